@@ -0,0 +1,475 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+// db_bench style benchmark for koradb. Example:
+//
+//   ./koradb_bench --benchmarks=fillseq,readrandom,mixed --num=200000 --value_size=100 --threads=4
+//
+
+#include "../include/kdb.h"
+#include "../include/histogram.h"
+#include "../include/perf_context.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // comma separated list of operations to run, in the given order
+    const char* FLAGS_benchmarks = "fillseq,fillrandom,overwrite,readrandom,readmissing,readseq,deleterandom,mixed";
+    // number of key/value pairs to place in the database
+    long FLAGS_num = 100000;
+    // number of read operations to do. If negative, do FLAGS_num reads
+    long FLAGS_reads = 1000;
+    // number of concurrent threads to run
+    int FLAGS_threads = 1;
+    // size of each key
+    int FLAGS_key_size = 16;
+    // size of each value
+    int FLAGS_value_size = 100;
+    // percentage of Get()s in the mixed workload, the rest are Set()s
+    int FLAGS_read_percent = 90;
+    // print the full latency histogram of each benchmark
+    bool FLAGS_histogram = false;
+    // print the "kora.stats" property after the last benchmark
+    bool FLAGS_stats = false;
+    // perf context level for the benchmark threads (0 disabled, 1 counters, 2 counters and timers). The context of the
+    // first thread is printed after each benchmark
+    int FLAGS_perf_level = 0;
+    // base directory for the benchmark database. It must not exist yet or be empty, and is removed when done unless
+    // --keep_db is set. A fresh temp directory is used if not given
+    const char* FLAGS_db = nullptr;
+    // don't remove the database directory when done
+    bool FLAGS_keep_db = false;
+    // seed for the random key generators
+    int FLAGS_seed = 301;
+    // number of shards the database spreads keys over
+    int FLAGS_shards = 1;
+    // set Options::fixed_key_size to --key_size, so that 8 and 16 byte keys are compared as integers
+    bool FLAGS_fixed_key_size = false;
+    // set Options::learned_index, so that segments of keys of one size are searched through learned models
+    bool FLAGS_learned_index = false;
+    // the merge operator of the database: uint64add, stringappend (with ',' as the delimiter) or none. By default
+    // uint64add is set when --benchmarks holds mergerandom and none otherwise, so that the other benchmarks measure
+    // a database without one
+    const char* FLAGS_merge_operator = nullptr;
+
+    double NowMicros() {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /**
+     * Pre-generated buffer of printable bytes values are sliced from. Keys and values are handed to the storage engine
+     * as C strings, so the buffer must never contain a NUL byte.
+     */
+    class RandomGenerator {
+    public:
+        RandomGenerator() {
+            std::mt19937 rnd(301);
+            std::uniform_int_distribution<int> dist(' ', '~');
+            _data.resize(1048576 + FLAGS_value_size);
+            for (char& c: _data) c = static_cast<char>(dist(rnd));
+        }
+
+        std::string Generate(size_t len) {
+            if (_pos + len > _data.size()) _pos = 0;
+            _pos += len;
+            return _data.substr(_pos - len, len);
+        }
+    private:
+        std::string _data;
+        size_t _pos = 0;
+    };
+
+    std::string MakeKey(long k) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%0*ld", FLAGS_key_size > 30 ? 30 : FLAGS_key_size, k);
+        std::string key(buf);
+        if (key.size() < static_cast<size_t>(FLAGS_key_size)) key.append(FLAGS_key_size - key.size(), 'x');
+        return key;
+    }
+
+    class Stats {
+    public:
+        void Start() {
+            _start = NowMicros();
+            _last_op_finish = _start;
+        }
+
+        void Stop() { _finish = NowMicros(); }
+
+        void FinishedSingleOp() {
+            double now = NowMicros();
+            _hist.Add(now - _last_op_finish);
+            _last_op_finish = now;
+            ++_done;
+        }
+
+        // n operations timed together, e.g. ones too short to time one by one
+        void FinishedOps(long n) {
+            double now = NowMicros();
+            _hist.Add((now - _last_op_finish) / n);
+            _last_op_finish = now;
+            _done += n;
+        }
+
+        void AddBytes(long n) { _bytes += n; }
+        void AddFound() { ++_found; }
+
+        void Merge(const Stats& other) {
+            _hist.Merge(other._hist);
+            _done += other._done;
+            _bytes += other._bytes;
+            _found += other._found;
+            // the elapsed time is the union of all the threads' running times
+            if (other._start < _start) _start = other._start;
+            if (other._finish > _finish) _finish = other._finish;
+        }
+
+        void Report(const std::string& name) const {
+            double elapsed = (_finish - _start) * 1e-6;
+            if (elapsed <= 0) elapsed = 1e-6;
+            std::ostringstream extra;
+            if (_bytes > 0) {
+                char rate[100];
+                std::snprintf(rate, sizeof(rate), "%6.1f MB/s", (_bytes / 1048576.0) / elapsed);
+                extra << rate;
+            }
+            if (_found >= 0 && name.rfind("read", 0) == 0) extra << " (" << _found << " of " << _done << " found)";
+            std::fprintf(stdout, "%-12s : %11.3f micros/op %10.0f ops/sec; %s\n", name.c_str(),
+                         elapsed * 1e6 / (_done ? _done : 1), _done / elapsed, extra.str().c_str());
+            std::fprintf(stdout, "%-12s   latency micros: P50: %.2f P99: %.2f P99.9: %.2f Max: %.2f\n", "",
+                         _hist.Percentile(50), _hist.Percentile(99), _hist.Percentile(99.9), _hist.Max());
+            if (FLAGS_histogram) std::fprintf(stdout, "Microseconds per op:\n%s\n", _hist.ToString().c_str());
+            std::fflush(stdout);
+        }
+    private:
+        double _start = 0;
+        double _finish = 0;
+        double _last_op_finish = 0;
+        long _done = 0;
+        long _bytes = 0;
+        long _found = 0;
+        Kora::Histogram _hist;
+    };
+
+    struct ThreadState {
+        int tid = 0;
+        long begin = 0; // first key index owned by this thread
+        long end = 0; // one past the last key index owned by this thread
+        std::mt19937_64 rnd;
+        Stats stats;
+        std::string perf_context;
+    };
+
+    class Benchmark {
+    public:
+        explicit Benchmark(fs::path db_path): _db_path{std::move(db_path)} {}
+
+        void Run() {
+            PrintHeader();
+            std::stringstream benchmarks(FLAGS_benchmarks);
+            std::string name;
+            while (std::getline(benchmarks, name, ',')) {
+                if (name.empty()) continue;
+                void (Benchmark::*method)(ThreadState*) = nullptr;
+                long ops = FLAGS_num;
+                if (name == "fillseq") method = &Benchmark::WriteSeq;
+                else if (name == "fillrandom" || name == "overwrite") method = &Benchmark::WriteRandom;
+                else if (name == "readrandom") { method = &Benchmark::ReadRandom; ops = Reads(); }
+                else if (name == "readmissing") { method = &Benchmark::ReadMissing; ops = Reads(); }
+                else if (name == "readseq") { method = &Benchmark::ReadSequential; ops = Reads(); }
+                else if (name == "deleterandom") method = &Benchmark::DeleteRandom;
+                else if (name == "mergerandom") method = &Benchmark::MergeRandom;
+                else if (name == "mixed") { method = &Benchmark::Mixed; ops = Reads(); }
+                else if (name == "compare") method = &Benchmark::CompareKeys;
+                else {
+                    std::fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+                    continue;
+                }
+                RunBenchmark(name, ops, method);
+            }
+            if (FLAGS_stats && _db != nullptr) {
+                std::fprintf(stdout, "\n%s\n", _db->GetProperty("kora.stats").data().c_str());
+            }
+        }
+
+    private:
+        fs::path _db_path;
+        std::unique_ptr<Kora::DB> _db;
+
+        static long Reads() { return FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads; }
+
+        void PrintHeader() const {
+            std::fprintf(stdout, "Keys:       %d bytes each\n", FLAGS_key_size);
+            std::fprintf(stdout, "Values:     %d bytes each\n", FLAGS_value_size);
+            std::fprintf(stdout, "Entries:    %ld\n", FLAGS_num);
+            std::fprintf(stdout, "Reads:      %ld\n", Reads());
+            std::fprintf(stdout, "Threads:    %d\n", FLAGS_threads);
+            std::fprintf(stdout, "Shards:     %d\n", FLAGS_shards);
+            std::fprintf(stdout, "Comparator: %s\n", FLAGS_fixed_key_size ? "fixed width" : "bytewise");
+            std::fprintf(stdout, "Index:      %s\n", FLAGS_learned_index ? "learned" : "partitioned");
+            std::fprintf(stdout, "Merges:     %s\n", FLAGS_merge_operator);
+            std::fprintf(stdout, "RawSize:    %.1f MB (estimated)\n",
+                         ((FLAGS_key_size + FLAGS_value_size) * static_cast<double>(FLAGS_num)) / 1048576.0);
+            std::fprintf(stdout, "DB:         %s\n", _db_path.string().c_str());
+            std::fprintf(stdout, "------------------------------------------------\n");
+            std::fflush(stdout);
+        }
+
+        void Open() {
+            if (_db != nullptr) return;
+            Kora::Options options;
+            options.num_shards = FLAGS_shards;
+            if (FLAGS_fixed_key_size) options.fixed_key_size = FLAGS_key_size;
+            options.learned_index = FLAGS_learned_index;
+            if (std::strcmp(FLAGS_merge_operator, "uint64add") == 0) options.merge_operator = std::make_shared<Kora::UInt64AddOperator>();
+            else if (std::strcmp(FLAGS_merge_operator, "stringappend") == 0) options.merge_operator = std::make_shared<Kora::StringAppendOperator>();
+            _db = std::make_unique<Kora::DB>(options, _db_path.string());
+        }
+
+        void RunBenchmark(const std::string& name, long ops, void (Benchmark::*method)(ThreadState*)) {
+            Open();
+            std::vector<std::unique_ptr<ThreadState>> states;
+            std::vector<std::thread> threads;
+            for (int i = 0; i < FLAGS_threads; i++) {
+                auto state = std::make_unique<ThreadState>();
+                state->tid = i;
+                state->begin = ops * i / FLAGS_threads;
+                state->end = ops * (i + 1) / FLAGS_threads;
+                state->rnd.seed(FLAGS_seed + i * 1000 + name.size());
+                states.push_back(std::move(state));
+            }
+            for (auto& state: states) {
+                threads.emplace_back([this, method, s = state.get()] {
+                    Kora::SetPerfLevel(static_cast<Kora::PerfLevel>(FLAGS_perf_level));
+                    Kora::GetPerfContext()->Reset();
+                    s->stats.Start();
+                    (this->*method)(s);
+                    s->stats.Stop();
+                    s->perf_context = Kora::GetPerfContext()->ToString(true);
+                });
+            }
+            for (auto& t: threads) t.join();
+            Stats merged = states[0]->stats;
+            for (size_t i = 1; i < states.size(); i++) merged.Merge(states[i]->stats);
+            merged.Report(name);
+            if (FLAGS_perf_level > 0) std::fprintf(stdout, "%-12s   perf context: %s\n", "", states[0]->perf_context.c_str());
+        }
+
+        void DoWrite(ThreadState* thread, bool seq) {
+            RandomGenerator gen;
+            for (long i = thread->begin; i < thread->end; i++) {
+                long k = seq ? i : static_cast<long>(thread->rnd() % FLAGS_num);
+                std::string key = MakeKey(k);
+                Kora::Status s = _db->Set(key, gen.Generate(FLAGS_value_size));
+                if (!s.isOk()) {
+                    std::fprintf(stderr, "set error: %s\n", s.toString().c_str());
+                    std::exit(1);
+                }
+                thread->stats.AddBytes(FLAGS_key_size + FLAGS_value_size);
+                thread->stats.FinishedSingleOp();
+            }
+        }
+
+        void WriteSeq(ThreadState* thread) { DoWrite(thread, true); }
+
+        void WriteRandom(ThreadState* thread) { DoWrite(thread, false); }
+
+        void DoRead(ThreadState* thread, long k) {
+            auto result = _db->Get(MakeKey(k));
+            if (result.status().isOk()) {
+                thread->stats.AddFound();
+                thread->stats.AddBytes(FLAGS_key_size + result.data().size());
+            }
+            thread->stats.FinishedSingleOp();
+        }
+
+        void ReadRandom(ThreadState* thread) {
+            for (long i = thread->begin; i < thread->end; i++) {
+                DoRead(thread, static_cast<long>(thread->rnd() % FLAGS_num));
+            }
+        }
+
+        void ReadMissing(ThreadState* thread) {
+            // same width as existing keys but outside the populated range, so no segment can short-circuit on length
+            for (long i = thread->begin; i < thread->end; i++) {
+                DoRead(thread, FLAGS_num + static_cast<long>(thread->rnd() % FLAGS_num));
+            }
+        }
+
+        void ReadSequential(ThreadState* thread) {
+            // each thread scans its share of entries from the start of the keyspace, wrapping around at the end
+            auto it = _db->NewIterator();
+            it->SeekToFirst();
+            for (long i = thread->begin; i < thread->end; i++) {
+                if (!it->Valid()) {
+                    it->SeekToFirst();
+                    if (!it->Valid()) break;
+                }
+                thread->stats.AddFound();
+                thread->stats.AddBytes(it->key().size() + it->value().size());
+                thread->stats.FinishedSingleOp();
+                it->Next();
+            }
+        }
+
+        void DeleteRandom(ThreadState* thread) {
+            for (long i = thread->begin; i < thread->end; i++) {
+                Kora::Status s = _db->Delete(MakeKey(static_cast<long>(thread->rnd() % FLAGS_num)));
+                if (!s.isOk()) {
+                    std::fprintf(stderr, "delete error: %s\n", s.toString().c_str());
+                    std::exit(1);
+                }
+                thread->stats.FinishedSingleOp();
+            }
+        }
+
+        void MergeRandom(ThreadState* thread) {
+            // blind increments of 64 bit counters. Keys written by the fill benchmarks don't hold counters, reading
+            // them back after merging fails
+            const std::string one = Kora::UInt64AddOperator::Encode(1);
+            for (long i = thread->begin; i < thread->end; i++) {
+                Kora::Status s = _db->Merge(MakeKey(static_cast<long>(thread->rnd() % FLAGS_num)), one);
+                if (!s.isOk()) {
+                    std::fprintf(stderr, "merge error: %s\n", s.toString().c_str());
+                    std::exit(1);
+                }
+                thread->stats.AddBytes(FLAGS_key_size + one.size());
+                thread->stats.FinishedSingleOp();
+            }
+        }
+
+        void CompareKeys(ThreadState* thread) {
+            // the memtable comparator alone, on random pairs of keys that mostly share a long common prefix. The pairs
+            // are picked up front and timed a batch at a time, so the clock and the generator stay out of the numbers
+            Kora::Comparator comparator(FLAGS_fixed_key_size ? FLAGS_key_size : 0);
+            std::vector<std::string> keys;
+            for (int i = 0; i < 4096; i++) keys.push_back(MakeKey(static_cast<long>(thread->rnd() % FLAGS_num)));
+            std::vector<Kora::Data> a, b;
+            for (int i = 0; i < 4096; i++) {
+                auto& first = keys[thread->rnd() % keys.size()];
+                auto& second = keys[thread->rnd() % keys.size()];
+                a.emplace_back(first, first.size());
+                b.emplace_back(second, second.size());
+            }
+            const long batch = 1024;
+            long less = 0;
+            for (long i = thread->begin; i < thread->end; i += batch) {
+                long n = std::min(batch, thread->end - i);
+                for (long j = 0; j < n; j++) less += comparator(a[(i + j) % a.size()], b[(i + j) % b.size()]);
+                thread->stats.FinishedOps(n);
+            }
+            // keep the comparisons from being optimized away
+            volatile long sink = less;
+            (void) sink;
+        }
+
+        void Mixed(ThreadState* thread) {
+            RandomGenerator gen;
+            for (long i = thread->begin; i < thread->end; i++) {
+                long k = static_cast<long>(thread->rnd() % FLAGS_num);
+                if (static_cast<int>(thread->rnd() % 100) < FLAGS_read_percent) {
+                    DoRead(thread, k);
+                } else {
+                    Kora::Status s = _db->Set(MakeKey(k), gen.Generate(FLAGS_value_size));
+                    if (!s.isOk()) {
+                        std::fprintf(stderr, "set error: %s\n", s.toString().c_str());
+                        std::exit(1);
+                    }
+                    thread->stats.AddBytes(FLAGS_key_size + FLAGS_value_size);
+                    thread->stats.FinishedSingleOp();
+                }
+            }
+        }
+    };
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        long n;
+        char junk;
+        if (std::strncmp(argv[i], "--benchmarks=", 13) == 0) {
+            FLAGS_benchmarks = argv[i] + 13;
+        } else if (std::sscanf(argv[i], "--num=%ld%c", &n, &junk) == 1) {
+            FLAGS_num = n;
+        } else if (std::sscanf(argv[i], "--reads=%ld%c", &n, &junk) == 1) {
+            FLAGS_reads = n;
+        } else if (std::sscanf(argv[i], "--threads=%ld%c", &n, &junk) == 1) {
+            FLAGS_threads = static_cast<int>(n);
+        } else if (std::sscanf(argv[i], "--key_size=%ld%c", &n, &junk) == 1) {
+            FLAGS_key_size = static_cast<int>(n);
+        } else if (std::sscanf(argv[i], "--value_size=%ld%c", &n, &junk) == 1) {
+            FLAGS_value_size = static_cast<int>(n);
+        } else if (std::sscanf(argv[i], "--read_percent=%ld%c", &n, &junk) == 1) {
+            FLAGS_read_percent = static_cast<int>(n);
+        } else if (std::sscanf(argv[i], "--histogram=%ld%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_histogram = n == 1;
+        } else if (std::sscanf(argv[i], "--stats=%ld%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_stats = n == 1;
+        } else if (std::sscanf(argv[i], "--keep_db=%ld%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_keep_db = n == 1;
+        } else if (std::sscanf(argv[i], "--perf_level=%ld%c", &n, &junk) == 1 && n >= 0 && n <= 2) {
+            FLAGS_perf_level = static_cast<int>(n);
+        } else if (std::sscanf(argv[i], "--shards=%ld%c", &n, &junk) == 1 && n >= 1) {
+            FLAGS_shards = static_cast<int>(n);
+        } else if (std::sscanf(argv[i], "--fixed_key_size=%ld%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_fixed_key_size = n == 1;
+        } else if (std::sscanf(argv[i], "--learned_index=%ld%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_learned_index = n == 1;
+        } else if (std::sscanf(argv[i], "--seed=%ld%c", &n, &junk) == 1) {
+            FLAGS_seed = static_cast<int>(n);
+        } else if (std::strcmp(argv[i], "--merge_operator=uint64add") == 0 || std::strcmp(argv[i], "--merge_operator=stringappend") == 0 ||
+                   std::strcmp(argv[i], "--merge_operator=none") == 0) {
+            FLAGS_merge_operator = argv[i] + 17;
+        } else if (std::strncmp(argv[i], "--db=", 5) == 0) {
+            FLAGS_db = argv[i] + 5;
+        } else {
+            std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (FLAGS_num <= 0 || FLAGS_threads <= 0 || FLAGS_key_size <= 0 || FLAGS_value_size <= 0) {
+        std::fprintf(stderr, "--num, --threads, --key_size and --value_size must be positive\n");
+        return 1;
+    }
+    if (FLAGS_merge_operator == nullptr) {
+        std::stringstream benchmarks(FLAGS_benchmarks);
+        std::string name;
+        FLAGS_merge_operator = "none";
+        while (std::getline(benchmarks, name, ',')) {
+            if (name == "mergerandom") FLAGS_merge_operator = "uint64add";
+        }
+    }
+
+    fs::path base = FLAGS_db != nullptr ? fs::path(FLAGS_db)
+                                        : fs::temp_directory_path() / ("koradb_bench_" + std::to_string(getpid()));
+    // a --db pointing at a directory that holds anything, e.g. a real database, is never emptied
+    std::error_code ec;
+    if (fs::exists(base, ec) && !fs::is_empty(base, ec)) {
+        std::fprintf(stderr, "%s is not empty, pick an empty or new directory for --db\n", base.string().c_str());
+        return 1;
+    }
+
+    {
+        Benchmark benchmark(base);
+        benchmark.Run();
+    }
+
+    if (!FLAGS_keep_db) fs::remove_all(base);
+    return 0;
+}
@@ -0,0 +1,205 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+// Replays a trace recorded with DB::StartTrace() against a fresh database. Example:
+//
+//   ./koradb_replay --trace=/tmp/app.trace --replay_speed=0 --histogram=1
+//
+
+#include "../include/kdb.h"
+#include "../include/histogram.h"
+#include "../include/trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // the trace file to replay
+    const char* FLAGS_trace = nullptr;
+    // how fast to replay the trace relative to when its operations were recorded: 1 at the original speed, 2 twice as
+    // fast. 0 replays every operation as soon as the previous one returns
+    double FLAGS_replay_speed = 1;
+    // directory of the database to replay against. It must not exist yet or be empty, and is removed when done unless
+    // --keep_db is set. A fresh temp directory is used if not given
+    const char* FLAGS_db = nullptr;
+    // don't remove the database directory when done
+    bool FLAGS_keep_db = false;
+    // number of shards the database spreads keys over
+    int FLAGS_shards = 1;
+    // print the full latency histogram of each operation type
+    bool FLAGS_histogram = false;
+    // print the "kora.stats" property at the end
+    bool FLAGS_stats = false;
+    // the merge operator of the traced database, which its merges are replayed with: uint64add, stringappend (with
+    // ',' as the delimiter) or none, which fails the replay at the first batch holding a merge
+    const char* FLAGS_merge_operator = "uint64add";
+
+    double NowMicros() {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    struct OpStats {
+        explicit OpStats(const char* name): name{name} {}
+
+        const char* name;
+        long done = 0;
+        long found = 0;
+        Kora::Histogram hist;
+
+        void Report(double elapsed) const {
+            if (done == 0) return;
+            std::fprintf(stdout, "%-8s : %10ld ops %10.0f ops/sec", name, done, done / elapsed);
+            if (std::strcmp(name, "get") == 0) std::fprintf(stdout, " (%ld of %ld found)", found, done);
+            std::fprintf(stdout, "\n%-8s   latency micros: P50: %.2f P99: %.2f P99.9: %.2f Max: %.2f\n", "",
+                         hist.Percentile(50), hist.Percentile(99), hist.Percentile(99.9), hist.Max());
+            if (FLAGS_histogram) std::fprintf(stdout, "Microseconds per op:\n%s\n", hist.ToString().c_str());
+        }
+    };
+
+    int Replay(const fs::path& db_path) {
+        Kora::TraceReader trace(FLAGS_trace);
+        if (!trace.status().isOk()) {
+            std::fprintf(stderr, "%s\n", trace.status().toString().c_str());
+            return 1;
+        }
+        Kora::Options options;
+        options.num_shards = FLAGS_shards;
+        if (std::strcmp(FLAGS_merge_operator, "uint64add") == 0) options.merge_operator = std::make_shared<Kora::UInt64AddOperator>();
+        else if (std::strcmp(FLAGS_merge_operator, "stringappend") == 0) options.merge_operator = std::make_shared<Kora::StringAppendOperator>();
+        Kora::DB db(options, db_path.string());
+
+        OpStats stats[] = {OpStats("set"), OpStats("get"), OpStats("delete"), OpStats("write")};
+        Kora::Histogram all;
+        long bytes = 0;
+        // how far the replay fell behind the schedule of the trace at worst, when replaying at a set speed
+        double max_lag = 0;
+        Kora::TraceRecord record;
+        double start = NowMicros();
+        while (trace.Next(record)) {
+            if (FLAGS_replay_speed > 0) {
+                double due = start + record.timestamp / FLAGS_replay_speed;
+                double now = NowMicros();
+                if (due > now) std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long>(due - now)));
+                else if (now - due > max_lag) max_lag = now - due;
+            }
+            Kora::WriteOptions write_options;
+            write_options.sync = record.sync;
+            OpStats* op = nullptr;
+            Kora::Status status;
+            double op_start = NowMicros();
+            switch (record.type) {
+                case Kora::TraceType::_SET:
+                    op = &stats[0];
+                    bytes += record.key.size() + record.value.size();
+                    status = db.Set(write_options, record.key, record.value);
+                    break;
+                case Kora::TraceType::_GET: {
+                    op = &stats[1];
+                    auto result = db.Get(record.key);
+                    if (result.status().isOk()) {
+                        op->found++;
+                        bytes += record.key.size() + result.data().size();
+                    }
+                    break;
+                }
+                case Kora::TraceType::_DELETE:
+                    op = &stats[2];
+                    bytes += record.key.size();
+                    status = db.Delete(write_options, record.key);
+                    break;
+                case Kora::TraceType::_WRITE:
+                    op = &stats[3];
+                    bytes += record.batch.ByteSize();
+                    status = db.Write(write_options, record.batch);
+                    break;
+            }
+            double latency = NowMicros() - op_start;
+            if (op == nullptr) {
+                std::fprintf(stderr, "unknown operation in trace\n");
+                return 1;
+            }
+            if (!status.isOk()) {
+                std::fprintf(stderr, "%s error: %s\n", op->name, status.toString().c_str());
+                return 1;
+            }
+            op->done++;
+            op->hist.Add(latency);
+            all.Add(latency);
+        }
+        double elapsed = (NowMicros() - start) * 1e-6;
+        if (elapsed <= 0) elapsed = 1e-6;
+
+        std::fprintf(stdout, "Trace:      %s\n", FLAGS_trace);
+        if (FLAGS_replay_speed > 0) std::fprintf(stdout, "Speed:      %gx\n", FLAGS_replay_speed);
+        else std::fprintf(stdout, "Speed:      as fast as possible\n");
+        std::fprintf(stdout, "Shards:     %d\n", FLAGS_shards);
+        std::fprintf(stdout, "Merges:     %s\n", FLAGS_merge_operator);
+        std::fprintf(stdout, "DB:         %s\n", db_path.string().c_str());
+        std::fprintf(stdout, "------------------------------------------------\n");
+        std::fprintf(stdout, "%-8s : %10ld ops %10.0f ops/sec %6.1f MB/s in %.3f seconds\n", "replay", static_cast<long>(all.Count()),
+                     all.Count() / elapsed, (bytes / 1048576.0) / elapsed, elapsed);
+        std::fprintf(stdout, "%-8s   latency micros: P50: %.2f P99: %.2f P99.9: %.2f Max: %.2f\n", "",
+                     all.Percentile(50), all.Percentile(99), all.Percentile(99.9), all.Max());
+        if (FLAGS_replay_speed > 0) std::fprintf(stdout, "%-8s   fell behind the trace by up to %.0f micros\n", "", max_lag);
+        for (const auto& op: stats) op.Report(elapsed);
+        if (FLAGS_stats) std::fprintf(stdout, "\n%s\n", db.GetProperty("kora.stats").data().c_str());
+        std::fflush(stdout);
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        long n;
+        double d;
+        char junk;
+        if (std::strncmp(argv[i], "--trace=", 8) == 0) {
+            FLAGS_trace = argv[i] + 8;
+        } else if (std::sscanf(argv[i], "--replay_speed=%lf%c", &d, &junk) == 1 && d >= 0) {
+            FLAGS_replay_speed = d;
+        } else if (std::sscanf(argv[i], "--shards=%ld%c", &n, &junk) == 1 && n >= 1) {
+            FLAGS_shards = static_cast<int>(n);
+        } else if (std::sscanf(argv[i], "--histogram=%ld%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_histogram = n == 1;
+        } else if (std::sscanf(argv[i], "--stats=%ld%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_stats = n == 1;
+        } else if (std::sscanf(argv[i], "--keep_db=%ld%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_keep_db = n == 1;
+        } else if (std::strcmp(argv[i], "--merge_operator=uint64add") == 0 || std::strcmp(argv[i], "--merge_operator=stringappend") == 0 ||
+                   std::strcmp(argv[i], "--merge_operator=none") == 0) {
+            FLAGS_merge_operator = argv[i] + 17;
+        } else if (std::strncmp(argv[i], "--db=", 5) == 0) {
+            FLAGS_db = argv[i] + 5;
+        } else {
+            std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (FLAGS_trace == nullptr) {
+        std::fprintf(stderr, "--trace is required\n");
+        return 1;
+    }
+
+    fs::path base = FLAGS_db != nullptr ? fs::path(FLAGS_db)
+                                        : fs::temp_directory_path() / ("koradb_replay_" + std::to_string(getpid()));
+    // a --db pointing at a directory that holds anything, e.g. a real database, is never emptied
+    std::error_code ec;
+    if (fs::exists(base, ec) && !fs::is_empty(base, ec)) {
+        std::fprintf(stderr, "%s is not empty, pick an empty or new directory for --db\n", base.string().c_str());
+        return 1;
+    }
+
+    int result = Replay(base);
+
+    if (!FLAGS_keep_db) fs::remove_all(base);
+    return result;
+}
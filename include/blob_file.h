@@ -0,0 +1,108 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_BLOB_FILE_H
+#define KV_STORE_BLOB_FILE_H
+
+#include "direct_io.h"
+#include "helper.h"
+#include "status.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace Kora {
+    /**
+     * Where a value moved out of a segment lives: the number of its blob file, the offset of the value in that file
+     * and its size. Segments store it in place of the value
+     */
+    struct BlobIndex {
+        uint64_t file_number = 0;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+
+        // [file number][offset][size], 8 bytes each in host byte order
+        [[nodiscard]] std::string Encode() const;
+
+        // false if data doesn't hold an encoded index
+        bool Decode(const char* data, size_t size);
+
+        // bytes taken in the blob file by the record holding the value of key
+        [[nodiscard]] uint64_t RecordSize(size_t key_size) const { return sizeof(size_t) + sizeof(size_t) + key_size + size; }
+    };
+
+    /**
+     * Writes a new blob file. Values are appended as [size_t key size][size_t value size][key][value] records, the same
+     * layout as segment records, so that blob garbage collection can tell which key each value belongs to
+     */
+    class BlobFileWriter {
+    public:
+        BlobFileWriter(const fs::path& path, uint64_t number, bool use_direct_io = false): _file{path, use_direct_io}, _number{number} {}
+
+        // append a record and fill in the index of its value. False if the file could not be written
+        bool Add(const char* key, size_t key_size, const char* value, size_t value_size, BlobIndex& index);
+
+        // close the file. False if any write failed
+        bool Finish();
+
+        [[nodiscard]] uint64_t Size() const { return _offset; }
+
+    private:
+        DirectWritableFile _file;
+        uint64_t _number;
+        uint64_t _offset = 0;
+    };
+
+    /**
+     * A blob file that has been written out. Blob files never change once written; they are shared between the engine
+     * and its readers, and a file that no segment needs anymore is only removed from disk once the last reader holding
+     * it lets go
+     */
+    class BlobFile {
+    public:
+        BlobFile(fs::path path, uint64_t number);
+
+        ~BlobFile();
+
+        BlobFile(const BlobFile&) = delete;
+        BlobFile& operator=(const BlobFile&) = delete;
+
+        // read the value the index points at. Safe to call from several threads at once
+        Status Read(const BlobIndex& index, std::string& value) const;
+
+        [[nodiscard]] const fs::path& Path() const { return _path; }
+
+        [[nodiscard]] uint64_t Number() const { return _number; }
+
+        [[nodiscard]] uint64_t FileSize() const { return _file_size; }
+
+        /**
+         * Bytes of the records still referenced by a segment. The rest of the file is garbage left behind by values
+         * that were overwritten or deleted since
+         */
+        [[nodiscard]] uint64_t LiveBytes() const { return _live_bytes.load(std::memory_order_relaxed); }
+
+        void AddLiveBytes(uint64_t bytes) { _live_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+
+        void RemoveLiveBytes(uint64_t bytes);
+
+        // fraction of the file no segment references anymore
+        [[nodiscard]] double GarbageRatio() const;
+
+        // remove the file from disk once the last holder lets go of it
+        void MarkObsolete() { _obsolete = true; }
+
+    private:
+        fs::path _path;
+        uint64_t _number;
+        int _fd = -1;
+        uint64_t _file_size = 0;
+        std::atomic<uint64_t> _live_bytes{0};
+        std::atomic<bool> _obsolete{false};
+    };
+}
+
+#endif //KV_STORE_BLOB_FILE_H
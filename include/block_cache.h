@@ -0,0 +1,77 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_BLOCK_CACHE_H
+#define KV_STORE_BLOCK_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Kora {
+    /**
+     * LRU cache of segment blocks: index partitions, filter partitions and data blocks. Keys are split over shards by
+     * hash, each with its own lock and its own share of the capacity, so concurrent readers rarely wait on each other.
+     * One cache can be shared by any number of databases through Options::block_cache, which bounds their block memory
+     * together. Blocks handed out stay valid after they are evicted, until the last holder lets go of them
+     */
+    class BlockCache {
+    public:
+        using Block = std::shared_ptr<const std::string>;
+
+        static const size_t _DEFAULT_CAPACITY = 8 * 1024 * 1024; // in bytes ~ 8MB
+
+        explicit BlockCache(size_t capacity = _DEFAULT_CAPACITY, int num_shard_bits = 4);
+
+        // the cached block or nullptr. A hit makes the block the most recently used of its shard
+        Block Lookup(const std::string& key);
+
+        // cache block under key, evicting the least recently used blocks of the shard while it is over its capacity
+        void Insert(const std::string& key, Block block);
+
+        // drop the block cached under key, if any
+        void Erase(const std::string& key);
+
+        // bytes charged for the cached blocks, keys included
+        [[nodiscard]] size_t Usage() const;
+
+        [[nodiscard]] size_t Capacity() const { return _capacity.load(std::memory_order_relaxed); }
+
+        // evicts the least recently used blocks right away if the cache is over the new capacity
+        void SetCapacity(size_t capacity);
+
+        // cache key of the block at offset in the file with the given cache id
+        static std::string BlockKey(uint64_t cache_id, uint64_t offset);
+
+        // a cache id no other file has used in this process
+        static uint64_t NewCacheId();
+
+    private:
+        struct Shard {
+            std::mutex mutex;
+            // most recently used first
+            std::list<std::pair<std::string, Block>> lru;
+            std::unordered_map<std::string, std::list<std::pair<std::string, Block>>::iterator> entries;
+            size_t usage = 0;
+        };
+
+        // drop the least recently used blocks of a locked shard until it is within capacity
+        static void EvictToCapacity(Shard& shard, size_t capacity);
+
+        static size_t Charge(const std::string& key, const Block& block) { return key.size() + block->size() + _ENTRY_OVERHEAD; }
+
+        // bookkeeping bytes per entry on top of its key and block
+        static const size_t _ENTRY_OVERHEAD = 64;
+
+        std::atomic<size_t> _capacity;
+        std::vector<std::unique_ptr<Shard>> _shards;
+    };
+}
+
+#endif //KV_STORE_BLOCK_CACHE_H
@@ -0,0 +1,67 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_BLOOM_FILTER_H
+#define KV_STORE_BLOOM_FILTER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Kora {
+    // 64 bit hash of a key. Filters are stored in segment files, so it must never change
+    uint64_t StableHash(std::string_view key);
+
+    /**
+     * Collects keys and builds a Bloom filter over them: [bit array][uint8_t number of probes]
+     */
+    class BloomFilterBuilder {
+    public:
+        void AddKey(std::string_view key) { _hashes.push_back(StableHash(key)); }
+
+        // add the keys added to other
+        void AddKeys(const BloomFilterBuilder& other) { _hashes.insert(_hashes.end(), other._hashes.begin(), other._hashes.end()); }
+
+        [[nodiscard]] size_t NumKeys() const { return _hashes.size(); }
+
+        // the filter of the keys added so far, with bits_per_key bits per key
+        [[nodiscard]] std::string Finish(int bits_per_key) const;
+
+        void Clear() { _hashes.clear(); }
+
+    private:
+        std::vector<uint64_t> _hashes;
+    };
+
+    // false if key was definitely not added to the filter. An empty or malformed filter matches every key
+    bool BloomFilterMayMatch(std::string_view filter, std::string_view key);
+
+    /**
+     * A Bloom filter of a fixed number of bits that keys are added to one at a time, e.g. the prefixes written to a
+     * memtable. The bits are only allocated once the first key is added. Not thread-safe
+     */
+    class DynamicBloom {
+    public:
+        explicit DynamicBloom(size_t bits = 0);
+
+        void AddKey(std::string_view key);
+
+        // false if key was definitely not added. A filter without bits matches every key
+        [[nodiscard]] bool MayMatch(std::string_view key) const;
+
+        // bytes the bits take once allocated
+        [[nodiscard]] size_t Bytes() const { return _bits / 8; }
+
+        [[nodiscard]] bool Empty() const { return _data.empty(); }
+
+    private:
+        static const int _NUM_PROBES = 6;
+
+        size_t _bits;
+        std::vector<uint64_t> _data;
+    };
+}
+
+#endif //KV_STORE_BLOOM_FILTER_H
@@ -0,0 +1,60 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_COMPACTION_FILTER_H
+#define KV_STORE_COMPACTION_FILTER_H
+
+#include <cstdint>
+#include <string>
+
+namespace Kora {
+    /**
+     * Lets the application drop or rewrite values while compaction merges segments, e.g. to expire old data without
+     * having to Delete() it. Compaction calls the filter for the value each key keeps after the merge; tombstones and
+     * merge operands that can't be applied yet are not passed to it. Values moved to blob files are read for it.
+     *
+     * The filter may be called from background threads at any time, so it must be thread safe.
+     */
+    class CompactionFilter {
+    public:
+        enum class Decision {
+            _KEEP = 0,
+            _REMOVE = 1, // the key is deleted. Compaction leaves a tombstone unless nothing older can hold the key
+            _CHANGE_VALUE = 2 // the value is replaced by new_value
+        };
+
+        virtual ~CompactionFilter() = default;
+
+        virtual Decision Filter(const std::string& key, const std::string& existing_value, std::string* new_value) const = 0;
+
+        virtual const char* Name() const = 0;
+    };
+
+    /**
+     * Removes values whose expiry time has passed. Values are stored with their expiry time as 8 trailing bytes, a
+     * unix timestamp in seconds in host byte order; use Encode() to write them and Decode() to read them back. Values
+     * too short to hold a timestamp are kept. Expired values stay readable until compaction gets to them, so readers
+     * should check the expiry time returned by Decode() themselves.
+     */
+    class TtlCompactionFilter : public CompactionFilter {
+    public:
+        Decision Filter(const std::string& key, const std::string& existing_value, std::string* new_value) const override;
+
+        const char* Name() const override { return "TtlCompactionFilter"; }
+
+        // value followed by its expiry time
+        static std::string Encode(const std::string& value, uint64_t expiry_time);
+
+        // value that expires ttl_seconds from now
+        static std::string EncodeWithTtl(const std::string& value, uint64_t ttl_seconds);
+
+        // false if stored is too short to hold an expiry time
+        static bool Decode(const std::string& stored, std::string* value, uint64_t* expiry_time);
+
+        // current unix time in seconds
+        static uint64_t Now();
+    };
+}
+
+#endif //KV_STORE_COMPACTION_FILTER_H
@@ -0,0 +1,215 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_COMPACTION_PIPELINE_H
+#define KV_STORE_COMPACTION_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "direct_io.h"
+#include "helper.h"
+
+namespace Kora {
+    /**
+     * A first in, first out queue of at most capacity items that hands work from one stage of a pipeline to the next.
+     * Push() waits while the queue is full and Pop() while it is empty, so a fast stage can't run away from a slow one.
+     * Both stop waiting once the queue is closed
+     */
+    template<typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity): _capacity{capacity} {}
+
+        // false if the queue was closed, in which case item is dropped
+        bool Push(T&& item) {
+            std::unique_lock<std::mutex> ulock(_mutex);
+            _cond.wait(ulock, [this] { return _items.size() < _capacity || _closed; });
+            if (_closed) return false;
+            _items.push_back(std::move(item));
+            _cond.notify_all();
+            return true;
+        }
+
+        // false once the queue is closed and every item pushed before has been popped
+        bool Pop(T& item) {
+            std::unique_lock<std::mutex> ulock(_mutex);
+            _cond.wait(ulock, [this] { return !_items.empty() || _closed; });
+            if (_items.empty()) return false;
+            item = std::move(_items.front());
+            _items.pop_front();
+            _cond.notify_all();
+            return true;
+        }
+
+        // nothing more will be pushed
+        void Close() {
+            std::lock_guard<std::mutex> lg(_mutex);
+            _closed = true;
+            _cond.notify_all();
+        }
+
+    private:
+        size_t _capacity;
+        std::deque<T> _items;
+        bool _closed = false;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+    };
+
+    /**
+     * The read stage of a compaction. A thread of its own reads the key-value records of one input segment ahead of
+     * the merge and decodes them into batches of about _BATCH_BYTES, of which up to _QUEUE_BATCHES wait for the merge.
+     * The merge only waits for the disk when it has caught up with it
+     */
+    class PrefetchingSegmentReader {
+    public:
+        // reads the records in [data_offset, data_end) of the segment at path
+        PrefetchingSegmentReader(const fs::path& path, uint64_t data_offset, uint64_t data_end, size_t readahead_size,
+                                 bool use_direct_io);
+
+        ~PrefetchingSegmentReader();
+
+        PrefetchingSegmentReader(const PrefetchingSegmentReader&) = delete;
+        PrefetchingSegmentReader& operator=(const PrefetchingSegmentReader&) = delete;
+
+        // move on to the next record. False at the end of the records or of the readable part of the file
+        bool Next();
+
+        // the current record, valid until the next call to Next()
+        [[nodiscard]] const std::string& key() const { return _batch[_next - 1].first; }
+        [[nodiscard]] const std::string& value() const { return _batch[_next - 1].second; }
+
+        // time the reader thread spent reading and decoding
+        [[nodiscard]] uint64_t BusyMicros() const { return _busy_micros.load(std::memory_order_relaxed); }
+
+        // time Next() spent waiting for the reader thread
+        [[nodiscard]] uint64_t WaitMicros() const { return _wait_micros; }
+
+    private:
+        using Batch = std::vector<std::pair<std::string, std::string>>;
+
+        void Run();
+
+        static const size_t _BATCH_BYTES = 256 * 1024;
+        static const size_t _QUEUE_BATCHES = 4;
+
+        SequentialFileReader _file;
+        uint64_t _pos;
+        uint64_t _end;
+        BoundedQueue<Batch> _queue{_QUEUE_BATCHES};
+        // the batch the merge is working through, and the index of its next record
+        Batch _batch;
+        size_t _next = 0;
+        std::atomic<uint64_t> _busy_micros{0};
+        uint64_t _wait_micros = 0;
+        std::thread _thread;
+    };
+
+    // bytes [start, end) of a file that one key range of a compaction split into subcompactions was written to
+    struct FileRegion {
+        uint64_t start = 0;
+        uint64_t end = 0;
+    };
+
+    /**
+     * Make one run of records of the file at path, whose key ranges were written at once into regions that start at
+     * multiples of alignment, the block size of its filesystem, with at least PADDING_HEADER_SIZE bytes between each
+     * region and the next. The file is cut back to the end of the last region, and the gap after each other region
+     * becomes a padding record. Where the filesystem can collapse a range of a file, as ext4 and XFS can, the whole
+     * blocks of each gap are cut out, which moves the regions after it down without writing them again; elsewhere
+     * the gaps stay as holes. The regions are updated to where they end up. False if the file could not be changed
+     */
+    bool JoinFileRegions(const fs::path& path, std::vector<FileRegion>& regions, uint64_t alignment);
+
+    // copy the whole of the open file fd to a new file at path, in the kernel where it can be, and sync it
+    bool CopyOpenFile(int fd, const fs::path& path);
+
+    /**
+     * The write stage of a compaction: an output stream whose bytes a thread of its own writes to the file. The stream
+     * fills one buffer of _BUFFER_SIZE bytes while the thread writes the other, so the merge only waits for the disk
+     * when the disk has fallen a whole buffer behind
+     */
+    class AsyncWritableFile : public std::ostream {
+    public:
+        AsyncWritableFile(const fs::path& path, bool use_direct_io);
+
+        // write the file at path from offset on, e.g. one key range of a compaction split into subcompactions. See
+        // DirectFileBuffer::OpenForWriteAt
+        AsyncWritableFile(const fs::path& path, bool use_direct_io, uint64_t offset);
+
+        ~AsyncWritableFile() override { close(); }
+
+        [[nodiscard]] bool is_open() const { return _buffer.IsOpen(); }
+
+        // write out what is left and close the file. Sets badbit if anything could not be written
+        void close();
+
+        [[nodiscard]] bool UsingDirectIO() const { return _buffer.UsingDirectIO(); }
+
+        // time the writer thread spent writing
+        [[nodiscard]] uint64_t BusyMicros() const { return _buffer.BusyMicros(); }
+
+        // time the stream spent waiting for a buffer the writer thread was still writing
+        [[nodiscard]] uint64_t WaitMicros() const { return _buffer.WaitMicros(); }
+
+    private:
+        class Buffer : public std::streambuf {
+        public:
+            Buffer(const fs::path& path, bool use_direct_io);
+
+            Buffer(const fs::path& path, bool use_direct_io, uint64_t offset);
+
+            ~Buffer() override { Close(); }
+
+            bool Close();
+
+            [[nodiscard]] bool IsOpen() const { return _thread.joinable(); }
+
+            [[nodiscard]] bool UsingDirectIO() const { return _file.UsingDirectIO(); }
+
+            [[nodiscard]] uint64_t BusyMicros() const { return _busy_micros.load(std::memory_order_relaxed); }
+
+            [[nodiscard]] uint64_t WaitMicros() const { return _wait_micros; }
+
+        protected:
+            int_type overflow(int_type c) override;
+
+        private:
+            // set up the buffers and start the writer thread once the file is open
+            void Start();
+
+            // hand the filled part of the current buffer to the writer thread and take the other one
+            bool Hand();
+
+            void Run();
+
+            static const size_t _BUFFER_SIZE = 1024 * 1024;
+
+            DirectWritableFile _file;
+            std::string _current;
+            // buffers waiting to be written, and buffers the writer thread is done with
+            BoundedQueue<std::string> _full{1};
+            BoundedQueue<std::string> _free{2};
+            bool _failed = false;
+            std::atomic<uint64_t> _busy_micros{0};
+            uint64_t _wait_micros = 0;
+            std::thread _thread;
+        };
+
+        Buffer _buffer;
+    };
+}
+
+#endif //KV_STORE_COMPACTION_PIPELINE_H
@@ -5,6 +5,8 @@
 #ifndef KV_STORE_DATA_H
 #define KV_STORE_DATA_H
 
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <iostream>
@@ -18,19 +20,36 @@ namespace Kora {
         Data(std::string& str, size_t size) : _data{str.data()}, _size(size) {}
         explicit Data(std::string str) : _data{str.data()}, _size(str.size()) {}
 
-        // copy constructor
+        // copy constructor. Copies exactly size bytes, values may contain null bytes. The copy owns its bytes
         Data(const Data& other): _data {nullptr}, _size {0} {
             _data = (char *) malloc(other._size + 1);
-            strcpy(_data, other._data);
+            memcpy(_data, other._data, other._size);
+            _data[other._size] = '\0';
             _size = other._size;
+            _owned = true;
+        }
+        // copy assignment. Copies the bytes like the copy constructor
+        Data& operator=(const Data& other) {
+            if (this != &other) {
+                Data copy(other);
+                Swap(copy);
+            }
+            return *this;
         }
-        // copy assignment
-        Data& operator=(const Data&) = default;
 
         // move constructor
         Data(Data&& that) noexcept: _data{nullptr}, _size{0} {
-            std::swap(_data, that._data);
-            std::swap(_size, that._size);
+            Swap(that);
+        }
+        // move assignment. Whatever this held is freed with that
+        Data& operator=(Data&& that) noexcept {
+            Swap(that);
+            return *this;
+        }
+
+        // only copies free their bytes, the other constructors merely point at the caller's bytes
+        ~Data() {
+            if (_owned) free(_data);
         }
 
         //getters
@@ -40,36 +59,65 @@ namespace Kora {
         // return the length of the referenced data in bytes
         [[nodiscard]] size_t size() const { return _size; }
     private:
+        void Swap(Data& other) noexcept {
+            std::swap(_data, other._data);
+            std::swap(_size, other._size);
+            std::swap(_owned, other._owned);
+        }
+
         char* _data = nullptr;
         size_t _size = 0;
+        bool _owned = false;
     };
 
+    /**
+     * Orders keys byte by byte like memcmp, a key that is a prefix of another first. With a fixed key size of 8 or
+     * 16, keys of that size are loaded as big-endian integers and compared with one or two integer comparisons, which
+     * gives the same order; keys of any other size still take the byte by byte path
+     */
     class Comparator {
     public:
+        explicit Comparator(size_t fixed_key_size = 0): _fixed_key_size{fixed_key_size} {}
+
         bool operator()(const Data& d1, const Data& d2) const {
+            if (d1.size() == _fixed_key_size && d2.size() == _fixed_key_size) {
+                if (_fixed_key_size == 8) return FixedKeyLess<8>(d1.data(), d2.data());
+                if (_fixed_key_size == 16) return FixedKeyLess<16>(d1.data(), d2.data());
+            }
+            return BytewiseLess(d1, d2);
+        }
+
+        static bool BytewiseLess(const Data& d1, const Data& d2) {
             const size_t min_len = (d1.size() < d2.size()) ? d1.size() : d2.size();
             int result = memcmp(d1.data(), d2.data(), min_len);
-            if (result < 0) {
-                // first differing byte in d1 is less than that of d2, hence  d1 precedes d2
-                return true;
-            }
-            if (result == 0) {
-                if (d1.size() < d2.size()) {
-                    // they are not the same length and d1 is the smaller one, then it precedes d2
-                    return true;
-                } else if (d1.size() > d2.size()) {
-                    return false;
-                } else {
-                    // they are same so bool doesn't really matter here
-                    return false;
-                }
-            }
+            // with equal leading bytes the shorter key precedes the longer one
+            return result < 0 || (result == 0 && d1.size() < d2.size());
+        }
 
-            if (result > 0) {
-                // first differing byte in d1 is greater than that of d2, hence d2 precedes d1
-                return false;
+        // compares two keys of N bytes, a multiple of 8, as big-endian integers a word at a time
+        template <size_t N>
+        static bool FixedKeyLess(const char* a, const char* b) {
+            static_assert(N % 8 == 0, "fixed keys are compared 8 bytes at a time");
+            for (size_t i = 0; i < N; i += 8) {
+                uint64_t x = LoadBigEndian64(a + i), y = LoadBigEndian64(b + i);
+                if (x != y) return x < y;
             }
+            return false;
         }
+
+        [[nodiscard]] size_t FixedKeySize() const { return _fixed_key_size; }
+
+    private:
+        static uint64_t LoadBigEndian64(const char* p) {
+            uint64_t value;
+            memcpy(&value, p, sizeof value);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            value = __builtin_bswap64(value);
+#endif
+            return value;
+        }
+
+        size_t _fixed_key_size;
     };
 }
 
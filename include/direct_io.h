@@ -0,0 +1,151 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_DIRECT_IO_H
+#define KV_STORE_DIRECT_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+
+#include "helper.h"
+
+namespace Kora {
+    /**
+     * A file opened with O_DIRECT, so that its reads and writes bypass the page cache, through a buffer aligned to the
+     * block size of its filesystem. Transfers then always start at a multiple of the block size and are a multiple of
+     * it long. If the filesystem rejects O_DIRECT, as tmpfs does, the file falls back to buffered I/O.
+     * Files read with buffered I/O are read ahead: each read asks the kernel to fetch the next window in the background
+     * while the current one is consumed
+     */
+    class DirectFileBuffer : public std::streambuf {
+    public:
+        DirectFileBuffer() = default;
+
+        ~DirectFileBuffer() override;
+
+        DirectFileBuffer(const DirectFileBuffer&) = delete;
+        DirectFileBuffer& operator=(const DirectFileBuffer&) = delete;
+
+        // open path for writing, truncating it. direct false opens it for buffered I/O right away
+        bool OpenForWrite(const fs::path& path, bool direct);
+
+        /**
+         * open path for writing from offset on, creating it if need be but leaving the rest of it as it is, so that
+         * several buffers can write regions of one file at once. offset has to be a multiple of the block size for
+         * direct I/O. Close() doesn't cut off the padding of the last transfer, which the caller has to
+         */
+        bool OpenForWriteAt(const fs::path& path, bool direct, uint64_t offset);
+
+        /**
+         * open path for reading, readahead bytes at a time. With auto_readahead the reads start at _MIN_READAHEAD bytes
+         * and double with every read that follows on from the last one, up to readahead, so that short scans don't pay
+         * for a large buffer. A seek starts over with small reads
+         */
+        bool OpenForRead(const fs::path& path, bool direct, size_t readahead, bool auto_readahead);
+
+        // write out what is left, padded to the block size, and cut the file back to the bytes actually written
+        // unless it was opened with OpenForWriteAt()
+        bool Close();
+
+        [[nodiscard]] bool IsOpen() const { return _fd >= 0; }
+
+        [[nodiscard]] bool UsingDirectIO() const { return _direct; }
+
+        // bytes of the buffer
+        [[nodiscard]] size_t BufferSize() const { return _capacity; }
+
+        // bytes read from the file so far
+        [[nodiscard]] uint64_t BytesRead() const { return _bytes_read; }
+
+        static const size_t _MIN_READAHEAD = 8 * 1024;
+
+    protected:
+        int_type overflow(int_type c) override;
+        int sync() override;
+        int_type underflow() override;
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+    private:
+        bool Open(const fs::path& path, int flags, bool direct, size_t capacity);
+
+        // make room for size bytes in the buffer, keeping the alignment
+        bool Reserve(size_t size);
+
+        // write the first size bytes of the buffer at _file_offset
+        bool Write(size_t size);
+
+        // fill the buffer from the block holding offset on. False at the end of the file or on an error
+        bool Fill(uint64_t offset);
+
+        // O_DIRECT was rejected for a transfer: go on with buffered I/O
+        bool DropDirectIO();
+
+        // bytes per O_DIRECT write
+        static const size_t _BUFFER_SIZE = 1024 * 1024;
+
+        int _fd = -1;
+        bool _direct = false;
+        bool _writing = false;
+        bool _truncate = true;
+        bool _failed = false;
+        size_t _alignment = 4096;
+        size_t _capacity = 0;
+        char* _buffer = nullptr;
+        // file offset of the start of the buffer
+        uint64_t _file_offset = 0;
+        // bytes asked for by the next read, the most that may be asked for, and whether the next read follows on from
+        // the last one
+        size_t _window = 0;
+        size_t _max_window = 0;
+        bool _auto_readahead = false;
+        bool _sequential = false;
+        uint64_t _bytes_read = 0;
+    };
+
+    // an output stream over a DirectFileBuffer. close() sets badbit if anything could not be written
+    class DirectWritableFile : public std::ostream {
+    public:
+        DirectWritableFile(const fs::path& path, bool use_direct_io);
+
+        // write the file at path from offset on. See DirectFileBuffer::OpenForWriteAt
+        DirectWritableFile(const fs::path& path, bool use_direct_io, uint64_t offset);
+
+        ~DirectWritableFile() override { close(); }
+
+        [[nodiscard]] bool is_open() const { return _buffer.IsOpen(); }
+
+        void close();
+
+        [[nodiscard]] bool UsingDirectIO() const { return _buffer.UsingDirectIO(); }
+
+    private:
+        DirectFileBuffer _buffer;
+    };
+
+    /**
+     * An input stream over a DirectFileBuffer, for reading a file from front to back readahead_size bytes at a time,
+     * e.g. compaction inputs and log files. See DirectFileBuffer::OpenForRead for auto_readahead
+     */
+    class SequentialFileReader : public std::istream {
+    public:
+        SequentialFileReader(const fs::path& path, size_t readahead_size, bool use_direct_io = false, bool auto_readahead = false);
+
+        [[nodiscard]] bool is_open() const { return _buffer.IsOpen(); }
+
+        [[nodiscard]] bool UsingDirectIO() const { return _buffer.UsingDirectIO(); }
+
+        [[nodiscard]] size_t BufferSize() const { return _buffer.BufferSize(); }
+
+        [[nodiscard]] uint64_t BytesRead() const { return _buffer.BytesRead(); }
+
+    private:
+        DirectFileBuffer _buffer;
+    };
+}
+
+#endif //KV_STORE_DIRECT_IO_H
@@ -11,6 +11,7 @@
 #include <ctime>
 #include <fstream>
 #include <sstream>
+#include <cstdint>
 
 namespace fs = std::filesystem;
 
@@ -24,31 +25,21 @@ namespace Kora {
         return c1.filepath.string().compare(c2.filepath.string()) == 0;
     }
 
-    inline void createDBDirectory() {
-        fs::path p = fs::current_path();
-        auto parent_path = p.parent_path();
-        auto db_path = parent_path /= "db";
-        if (!fs::exists(db_path)) {
-            if (!fs::create_directory(db_path)) {
-                exit(1);
-            }
-        }
-    }
+    /**
+     * Key size of a padding record in a segment: [key size][value size] followed by value size bytes that hold no
+     * record, which readers skip. A compaction split into subcompactions leaves one between its key ranges
+     */
+    const size_t PADDING_RECORD = SIZE_MAX;
+    const size_t PADDING_HEADER_SIZE = 2 * sizeof(size_t);
 
     inline void createDir(fs::path&& dir_path) {
         if (!fs::exists(dir_path)) {
-            if (!fs::create_directory(dir_path)) {
+            if (!fs::create_directories(dir_path)) {
                 exit(1);
             }
         }
     }
 
-    inline fs::path getDBPath() {
-        fs::path p = fs::current_path();
-        auto parent_path = p.parent_path();
-        return parent_path /= "db";
-    }
-
     inline std::string now() {
         static int count = 0;
         auto result = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
@@ -57,6 +48,11 @@ namespace Kora {
         return ss.str();
     }
 
+    // microseconds on a monotonic clock. Only meaningful for measuring elapsed time
+    inline uint64_t nowMicros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
     inline size_t fileLength(std::ifstream& file) {
         file.seekg(0, file.end);
         size_t length = file.tellg();
@@ -64,9 +60,8 @@ namespace Kora {
         return length;
     }
 
-    inline int sstableCount() {
+    inline int sstableCount(const fs::path& path) {
         int count = 0;
-        auto path = getDBPath();
         if (!fs::exists(path)) return count;
         for(auto const& dir_entry: fs::directory_iterator{path}) {
             if (dir_entry.exists() && dir_entry.is_regular_file()) {
@@ -77,6 +72,26 @@ namespace Kora {
         return count;
     }
 
+    // whether path holds a log file: log.kdb, or a numbered log_<number>.kdb
+    inline bool hasLogFile(const fs::path& path) {
+        if (!fs::exists(path)) return false;
+        for (auto const& dir_entry: fs::directory_iterator{path}) {
+            auto filename = dir_entry.path().filename().string();
+            if (dir_entry.path().extension() == ".kdb" && (filename == "log.kdb" || filename.rfind("log_", 0) == 0)) return true;
+        }
+        return false;
+    }
+
+    // 64 bit FNV-1a. Stable across builds and platforms, so it can decide where a key is stored on disk
+    inline uint64_t hashKey(const char* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
     inline long getSegmentFileAsLong(fs::path filename) {
         std::string filename_str = filename.string();
         filename_str = filename_str.substr(0, filename_str.find_last_of('.'));
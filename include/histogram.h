@@ -0,0 +1,47 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_HISTOGRAM_H
+#define KV_STORE_HISTOGRAM_H
+
+#include <string>
+
+namespace Kora {
+    /**
+     * Fixed bucket latency histogram. Values are expected in microseconds. Buckets grow roughly geometrically so that
+     * both sub-microsecond memtable hits and multi-second flush stalls can be recorded without losing the tail.
+     */
+    class Histogram {
+    public:
+        Histogram() { Clear(); }
+
+        void Clear();
+        void Add(double value);
+        void Merge(const Histogram& other);
+
+        [[nodiscard]] double Count() const { return _num; }
+        [[nodiscard]] double Sum() const { return _sum; }
+        [[nodiscard]] double Min() const { return _min; }
+        [[nodiscard]] double Max() const { return _max; }
+        [[nodiscard]] double Median() const { return Percentile(50.0); }
+        [[nodiscard]] double Percentile(double p) const;
+        [[nodiscard]] double Average() const;
+        [[nodiscard]] double StandardDeviation() const;
+
+        [[nodiscard]] std::string ToString() const;
+
+        static const int _NUM_BUCKETS = 154;
+    private:
+        static const double _BUCKET_LIMIT[_NUM_BUCKETS];
+
+        double _min = 0;
+        double _max = 0;
+        double _num = 0;
+        double _sum = 0;
+        double _sum_squares = 0;
+        double _buckets[_NUM_BUCKETS] = {};
+    };
+}
+
+#endif //KV_STORE_HISTOGRAM_H
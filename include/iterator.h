@@ -0,0 +1,205 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_ITERATOR_H
+#define KV_STORE_ITERATOR_H
+
+#include "direct_io.h"
+#include "memory_manager.h"
+#include "segment_index.h"
+#include "status.h"
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Kora {
+    /**
+     * Walks key-value pairs in ascending key order. Iterators are forward only:
+     *
+     *   auto it = db.NewIterator();
+     *   for (it->SeekToFirst(); it->Valid(); it->Next()) std::cout << it->key() << ": " << it->value() << '\n';
+     *
+     * key() and value() may only be called while Valid() is true. An iterator returned by the DB reads a consistent
+     * snapshot of the database taken when it was created, writes made after that are not seen.
+     */
+    class Iterator {
+    public:
+        virtual ~Iterator() = default;
+
+        [[nodiscard]] virtual bool Valid() const = 0;
+
+        virtual void SeekToFirst() = 0;
+
+        // position at the first key that is at or past target
+        virtual void Seek(const std::string& target) = 0;
+
+        virtual void Next() = 0;
+
+        [[nodiscard]] virtual const std::string& key() const = 0;
+
+        [[nodiscard]] virtual const std::string& value() const = 0;
+
+        // not ok if reading failed. Valid() is false in that case
+        [[nodiscard]] virtual Status status() const = 0;
+    };
+
+    /**
+     * Iterates over sorted pairs held in memory, e.g. a copy of a memtable. With a memory manager, the pairs are
+     * charged to it as iterator memory until the iterator is destroyed
+     */
+    class MemtableIterator : public Iterator {
+    public:
+        explicit MemtableIterator(std::vector<std::pair<std::string, std::string>>&& entries, std::shared_ptr<MemoryManager> memory = nullptr);
+
+        [[nodiscard]] bool Valid() const override { return _pos < _entries.size(); }
+
+        void SeekToFirst() override { _pos = 0; }
+
+        void Seek(const std::string& target) override;
+
+        void Next() override { ++_pos; }
+
+        [[nodiscard]] const std::string& key() const override { return _entries[_pos].first; }
+
+        [[nodiscard]] const std::string& value() const override { return _entries[_pos].second; }
+
+        [[nodiscard]] Status status() const override { return {}; }
+
+    private:
+        std::vector<std::pair<std::string, std::string>> _entries;
+        size_t _pos;
+        MemoryReservation _reservation;
+    };
+
+    /**
+     * Reads the records of a segment file one after the other. The file is opened when the iterator is created, so it
+     * stays readable even if compaction replaces or removes it afterwards
+     */
+    class SegmentIterator : public Iterator {
+    public:
+        /**
+         * data_offset is where the key-value records of the file start. With the segment's index, the iterator stops
+         * at the end of the records and seeks start at the block holding the target. Records are read ahead from
+         * small reads up to readahead_size bytes as the scan goes on. With a memory manager, the read buffer is charged
+         * to it as iterator memory
+         */
+        explicit SegmentIterator(const std::string& filepath, size_t data_offset = 0, std::shared_ptr<const SegmentIndex> index = nullptr,
+                                 std::shared_ptr<MemoryManager> memory = nullptr, size_t readahead_size = 2 * 1024 * 1024);
+
+        [[nodiscard]] bool Valid() const override { return _valid; }
+
+        void SeekToFirst() override;
+
+        void Seek(const std::string& target) override;
+
+        void Next() override;
+
+        [[nodiscard]] const std::string& key() const override { return _key; }
+
+        [[nodiscard]] const std::string& value() const override { return _value; }
+
+        [[nodiscard]] Status status() const override { return _status; }
+
+    private:
+        // charge the read buffer to the memory manager once it has grown
+        void ChargeBuffer();
+
+        std::string _filepath;
+        size_t _data_offset;
+        std::shared_ptr<const SegmentIndex> _index;
+        // end of the key-value records, and the offset of the next record to read
+        size_t _data_end;
+        size_t _pos = 0;
+        SequentialFileReader _file;
+        std::string _key, _value;
+        bool _valid = false;
+        Status _status;
+        std::shared_ptr<MemoryManager> _memory;
+        // the read buffer grows as the scan goes on, and its charge with it
+        size_t _charged_buffer = 0;
+        MemoryReservation _reservation;
+    };
+
+    /**
+     * Bounds an iterator to the keys that start with prefix. Seeks land on the first of them at or past their target,
+     * and the iterator is no longer valid once the child moves past the last
+     */
+    class PrefixIterator : public Iterator {
+    public:
+        PrefixIterator(std::unique_ptr<Iterator> child, std::string prefix): _child{std::move(child)}, _prefix{std::move(prefix)} {}
+
+        [[nodiscard]] bool Valid() const override {
+            return _child->Valid() && _child->key().compare(0, _prefix.size(), _prefix) == 0;
+        }
+
+        void SeekToFirst() override { _child->Seek(_prefix); }
+
+        void Seek(const std::string& target) override { _child->Seek(target < _prefix ? _prefix : target); }
+
+        void Next() override { _child->Next(); }
+
+        [[nodiscard]] const std::string& key() const override { return _child->key(); }
+
+        [[nodiscard]] const std::string& value() const override { return _child->value(); }
+
+        [[nodiscard]] Status status() const override { return _child->status(); }
+
+    private:
+        std::unique_ptr<Iterator> _child;
+        std::string _prefix;
+    };
+
+    /**
+     * Merges several sorted iterators into one. When more than one child holds a key, only the entry of the child
+     * that comes first in the list is returned, so children are passed newest first. With a resolver, every key is
+     * passed to it together with one entry per child, in the order of the children: the child's value for the key,
+     * or nullptr if the child doesn't hold it. The resolver stores the value to return or returns false to step over
+     * the key, e.g. for tombstones or to fold merge operands
+     */
+    class MergingIterator : public Iterator {
+    public:
+        using Resolver = std::function<bool(const std::string& key, const std::vector<const std::string*>& versions,
+                                            std::string& value)>;
+
+        explicit MergingIterator(std::vector<std::unique_ptr<Iterator>>&& children, Resolver resolver = nullptr);
+
+        [[nodiscard]] bool Valid() const override { return _current != nullptr; }
+
+        void SeekToFirst() override;
+
+        void Seek(const std::string& target) override;
+
+        void Next() override;
+
+        [[nodiscard]] const std::string& key() const override { return _current->key(); }
+
+        [[nodiscard]] const std::string& value() const override { return _resolver ? _value : _current->value(); }
+
+        [[nodiscard]] Status status() const override;
+
+    private:
+        // point _current at the child holding the smallest key, preferring earlier children on ties
+        void FindSmallest();
+
+        // move every child past the current key
+        void Advance();
+
+        // run the resolver on the current key, advancing past the keys it hides
+        void Resolve();
+
+        std::vector<std::unique_ptr<Iterator>> _children;
+        Resolver _resolver;
+        Iterator* _current = nullptr;
+        // value of the current key as given by the resolver
+        std::string _value;
+        std::vector<const std::string*> _versions;
+    };
+}
+
+#endif //KV_STORE_ITERATOR_H
@@ -10,41 +10,180 @@
 #include "storage_engine.h"
 #include "helper.h"
 #include "options.h"
+#include "trace.h"
+#include "iterator.h"
+#include "write_batch.h"
 
 #include <string>
+#include <atomic>
 #include <map>
 #include <utility>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace fs = std::filesystem;
 namespace Kora {
     class DB {
     public:
         DB(): _filename{"/tmp/data.db"} {
-            createDBDirectory();
+            Open();
         }
 
+        /**
+         * Opens the database in the directory db_filename, creating it if needed. Each database keeps all of its
+         * files in its own directory, so any number of databases can be open in one process as long as they use
+         * different directories. Their flushes and compactions share the process wide background thread pools, see
+         * ThreadPool::Default()
+         */
         explicit DB(std::string db_filename): _filename{std::move(db_filename)} {
-            createDBDirectory();
+            Open();
         }
 
         DB(Options options, std::string db_filename): _filename{std::move(db_filename)}, _dbOptions{options} {
-            createDBDirectory();
+            Open();
         }
 
+        ~DB();
+
         Result Get(std::string key);
 
         Status Set(std::string key, std::string value);
 
+        Status Set(const WriteOptions& options, std::string key, std::string value);
+
         Status Delete(std::string key);
 
-        void Write() {}
+        Status Delete(const WriteOptions& options, std::string key);
+
+        /**
+         * Deletes every key in [begin, end) with a single write, however many keys the range holds. Reads and
+         * iterators stop seeing the keys right away and compaction drops their records in bulk. Does nothing if end
+         * is not past begin
+         */
+        Status DeleteRange(std::string begin, std::string end);
+
+        Status DeleteRange(const WriteOptions& options, std::string begin, std::string end);
+
+        /**
+         * Records operand as an update of key that Options::merge_operator applies to the current value of key, without
+         * reading it first. Operands are folded in when the key is read or compacted. Fails with InvalidArgument if no
+         * merge operator is set
+         */
+        Status Merge(std::string key, std::string operand);
+
+        Status Merge(const WriteOptions& options, std::string key, std::string operand);
+
+        /**
+         * Applies every update in the batch atomically, even when its keys live on different shards
+         */
+        Status Write(const WriteBatch& batch);
+
+        Status Write(const WriteOptions& options, const WriteBatch& batch);
+
+        /**
+         * Returns an iterator over a consistent snapshot of the database, in key order across all shards. The iterator
+         * must be destroyed before the database
+         */
+        std::unique_ptr<Iterator> NewIterator();
+
+        /**
+         * Like NewIterator(), but with ReadOptions::prefix set the iterator only visits the keys that start with it, and
+         * leaves out the memtables and segments whose prefix filters rule it out
+         */
+        std::unique_ptr<Iterator> NewIterator(const ReadOptions& options);
+
+        /**
+         * Returns the value of a named database property. Supported properties:
+         *  "kora.stats" - segments per size tier, compaction backlog, write amplification, stall time and all
+         *                 counters and latency histograms kept by the engine
+         *  "kora.num-segments" - the number of segment files
+         *  "kora.num-immutable-memtables" - the number of memtables waiting to be flushed
+         *  "kora.write-stall-condition" - whether writes are running normally, delayed or stopped, and why
+         *  "kora.actual-delayed-write-rate" - the rate in bytes per second writes are paced to while delayed
+         * With several shards, numeric properties are summed over the shards and the others are reported per shard.
+         */
+        Result GetProperty(const std::string& property);
+
+        /**
+         * Creates an openable, consistent copy of the database in checkpoint_dir, which must not exist yet. Segments
+         * and blob files are hard linked rather than copied where the filesystem allows it, so a checkpoint takes about
+         * as long on a large database as on a small one. Where checkpoint_dir is on another filesystem they are
+         * copied instead, which takes time in proportion to the database, but reads and writes carry on meanwhile.
+         * Only the log files of unflushed memtables are always copied.
+         * A MANIFEST file in the checkpoint lists its files and their sizes. Writes carry on while the checkpoint is
+         * taken; those that returned before it started are all in it
+         */
+        Status CreateCheckpoint(const std::string& checkpoint_dir);
+
+        /**
+         * Starts recording every Set(), Get(), Delete() and Write() call, with the time it was made, to a new trace
+         * file at trace_path, for koradb_replay to replay against another database. DeleteRange() and Merge() are
+         * recorded as the batches they write. Fails with InvalidArgument if a trace is already running
+         */
+        Status StartTrace(const std::string& trace_path, const TraceOptions& options = TraceOptions());
+
+        // stops the running trace and closes its file
+        Status EndTrace();
 
     private:
         std::string _filename = "";
         Options _dbOptions{};
-        StorageEngine _storage_engine;
+        // one engine per shard. An unsharded database has a single engine working directly in _filename
+        std::vector<std::unique_ptr<StorageEngine>> _shards;
+        // serializes batches spanning several shards with each other and with the creation of iterators
+        std::mutex _batch_mutex;
+        // id of the last batch spanning several shards. Guarded by _batch_mutex
+        uint64_t _batch_number = 0;
+        // the commit log, kept open for appends, and the number of batch ids in it. Guarded by _batch_mutex
+        int _commit_log_fd = -1;
+        uint64_t _commit_log_ids = 0;
+        // number of ids in the commit log at which it is next trimmed. Guarded by _batch_mutex
+        uint64_t _commit_log_trim_at = _COMMIT_LOG_TRIM_IDS;
+        static const uint64_t _COMMIT_LOG_TRIM_IDS = 64 * 1024;
         std::thread t;
+        // the running trace, if any, read and replaced with std::atomic_load() and std::atomic_store(). Operations
+        // only load it while _tracing is set. _trace_mutex serializes StartTrace() and EndTrace()
+        std::shared_ptr<TraceWriter> _tracer;
+        std::atomic<bool> _tracing{false};
+        std::mutex _trace_mutex;
+
+        // open or create the shards, recovering batches that were committed before the last shutdown
+        void Open();
+
+        StorageEngine& Shard(const std::string& key) {
+            return *_shards[_shards.size() == 1 ? 0 : hashKey(key.data(), key.size()) % _shards.size()];
+        }
+
+        // start recording an operation to the running trace, if there is one
+        TracedOperation TraceOperation() {
+            if (!_tracing.load(std::memory_order_relaxed)) return {};
+            return TracedOperation(std::atomic_load(&_tracer));
+        }
+
+        /**
+         * Write() without the tracing. trace_sequence, if given, is set to the TraceWriter::NextSequence() taken while
+         * the batch is applied
+         */
+        Status WriteToShards(const WriteOptions& options, const WriteBatch& batch, uint64_t* trace_sequence);
+
+        // where batches spanning several shards are committed
+        fs::path CommitLogPath() const { return fs::path(_filename) / "COMMIT"; }
+
+        /**
+         * Append batch_id to the commit log, which commits the batch. If the id can't be written, or synced when sync
+         * is set, the log is cut back to the ids before it and the batch is not committed. Requires _batch_mutex
+         */
+        Status CommitBatch(uint64_t batch_id, bool sync);
+
+        /**
+         * Once the commit log has grown by _COMMIT_LOG_TRIM_IDS ids, drop the ids of the batches no log file of any
+         * shard holds anymore, as recovery won't look for them. If most ids are still needed, the shards holding the
+         * older half switch their memtables so that the next trim can drop them. Requires _batch_mutex and no shard
+         * lock
+         */
+        void TrimCommitLog();
     };
 }
 
@@ -0,0 +1,105 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_LOG_FILE_H
+#define KV_STORE_LOG_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "direct_io.h"
+#include "helper.h"
+
+namespace Kora {
+    // CRC-32C (Castagnoli) of size bytes at data, carrying on from crc
+    uint32_t Crc32c(const char* data, size_t size, uint32_t crc = 0);
+
+    /**
+     * A numbered log file, log_<number>.kdb, that records are appended to before they are acknowledged. The file is
+     * kept open and allocated with fallocate() ahead of the records, _PREALLOCATE_SIZE bytes at a time, so that an
+     * append, even a synced one, only writes data and never has to allocate blocks or grow the file.
+     * The file starts with _MAGIC, and each record is [crc][log number][key size][value size][key][value], the
+     * checksum covering everything after it. Since the number changes every time a file is used, a file left over by
+     * an earlier log can be recycled: it is overwritten in place from the start, and whatever it held before is told
+     * apart from the new records by its number. Appends from several threads at once are safe
+     */
+    class LogWriter {
+    public:
+        /**
+         * Opens path to write the records of the given log number from the start, overwriting what the file already
+         * holds, e.g. when it is recycled. nullptr if the file can't be opened
+         */
+        static std::shared_ptr<LogWriter> Open(const fs::path& path, uint64_t number);
+
+        ~LogWriter();
+
+        LogWriter(const LogWriter&) = delete;
+        LogWriter& operator=(const LogWriter&) = delete;
+
+        // append a record. False if it could not be written
+        bool AddRecord(const char* key, size_t key_size, const char* value, size_t value_size);
+
+        // make the records appended so far durable. As appends don't change the file size, only the data is synced
+        bool Sync();
+
+        // copy the records appended so far to a new file at path, e.g. for a checkpoint
+        bool CopyTo(const fs::path& path);
+
+        [[nodiscard]] uint64_t Number() const { return _number; }
+
+        [[nodiscard]] const fs::path& Path() const { return _path; }
+
+        // bytes of the file taken by the records appended so far
+        [[nodiscard]] uint64_t Size();
+
+        // the file name of the log with the given number
+        static std::string FileName(uint64_t number) { return "log_" + std::to_string(number) + ".kdb"; }
+
+        static const char _MAGIC[8];
+        // [crc][log number]
+        static const size_t _RECORD_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint64_t);
+
+    private:
+        LogWriter(int fd, fs::path path, uint64_t number): _fd{fd}, _path{std::move(path)}, _number{number} {}
+
+        static const size_t _PREALLOCATE_SIZE = 4 * 1024 * 1024;
+
+        int _fd;
+        fs::path _path;
+        uint64_t _number;
+        std::mutex _mutex;
+        // end of the records, and of the space allocated for them. Guarded by _mutex
+        uint64_t _offset = sizeof _MAGIC;
+        uint64_t _allocated = 0;
+    };
+
+    /**
+     * Reads back the records of a log file, oldest first. Reading stops at the first record that is cut short, fails
+     * its checksum or carries another log number, i.e. was left behind by the file's previous use. Files written
+     * before log files were numbered and checksummed have no _MAGIC and are read record by record up to the first one
+     * cut short
+     */
+    class LogReader {
+    public:
+        LogReader(const fs::path& path, uint64_t number, size_t readahead_size);
+
+        // the next record. False at the end of the live records
+        bool ReadRecord(std::string& key, std::string& value);
+
+        // false for log files written before log files had checksums, which are never recycled
+        [[nodiscard]] bool Checksummed() const { return _checksummed; }
+
+    private:
+        SequentialFileReader _file;
+        uint64_t _number;
+        bool _checksummed = false;
+        // bytes of the file not read yet, so that a damaged size can't make us allocate more than the file holds
+        uint64_t _remaining = 0;
+    };
+}
+
+#endif //KV_STORE_LOG_FILE_H
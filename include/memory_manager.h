@@ -0,0 +1,111 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_MEMORY_MANAGER_H
+#define KV_STORE_MEMORY_MANAGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "block_cache.h"
+
+namespace Kora {
+    // what the memory charged to a MemoryManager is used for
+    enum class MemoryKind : uint32_t {
+        _MEMTABLE = 0, // active memtables
+        _IMMUTABLE_MEMTABLE = 1, // memtables waiting to be flushed
+        _PINNED_INDEX = 2, // top-level segment indexes, held in memory for as long as their segment is open
+        _ITERATOR = 3, // memtable snapshots and read buffers of open iterators
+        _KIND_MAX = 4
+    };
+
+    /**
+     * Accounts for the memory of one or more databases against a single byte budget: memtables, pinned index blocks
+     * and iterator buffers reserve what they use, and the usage of the block caches counts too. Once the reservations
+     * grow, the block caches are shrunk to what is left of the budget, and memtables are flushed early once they take
+     * more than their share, half of the budget. Share one manager, together with one block cache, between the
+     * databases of a host to bound their memory together. A budget of 0 only keeps the accounts
+     */
+    class MemoryManager {
+    public:
+        explicit MemoryManager(size_t budget = 0);
+
+        void Reserve(MemoryKind kind, size_t bytes);
+
+        void Release(MemoryKind kind, size_t bytes);
+
+        // move bytes from one kind to another, e.g. when a memtable becomes immutable
+        void Move(MemoryKind from, MemoryKind to, size_t bytes);
+
+        [[nodiscard]] size_t Usage(MemoryKind kind) const { return _usage[static_cast<uint32_t>(kind)].load(std::memory_order_relaxed); }
+
+        [[nodiscard]] size_t BlockCacheUsage() const;
+
+        // the reservations of every kind plus the usage of the block caches
+        [[nodiscard]] size_t TotalUsage() const { return _reserved.load(std::memory_order_relaxed) + BlockCacheUsage(); }
+
+        [[nodiscard]] size_t Budget() const { return _budget; }
+
+        // true once the active memtables should be flushed to stay within the budget
+        [[nodiscard]] bool ShouldFlush() const;
+
+        /**
+         * Counts the usage of a block cache against the budget. From now on its capacity follows the reservations: it
+         * is whatever they leave of the budget, up to the capacity the cache had when it was added
+         */
+        void AddBlockCache(const std::shared_ptr<BlockCache>& cache);
+
+        // a summary of the usage per kind, for the "kora.memory-usage" property
+        [[nodiscard]] std::string ToString() const;
+
+    private:
+        // fit the block caches into what the reservations leave of the budget
+        void UpdateBlockCacheCapacity();
+
+        // the caches are resized whenever the reservations cross a multiple of this many bytes
+        static const size_t _CACHE_RESIZE_STEP = 256 * 1024;
+
+        size_t _budget;
+        std::atomic<size_t> _usage[static_cast<uint32_t>(MemoryKind::_KIND_MAX)] = {};
+        // sum of _usage
+        std::atomic<size_t> _reserved{0};
+        std::atomic<size_t> _reserved_step{0};
+        mutable std::mutex _mutex;
+        // block caches and the capacity they were added with. Guarded by _mutex
+        std::vector<std::pair<std::shared_ptr<BlockCache>, size_t>> _caches;
+    };
+
+    // bytes reserved with a memory manager for as long as the reservation lives
+    class MemoryReservation {
+    public:
+        MemoryReservation() = default;
+
+        MemoryReservation(std::shared_ptr<MemoryManager> manager, MemoryKind kind, size_t bytes);
+
+        ~MemoryReservation() { Reset(); }
+
+        MemoryReservation(MemoryReservation&& other) noexcept { *this = std::move(other); }
+
+        MemoryReservation& operator=(MemoryReservation&& other) noexcept;
+
+        MemoryReservation(const MemoryReservation&) = delete;
+        MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+        // release the bytes
+        void Reset();
+
+    private:
+        std::shared_ptr<MemoryManager> _manager;
+        MemoryKind _kind = MemoryKind::_MEMTABLE;
+        size_t _bytes = 0;
+    };
+}
+
+#endif //KV_STORE_MEMORY_MANAGER_H
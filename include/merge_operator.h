@@ -0,0 +1,71 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_MERGE_OPERATOR_H
+#define KV_STORE_MERGE_OPERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Kora {
+    /**
+     * Turns the operands written with DB::Merge() into a value. Merge() stores its operand like a value without
+     * reading the key, and the engine folds the operands into the value they apply to only when the key is read or
+     * compacted, so read-modify-write updates such as counters and appends become blind writes.
+     *
+     * The operator must be deterministic and must be set on every open of a database that holds merge operands.
+     * Get(), iterators and compactions, including the subcompactions of one compaction, call it from several threads
+     * at once, so it must be thread safe.
+     */
+    class MergeOperator {
+    public:
+        virtual ~MergeOperator() = default;
+
+        /**
+         * Applies operands, oldest first, to the existing value of key and stores the result in new_value.
+         * existing_value is nullptr if the key had no value or was deleted. Returns false if the operands can't be
+         * applied, in which case Get() fails for the key and compaction keeps the operands as they are
+         */
+        virtual bool FullMerge(const std::string& key, const std::string* existing_value,
+                               const std::vector<std::string>& operands, std::string* new_value) const = 0;
+
+        virtual const char* Name() const = 0;
+    };
+
+    /**
+     * Values and operands are unsigned 64 bit integers stored as 8 bytes in host byte order; each operand is added to
+     * the value. A missing value counts as 0.
+     */
+    class UInt64AddOperator : public MergeOperator {
+    public:
+        bool FullMerge(const std::string& key, const std::string* existing_value,
+                       const std::vector<std::string>& operands, std::string* new_value) const override;
+
+        const char* Name() const override { return "UInt64AddOperator"; }
+
+        static std::string Encode(uint64_t value);
+
+        // false if value is not 8 bytes long
+        static bool Decode(const std::string& value, uint64_t* result);
+    };
+
+    /**
+     * Appends each operand to the value, separated by delimiter. A missing value starts out empty.
+     */
+    class StringAppendOperator : public MergeOperator {
+    public:
+        explicit StringAppendOperator(char delimiter = ','): _delimiter{delimiter} {}
+
+        bool FullMerge(const std::string& key, const std::string* existing_value,
+                       const std::vector<std::string>& operands, std::string* new_value) const override;
+
+        const char* Name() const override { return "StringAppendOperator"; }
+
+    private:
+        char _delimiter;
+    };
+}
+
+#endif //KV_STORE_MERGE_OPERATOR_H
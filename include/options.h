@@ -5,6 +5,17 @@
 #ifndef KV_STORE_OPTIONS_H
 #define KV_STORE_OPTIONS_H
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "block_cache.h"
+#include "compaction_filter.h"
+#include "memory_manager.h"
+#include "merge_operator.h"
+#include "prefix_extractor.h"
+
 namespace Kora {
     struct Options {
         Options(): create_if_missing{false} {}
@@ -13,8 +24,143 @@ namespace Kora {
         bool create_if_missing = false;
 
         // If true, an error is raised if
+
+        // If greater than zero, the output of DB::GetProperty("kora.stats") is appended to the LOG file in the database
+        // directory every stats_dump_period_sec seconds.
+        int stats_dump_period_sec = 0;
+
+        // The most memtables kept in memory: the active one plus those waiting to be flushed. Writers stop when the
+        // active memtable fills up while max_write_buffer_number - 1 memtables are still waiting for the flush thread.
+        int max_write_buffer_number = 2;
+
+        // Writes are slowed down once this many segments are waiting to be compacted, i.e. sit in a size tier that
+        // holds at least two segments, and stopped once segment_stop_writes_trigger are. 0 disables the trigger.
+        size_t segment_slowdown_writes_trigger = 20;
+        size_t segment_stop_writes_trigger = 36;
+
+        // Writes are slowed down once the segments waiting to be compacted add up to this many bytes, and stopped once
+        // they reach hard_pending_compaction_bytes_limit. 0 disables the limit.
+        uint64_t soft_pending_compaction_bytes_limit = 256ull * 1024 * 1024;
+        uint64_t hard_pending_compaction_bytes_limit = 1024ull * 1024 * 1024;
+
+        // Bytes per second writes are paced to when they are slowed down. The closer the backlog gets to its stop
+        // trigger, the lower the rate goes, down to an eighth of this value.
+        uint64_t delayed_write_rate = 16ull * 1024 * 1024;
+
+        // Number of independent shards keys are spread over by hash. Each shard has its own memtable, log file and
+        // flush and compaction jobs, so writes to different shards don't contend. Only used when the database is
+        // created: an existing database keeps the number of shards it was created with.
+        int num_shards = 1;
+
+        // Folds the operands written with DB::Merge() into values. Required for DB::Merge(), and for reading keys that
+        // have merge operands, e.g. std::make_shared<Kora::UInt64AddOperator>() for counters.
+        std::shared_ptr<MergeOperator> merge_operator;
+
+        // Values at least this many bytes long are moved into blob files when memtables are flushed, and segments only
+        // keep a small reference to them, so compaction no longer rewrites large values. 0 keeps every value in the
+        // segments.
+        size_t min_blob_size = 0;
+
+        // The blob garbage collection job rewrites the live values of a blob file and removes it once at least this
+        // fraction of the file belongs to values that were overwritten or deleted. Blob files with no live values left
+        // are removed right away.
+        double blob_garbage_collection_ratio = 0.5;
+
+        // Called by compaction for the value each key keeps, to drop or rewrite it, e.g.
+        // std::make_shared<Kora::TtlCompactionFilter>() to drop expired values. Not called by flushes.
+        std::shared_ptr<CompactionFilter> compaction_filter;
+
+        // Caches the index partitions, filter partitions and data blocks of segments. Share one cache between
+        // databases to bound their block memory together. If not set, one cache of BlockCache::_DEFAULT_CAPACITY bytes
+        // is created for the database.
+        std::shared_ptr<BlockCache> block_cache;
+
+        // Caches the result of point lookups answered by the segments, by key, so that hot keys skip the segment
+        // search altogether. Keys not found are cached too. Writes and range deletes keep it up to date. Use a cache of
+        // its own rather than block_cache, so that rows and blocks don't evict each other. Not set by default.
+        std::shared_ptr<BlockCache> row_cache;
+
+        // Segments group their records into data blocks of about this many bytes, the unit a point lookup reads.
+        size_t block_size = 4096;
+
+        // The block index of a segment is split into partitions of about this many bytes that are loaded on demand.
+        // Only the top-level index, one entry per partition, stays in memory.
+        size_t index_partition_size = 4096;
+
+        // Bits per key of the Bloom filters stored next to each index partition, about 1% false positives at 10. Lookups
+        // of keys a filter rules out don't read any data block. 0 disables the filters.
+        int bloom_bits_per_key = 10;
+
+        // Give each data block a hash index from the keys of its records to their offsets, so that a point lookup goes
+        // straight to its record, or finds the key absent, without searching the block. Iterators don't use it. It
+        // takes 2 bytes per bucket, with records / data_block_hash_util_ratio buckets per block: about 2.7 bytes per
+        // record at 0.75. The lower the ratio, the fewer lookups share a bucket and fall back to searching the block.
+        bool data_block_hash_index = false;
+        double data_block_hash_util_ratio = 0.75;
+
+        // Bytes of memory the database may use for its memtables, block cache, pinned index blocks and iterator
+        // buffers together. Memtables are flushed early once they take more than half of it, and the block cache
+        // shrinks to what the rest leaves. 0 sets no limit, memory use is still reported by "kora.memory-usage".
+        size_t memory_budget = 0;
+
+        // Accounts for memory against a budget. Share one manager, together with one block_cache, between databases to
+        // put them under a single budget; memory_budget is ignored then. If not set, a manager with memory_budget is
+        // created for the database.
+        std::shared_ptr<MemoryManager> memory_manager;
+
+        // Write the segments and blob files of flushes and compactions with O_DIRECT, so that they bypass the page
+        // cache instead of evicting the pages reads are using. Writes go through buffers aligned to the block size of
+        // the filesystem, and fall back to buffered I/O where the filesystem rejects O_DIRECT.
+        bool use_direct_io_for_flush_and_compaction = false;
+
+        // Read the input segments of compactions with O_DIRECT too.
+        bool use_direct_reads_for_compaction = false;
+
+        // Bytes read at a time by compactions and log recovery, which read their files from front to back. Buffered
+        // reads also ask the kernel to prefetch the next window meanwhile. Iterators start with 8KB reads that double
+        // with every read while the scan goes on, up to this size.
+        size_t readahead_size = 2 * 1024 * 1024;
+
+        // Compactions of segments in the largest size tier are split into up to this many key ranges, taken from the
+        // index partitions of their inputs, that are merged at once on the compaction thread pool, each into a region
+        // of the new segment of its own, so every record is written once. 1 merges every compaction on one thread.
+        int max_subcompactions = 1;
+
+        // Log files whose memtables have been flushed are kept, up to this many, to be overwritten by the next log
+        // files instead of creating new ones. The space of a recycled file is already allocated, so appends to it don't
+        // have to grow the file. 0 removes obsolete log files.
+        size_t recycle_log_file_num = 2;
+
+        // Set to 8 or 16 when the keys are 8 or 16 byte integers stored big-endian, so that they sort numerically.
+        // Memtables then compare keys of that size as integers instead of byte by byte; keys of other sizes are still
+        // accepted and ordered as usual.
+        size_t fixed_key_size = 0;
+
+        // Give segments whose keys all have the same size, such as fixed-width integers or timestamps, a learned index:
+        // piecewise linear models, fitted at flush and compaction time, from a key to the data block that holds it,
+        // each prediction within learned_index_error blocks of the right one. Point lookups and seeks then search the
+        // few blocks around the prediction with integer compares instead of reading an index partition and comparing
+        // keys through it. It stays in memory, 16 bytes per data block and 24 per model, and point lookups of these
+        // segments don't use the block hash index. Segments whose keys differ in size, or in more than the 8 bytes after
+        // the prefix they share, keep the partitioned index only.
+        bool learned_index = false;
+        size_t learned_index_error = 4;
+
+        // Derives the prefix of a key, e.g. std::make_shared<Kora::DelimitedPrefixExtractor>(':') for the tenant of
+        // "tenant42:user7". Segments then get Bloom filters over the prefixes of their keys (with bloom_bits_per_key bits
+        // per prefix), memtables a prefix filter of memtable_prefix_bloom_size_ratio times their size, and iterators
+        // created with ReadOptions::prefix skip the memtables and segments that don't hold the prefix.
+        std::shared_ptr<PrefixExtractor> prefix_extractor;
+        double memtable_prefix_bloom_size_ratio = 0.02;
+    };
+    struct ReadOptions {
+        // If not empty, the iterator only returns the keys that start with prefix: seeks land on the first of them and
+        // the iterator is no longer valid past the last. Only the memtables and segments that may hold such keys are
+        // read, which their prefix filters tell when prefix is a prefix of Options::prefix_extractor.
+        std::string prefix;
     };
     struct WriteOptions {
+        // If true, the log file is fsynced before the write returns so the write survives a machine crash
         bool sync = false;
     };
 }
@@ -0,0 +1,107 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_PERF_CONTEXT_H
+#define KV_STORE_PERF_CONTEXT_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace Kora {
+    enum class PerfLevel {
+        _DISABLE = 0, // nothing is recorded
+        _ENABLE_COUNT = 1, // only counters are recorded
+        _ENABLE_TIME = 2 // counters and timers are recorded
+    };
+
+    /**
+     * Breakdown of where the operations issued by the current thread spent their time. Counters accumulate until
+     * Reset() is called, so the usual pattern is:
+     *
+     *   Kora::SetPerfLevel(Kora::PerfLevel::_ENABLE_TIME);
+     *   Kora::GetPerfContext()->Reset();
+     *   db.Get(key);
+     *   std::cout << Kora::GetPerfContext()->ToString();
+     *
+     * The instrumentation is compiled out unless the library is built with KORA_PERF_CONTEXT (the KORADB_PERF_CONTEXT
+     * cmake option, on by default). Without it the counters stay zero and the timers cost nothing.
+     */
+    struct PerfContext {
+        uint64_t mutex_wait_nanos = 0; // time spent waiting to acquire the storage engine mutex
+        uint64_t memtable_probe_nanos = 0; // time spent looking the key up in the memtable
+        uint64_t segments_probed = 0; // number of segment files searched
+        uint64_t block_read_count = 0; // number of records read from segment files
+        uint64_t block_read_byte = 0; // bytes read from segment files
+        uint64_t search_nanos = 0; // time spent in StorageEngine::Search()
+        uint64_t wal_append_nanos = 0; // time spent appending to the log file
+        uint64_t wal_sync_nanos = 0; // time spent syncing the log file for WriteOptions::sync writes
+        uint64_t write_stall_nanos = 0; // time a writer spent delayed or stopped by the write controller
+
+        void Reset();
+
+        [[nodiscard]] std::string ToString(bool exclude_zero_counters = false) const;
+    };
+
+    // the perf context of the calling thread
+    PerfContext* GetPerfContext();
+
+    // set the perf level of the calling thread
+    void SetPerfLevel(PerfLevel level);
+
+    PerfLevel GetPerfLevel();
+
+#ifdef KORA_PERF_CONTEXT
+    extern thread_local PerfContext perf_context;
+    extern thread_local PerfLevel perf_level;
+
+    /**
+     * Adds the time between Start() and Stop() (or destruction) to a perf context metric when timing is enabled
+     */
+    class PerfStepTimer {
+    public:
+        explicit PerfStepTimer(uint64_t* metric) : _enabled{perf_level >= PerfLevel::_ENABLE_TIME}, _metric{metric} {}
+
+        ~PerfStepTimer() { Stop(); }
+
+        void Start() {
+            if (_enabled) _start = std::chrono::steady_clock::now();
+        }
+
+        void Stop() {
+            if (_enabled && _start != std::chrono::steady_clock::time_point{}) {
+                *_metric += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - _start).count();
+                _start = std::chrono::steady_clock::time_point{};
+            }
+        }
+
+    private:
+        const bool _enabled;
+        uint64_t* _metric;
+        std::chrono::steady_clock::time_point _start{};
+    };
+#endif
+}
+
+#ifdef KORA_PERF_CONTEXT
+// time the rest of the enclosing scope into perf_context.metric
+#define PERF_TIMER_GUARD(metric) \
+    Kora::PerfStepTimer perf_step_timer_##metric(&(Kora::perf_context.metric)); \
+    perf_step_timer_##metric.Start()
+
+// stop a timer started by PERF_TIMER_GUARD before the end of its scope
+#define PERF_TIMER_STOP(metric) perf_step_timer_##metric.Stop()
+
+#define PERF_COUNTER_ADD(metric, value) \
+    do { \
+        if (Kora::perf_level >= Kora::PerfLevel::_ENABLE_COUNT) Kora::perf_context.metric += (value); \
+    } while (0)
+#else
+#define PERF_TIMER_GUARD(metric)
+#define PERF_TIMER_STOP(metric)
+#define PERF_COUNTER_ADD(metric, value)
+#endif
+
+#endif //KV_STORE_PERF_CONTEXT_H
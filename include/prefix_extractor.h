@@ -0,0 +1,75 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_PREFIX_EXTRACTOR_H
+#define KV_STORE_PREFIX_EXTRACTOR_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace Kora {
+    /**
+     * Derives the prefix of a key, such as the tenant or user it belongs to, that prefix Bloom filters are built over
+     * and prefix iterators are bounded by. The prefix of a key must be a leading part of it, so that the keys sharing a
+     * prefix follow each other in key order. Keys outside the domain have no prefix.
+     *
+     * The name is stored with the prefix filters of each segment, and filters written by an extractor of another name
+     * are not used, so the extractor can be changed between opens.
+     */
+    class PrefixExtractor {
+    public:
+        virtual ~PrefixExtractor() = default;
+
+        // whether key has a prefix
+        virtual bool InDomain(std::string_view key) const = 0;
+
+        // the prefix of a key in the domain
+        virtual std::string_view Transform(std::string_view key) const = 0;
+
+        virtual const char* Name() const = 0;
+
+        // whether prefix is the prefix of the keys that start with it, i.e. one the filters can be asked about
+        bool IsPrefix(std::string_view prefix) const { return InDomain(prefix) && Transform(prefix) == prefix; }
+    };
+
+    /**
+     * The first length bytes of a key. Shorter keys have no prefix.
+     */
+    class FixedPrefixExtractor : public PrefixExtractor {
+    public:
+        explicit FixedPrefixExtractor(size_t length);
+
+        bool InDomain(std::string_view key) const override { return key.size() >= _length; }
+
+        std::string_view Transform(std::string_view key) const override { return key.substr(0, _length); }
+
+        const char* Name() const override { return _name.c_str(); }
+
+    private:
+        size_t _length;
+        std::string _name;
+    };
+
+    /**
+     * A key up to and including the first delimiter, e.g. "tenant42:" of "tenant42:user7". Keys without the delimiter
+     * have no prefix.
+     */
+    class DelimitedPrefixExtractor : public PrefixExtractor {
+    public:
+        explicit DelimitedPrefixExtractor(char delimiter = ':');
+
+        bool InDomain(std::string_view key) const override { return key.find(_delimiter) != std::string_view::npos; }
+
+        std::string_view Transform(std::string_view key) const override { return key.substr(0, key.find(_delimiter) + 1); }
+
+        const char* Name() const override { return _name.c_str(); }
+
+    private:
+        char _delimiter;
+        std::string _name;
+    };
+}
+
+#endif //KV_STORE_PREFIX_EXTRACTOR_H
@@ -0,0 +1,46 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_RANGE_TOMBSTONES_H
+#define KV_STORE_RANGE_TOMBSTONES_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace Kora {
+    /**
+     * The key ranges deleted with DB::DeleteRange() in one memtable or segment, kept as disjoint [begin, end) ranges.
+     * They hide the records of older memtables and segments in those ranges; the records of their own memtable or
+     * segment are always newer than them
+     */
+    class RangeTombstones {
+    public:
+        // delete [begin, end). Overlapping and adjacent ranges are merged, an empty range is ignored
+        void Add(const std::string& begin, const std::string& end);
+
+        void Add(const RangeTombstones& other);
+
+        [[nodiscard]] bool Covers(std::string_view key) const;
+
+        [[nodiscard]] bool Empty() const { return _ranges.empty(); }
+
+        [[nodiscard]] size_t Count() const { return _ranges.size(); }
+
+        // begin -> end, ordered by begin
+        [[nodiscard]] const std::map<std::string, std::string, std::less<>>& Ranges() const { return _ranges; }
+
+        // [size_t count] followed by [size_t size][begin][size_t size][end] for every range
+        [[nodiscard]] std::string Encode() const;
+
+        // replaces the ranges with the encoded ones. False if encoded is malformed
+        bool Decode(const std::string& encoded);
+
+    private:
+        std::map<std::string, std::string, std::less<>> _ranges;
+    };
+}
+
+#endif //KV_STORE_RANGE_TOMBSTONES_H
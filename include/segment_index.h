@@ -0,0 +1,287 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_SEGMENT_INDEX_H
+#define KV_STORE_SEGMENT_INDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "block_cache.h"
+#include "bloom_filter.h"
+#include "helper.h"
+#include "memory_manager.h"
+#include "prefix_extractor.h"
+#include "statistics.h"
+#include "status.h"
+
+namespace Kora {
+    // where a block lives in a segment file
+    struct BlockHandle {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    /**
+     * Builds the two-level index a segment ends with. The key-value records are grouped into data blocks of about
+     * block_size bytes, each block indexed by its last key. The block entries are split into index partitions of about
+     * partition_size bytes, each with a Bloom filter over the keys of its blocks, and a small top-level index holds one
+     * entry per partition. After the records the segment holds:
+     * [index partition][filter partition]...[top-level index][footer]
+     * With a block hash index, the entry of each block also carries a small hash table from key hashes to the offsets
+     * of the records in the block, so that a point lookup goes straight to its record or learns the key is absent.
+     * With a learned index, a segment whose keys all have the same size and differ in no more than the 8 bytes after
+     * the prefix they share also gets piecewise linear models from those 8 bytes, read as a big-endian number, to the
+     * ordinal of the block that holds the key, each within learned_index_error blocks of the right one. The models, the
+     * number of the last key and the offset of each block, and the first block of each partition follow the partition
+     * entries of the top-level index. With a prefix extractor, the segment also gets Bloom filters over the prefixes of
+     * its keys, written before the top-level index, for prefix iterators to skip segments without their prefix
+     */
+    class SegmentIndexBuilder {
+    public:
+        /**
+         * data_offset is where the key-value records of the segment start. With a hash_util_ratio above 0 each block
+         * gets a hash index with records / hash_util_ratio buckets
+         */
+        SegmentIndexBuilder(size_t data_offset, size_t block_size, size_t partition_size, int bloom_bits_per_key,
+                            double hash_util_ratio = 0, bool learned_index = false, size_t learned_index_error = 0,
+                            std::shared_ptr<const PrefixExtractor> prefix_extractor = nullptr);
+
+        // add the next record of the segment, in key order, together with the bytes it takes in the file
+        void Add(const char* key, size_t key_size, size_t record_size);
+
+        /**
+         * Add the records of part after those added so far, for segments whose key ranges are written at once. part
+         * must have been built with a data_offset of 0 and the same settings, its keys must all be greater, and its
+         * records start at offset, at or after the end of those so far. The bytes in between hold a padding record
+         */
+        void Append(SegmentIndexBuilder&& part, uint64_t offset);
+
+        // end of the records added so far
+        [[nodiscard]] uint64_t Offset() const { return _offset; }
+
+        // the most padding that may follow a block of a segment with a learned index, which reads it with the block
+        static const uint64_t _MAX_LEARNED_PADDING = 64 * 1024;
+
+        /**
+         * Write the index after the records. Nothing is written for a segment without records or range tombstones, so
+         * that it stays empty
+         */
+        void Finish(std::ostream& file);
+
+    private:
+        struct Partition {
+            std::string last_key;
+            std::string index;
+            std::string filter;
+        };
+
+        void FinishBlock();
+        void FinishPartition();
+
+        // the hash index of the block being finished. Empty if its records reach too far for 16 bit offsets
+        [[nodiscard]] std::string BuildBlockHashIndex() const;
+
+        // take keys added after those so far into account for the learned index: the first of them, and the size they
+        // all have, or SIZE_MAX if they differ
+        void AddKeys(const std::string& first_key, size_t key_size);
+
+        // the learned index of the finished partitions. Empty if the keys don't allow one
+        [[nodiscard]] std::string BuildLearnedIndex() const;
+
+        // [number of filters]([filter size][filter])... over the prefixes of the keys. Empty without prefix filters
+        [[nodiscard]] std::string BuildPrefixFilters() const;
+
+        size_t _data_offset;
+        size_t _block_size;
+        size_t _partition_size;
+        int _bloom_bits_per_key;
+        double _hash_util_ratio;
+        // end of the records added so far
+        uint64_t _offset;
+        BlockHandle _block;
+        std::string _last_key;
+        // encoded entries of the partition being built, and the keys of its blocks
+        std::string _partition;
+        BloomFilterBuilder _filter;
+        std::vector<Partition> _partitions;
+        // key hash and offset in the block of each record of the block being built, for its hash index
+        std::vector<std::pair<uint64_t, uint16_t>> _block_entries;
+        size_t _block_records = 0;
+        bool _learned_index;
+        size_t _learned_index_error;
+        // the first key added, and the size of every key or SIZE_MAX, for the learned index
+        bool _has_keys = false;
+        std::string _first_key;
+        size_t _key_size = 0;
+        std::shared_ptr<const PrefixExtractor> _prefix_extractor;
+        // the prefixes of the keys added, each once as the keys sharing it follow each other
+        BloomFilterBuilder _prefixes;
+        std::string _last_prefix;
+    };
+
+    /**
+     * The index of one segment file. Only the top-level index, one entry per partition, stays in memory; index
+     * partitions, filter partitions and data blocks are read on demand through the block cache. Segments written before
+     * segments had an index have none, and are searched by reading their records one after the other. Immutable once
+     * opened, so it can be used from several threads at once, and the file stays readable while the index is held
+     */
+    class SegmentIndex {
+    public:
+        /**
+         * data_offset is where the key-value records of the segment start. The top-level index is charged to memory as
+         * a pinned index for as long as the index is open. memory and statistics may be nullptr
+         */
+        static std::shared_ptr<SegmentIndex> Open(const fs::path& path, size_t data_offset, std::shared_ptr<BlockCache> cache,
+                                                  std::shared_ptr<MemoryManager> memory, Statistics* statistics);
+
+        ~SegmentIndex();
+
+        SegmentIndex(const SegmentIndex&) = delete;
+        SegmentIndex& operator=(const SegmentIndex&) = delete;
+
+        // false for segments written without an index
+        [[nodiscard]] bool HasIndex() const { return _has_index; }
+
+        // whether the segment has a learned index, which point lookups and seeks then find their block with
+        [[nodiscard]] bool HasLearnedIndex() const { return !_models.empty(); }
+
+        // the number of linear models of the learned index
+        [[nodiscard]] size_t NumLearnedModels() const { return _models.size(); }
+
+        // whether the segment has prefix filters written with extractor
+        [[nodiscard]] bool HasPrefixFilters(const PrefixExtractor& extractor) const {
+            return _prefix_filters.size > 0 && _prefix_extractor_name == extractor.Name();
+        }
+
+        /**
+         * False if no key of the segment starts with prefix, as told by the smallest and largest key and, if extractor
+         * is given, prefix is one of its prefixes and the segment has its filters, by the prefix filters. True for
+         * segments without an index
+         */
+        [[nodiscard]] bool PrefixMayMatch(const std::string& prefix, const PrefixExtractor* extractor) const;
+
+        /**
+         * The smallest and the largest key of the segment, which bound the keys lookups and compactions have to look
+         * for in it. The smallest key is empty if it couldn't be read, the largest if the segment has no partitions
+         */
+        [[nodiscard]] const std::string& SmallestKey() const { return _smallest_key; }
+        [[nodiscard]] const std::string& LargestKey() const { return _partitions.empty() ? _NO_KEY : _partitions.back().last_key; }
+
+        /**
+         * The data block that holds key if the segment has it. block is left empty if the segment definitely doesn't:
+         * the key is past its last key or ruled out by a Bloom filter or block hash index. If entry_offset is given, it
+         * is set to the offset in the block of the only record that can hold key, as found by the block hash index,
+         * or to SIZE_MAX if the block has to be searched. Segments with a learned index find the block through it and
+         * leave the block hash index aside. Requires HasIndex()
+         */
+        Status FindBlock(const std::string& key, BlockCache::Block& block, size_t* entry_offset = nullptr) const;
+
+        /**
+         * Offset of the first record of the first data block whose keys reach target, where a forward scan for target
+         * can start. DataEnd() if every key is smaller, DataOffset() for segments without an index
+         */
+        [[nodiscard]] uint64_t SeekOffset(const std::string& target) const;
+
+        /**
+         * Bytes of the data blocks from the one the keys reaching begin start in to the one holding end, either of
+         * which may be empty for the first or last block. Unlike the distance between their offsets it leaves out the
+         * padding between the key ranges of a segment written by subcompactions
+         */
+        [[nodiscard]] uint64_t DataBytes(const std::string& begin, const std::string& end) const;
+
+        [[nodiscard]] uint64_t DataOffset() const { return _data_offset; }
+
+        // end of the key-value records, where the index starts
+        [[nodiscard]] uint64_t DataEnd() const { return _data_end; }
+
+        // bytes held in memory for the top-level index
+        [[nodiscard]] size_t MemoryUsage() const;
+
+        [[nodiscard]] size_t NumPartitions() const { return _partitions.size(); }
+
+        // the last key of each index partition, in order. The partitions cover about the same number of data blocks
+        [[nodiscard]] std::vector<std::string> PartitionKeys() const;
+
+        // bytes of the index and filter partitions in the file, loaded into the block cache on demand
+        [[nodiscard]] uint64_t IndexPartitionBytes() const { return _index_bytes; }
+        [[nodiscard]] uint64_t FilterPartitionBytes() const { return _filter_bytes; }
+
+    private:
+        // the largest key of a segment without partitions
+        static const std::string _NO_KEY;
+
+        struct Partition {
+            std::string last_key;
+            BlockHandle index;
+            BlockHandle filter;
+        };
+
+        // predicts the block of the keys from first on as block + slope * (key - first)
+        struct LearnedModel {
+            uint64_t first;
+            uint64_t block;
+            double slope;
+        };
+
+        SegmentIndex(const fs::path& path, size_t data_offset, std::shared_ptr<BlockCache> cache, Statistics* statistics);
+
+        // read a block of the file, from the block cache if it is there
+        Status ReadBlock(const BlockHandle& handle, BlockCache::Block& block) const;
+
+        // the entry of the first partition whose last key reaches key, or nullptr if there is none
+        [[nodiscard]] const Partition* FindPartition(const std::string& key) const;
+
+        /**
+         * the handle of the first data block in an index partition whose last key reaches key, and its hash index if
+         * hash_index is given. False if none does
+         */
+        bool FindBlockHandle(const std::string& partition, const std::string& key, BlockHandle& handle,
+                             std::string_view* hash_index = nullptr) const;
+
+        // read the learned index section of the top-level index. False if it is damaged
+        bool ReadLearnedIndex(const std::string& section);
+
+        /**
+         * the ordinal of the first block whose last key reaches key, found through the learned index, or SIZE_MAX if
+         * every key is smaller. key must share the prefix of the keys of the segment
+         */
+        [[nodiscard]] size_t LearnedBlock(const std::string& key) const;
+
+        fs::path _path;
+        int _fd = -1;
+        std::shared_ptr<BlockCache> _cache;
+        uint64_t _cache_id;
+        Statistics* _statistics;
+        bool _has_index = false;
+        // the block entries of the index partitions carry hash indexes
+        bool _block_hash = false;
+        uint64_t _data_offset;
+        uint64_t _data_end = 0;
+        std::vector<Partition> _partitions;
+        std::string _smallest_key;
+        // the learned index: the size of every key and of the prefix they share, the error bound of the models, the
+        // number of the last key and the offset of each block, and the ordinal of the first block of each partition
+        size_t _key_size = 0;
+        size_t _prefix_size = 0;
+        uint64_t _learned_error = 0;
+        std::vector<LearnedModel> _models;
+        std::vector<uint64_t> _block_keys;
+        std::vector<uint64_t> _block_offsets;
+        std::vector<uint64_t> _partition_blocks;
+        // the block of prefix filters, and the name of the extractor they were built with
+        BlockHandle _prefix_filters;
+        std::string _prefix_extractor_name;
+        uint64_t _index_bytes = 0;
+        uint64_t _filter_bytes = 0;
+        MemoryReservation _pinned;
+    };
+}
+
+#endif //KV_STORE_SEGMENT_INDEX_H
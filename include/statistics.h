@@ -0,0 +1,156 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_STATISTICS_H
+#define KV_STORE_STATISTICS_H
+
+#include "histogram.h"
+#include "helper.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace Kora {
+    // Monotonically increasing counters kept by the storage engine
+    enum Ticker : uint32_t {
+        NUMBER_KEYS_WRITTEN = 0,
+        NUMBER_KEYS_DELETED,
+        NUMBER_KEYS_READ,
+        NUMBER_KEYS_FOUND,
+        BYTES_WRITTEN, // user key and value bytes passed to Set(), Delete() and Merge()
+        BYTES_READ, // value bytes returned by Get()
+        MEMTABLE_HIT,
+        MEMTABLE_MISS,
+        SEGMENTS_PROBED, // segments searched by Get() calls that missed the memtable
+        SEGMENT_BYTES_READ, // bytes scanned in segment files by Search()
+        WAL_WRITES,
+        WAL_BYTES,
+        STALL_MICROS, // time writers spent delayed or stopped by the write controller, for any cause
+        STALL_DELAYED_WRITES, // writes that were slowed down to the delayed write rate
+        STALL_STOPPED_WRITES, // writes that had to wait for a flush or compaction to catch up
+        STALL_MEMTABLE_LIMIT_MICROS, // stall time caused by too many memtables waiting to be flushed
+        STALL_SEGMENT_LIMIT_MICROS, // stall time caused by too many segments waiting to be compacted
+        STALL_PENDING_COMPACTION_MICROS, // stall time caused by too many bytes waiting to be compacted
+        FLUSH_COUNT,
+        FLUSH_BYTES_WRITTEN,
+        COMPACTION_COUNT,
+        COMPACT_READ_BYTES,
+        COMPACT_WRITE_BYTES,
+        COMPACT_KEYS_DROPPED, // records dropped by compaction because a newer record of the same key was kept
+        COMPACT_TOMBSTONES_DROPPED, // tombstones dropped by compactions that reached the oldest segment
+        NUMBER_MERGES, // operands written with Merge()
+        NUMBER_RANGE_DELETES, // ranges deleted with DeleteRange()
+        COMPACT_RANGE_DELETED_KEYS, // records dropped by compaction because a range tombstone of a newer segment covers them
+        MERGE_OPERATIONS, // calls to the merge operator by reads and compactions
+        MERGE_FAILURES, // merge operator calls that failed
+        BLOB_FILE_BYTES_WRITTEN, // bytes of values moved into blob files by flushes
+        BLOB_FILE_BYTES_READ, // value bytes read from blob files
+        BLOB_GC_FILES, // blob files removed by blob garbage collection, or because none of their values were live
+        BLOB_GC_BYTES_RELOCATED, // live value bytes blob garbage collection wrote back to the database
+        COMPACT_FILTER_REMOVED_KEYS, // values the compaction filter removed
+        COMPACT_FILTER_CHANGED_VALUES, // values the compaction filter rewrote
+        BLOCK_CACHE_HIT, // segment index, filter and data blocks found in the block cache
+        BLOCK_CACHE_MISS, // segment blocks read from disk
+        BLOOM_FILTER_USEFUL, // segment lookups a Bloom filter ruled out without reading a data block
+        MEMORY_BUDGET_FLUSHES, // memtables switched before they were full to stay within the memory budget
+        DIRECT_IO_FALLBACKS, // segment files written with buffered I/O because the filesystem rejected O_DIRECT
+        BLOCK_HASH_INDEX_HIT, // point lookups the block hash index took straight to their record or ruled out
+        BLOCK_HASH_INDEX_COLLISION, // point lookups that searched their block because their hash bucket was shared
+        ROW_CACHE_HIT, // point lookups answered by the row cache
+        ROW_CACHE_MISS, // point lookups that went on to the segments with a row cache set
+        COMPACT_READ_STAGE_MICROS, // time the compaction readers spent reading and decoding their inputs, summed over the inputs
+        COMPACT_MERGE_STAGE_MICROS, // time compactions spent merging and building output, not waiting on their readers or writer
+        COMPACT_WRITE_STAGE_MICROS, // time the compaction writers spent writing output
+        SUBCOMPACTIONS, // key ranges merged on threads of their own by compactions split with max_subcompactions
+        WAL_FILES_RECYCLED, // log files started by overwriting an obsolete log file instead of creating one
+        COMPACT_TRIVIAL_MOVES, // compactions whose inputs didn't overlap and were moved up a tier without merging them
+        MEMTABLE_APPENDS, // writes of a key greater than every key in the memtable, added at its end without a search
+        LEARNED_INDEX_HIT, // point lookups and seeks whose block the learned index predicted within its error bound
+        LEARNED_INDEX_MISS, // point lookups and seeks that searched every block of their model after a prediction missed
+        PREFIX_FILTER_CHECKED, // memtables and segments whose prefix filter was asked about the prefix of a lookup or iterator
+        PREFIX_FILTER_USEFUL, // memtables and segments skipped because their prefix filter ruled the prefix out
+        TICKER_ENUM_MAX
+    };
+
+    enum HistogramType : uint32_t {
+        GET_MICROS = 0,
+        SET_MICROS,
+        DELETE_MICROS,
+        GET_SEGMENTS_PROBED,
+        WAL_APPEND_MICROS,
+        WRITE_STALL_MICROS,
+        FLUSH_MICROS,
+        COMPACTION_MICROS,
+        BLOB_GC_MICROS,
+        HISTOGRAM_ENUM_MAX
+    };
+
+    /**
+     * Engine wide counters and latency histograms. Tickers are relaxed atomics. Each histogram is split into a few
+     * shards picked per thread so that concurrent readers and writers rarely contend on the same mutex; the shards are
+     * merged when the histogram is read.
+     */
+    class Statistics {
+    public:
+        Statistics() : _start_micros{nowMicros()} {}
+
+        void RecordTick(Ticker ticker, uint64_t count = 1) {
+            _tickers[ticker].fetch_add(count, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t GetTickerCount(Ticker ticker) const {
+            return _tickers[ticker].load(std::memory_order_relaxed);
+        }
+
+        void MeasureTime(HistogramType type, uint64_t value);
+
+        [[nodiscard]] Histogram GetHistogram(HistogramType type) const;
+
+        void Reset();
+
+        // human readable dump of every ticker and histogram
+        [[nodiscard]] std::string ToString() const;
+
+        [[nodiscard]] uint64_t UptimeMicros() const { return nowMicros() - _start_micros; }
+
+        static const char* TickerName(Ticker ticker);
+        static const char* HistogramName(HistogramType type);
+
+    private:
+        static const int _HISTOGRAM_SHARDS = 8;
+
+        struct alignas(64) HistogramShard {
+            mutable std::mutex mutex;
+            Histogram histogram;
+        };
+
+        uint64_t _start_micros = 0;
+        std::atomic<uint64_t> _tickers[TICKER_ENUM_MAX] = {};
+        HistogramShard _histograms[HISTOGRAM_ENUM_MAX][_HISTOGRAM_SHARDS];
+    };
+
+    /**
+     * Records the time between construction and destruction into a histogram of the given statistics object
+     */
+    class StopWatch {
+    public:
+        StopWatch(Statistics& statistics, HistogramType type) : _statistics{statistics}, _type{type},
+                                                                 _start{nowMicros()} {}
+
+        ~StopWatch() {
+            _statistics.MeasureTime(_type, ElapsedMicros());
+        }
+
+        [[nodiscard]] uint64_t ElapsedMicros() const { return nowMicros() - _start; }
+
+    private:
+        Statistics& _statistics;
+        HistogramType _type;
+        uint64_t _start;
+    };
+}
+
+#endif //KV_STORE_STATISTICS_H
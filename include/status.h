@@ -14,7 +14,9 @@ namespace Kora {
         _OK = 1,
         _NOTFOUND = 2,
         _IOERROR = 3,
-        _DONE = 4
+        _DONE = 4,
+        _INVALIDARGUMENT = 5,
+        _CORRUPTION = 6
     };
 
     class Status {
@@ -27,6 +29,8 @@ namespace Kora {
         static Status NotFound(std::string message) { return {Code::_NOTFOUND, std::move(message)}; }
         static Status Done() { return Status(Code::_DONE); }
         static Status IoError(std::string message) { return {Code::_IOERROR, std::move(message)}; }
+        static Status InvalidArgument(std::string message) { return {Code::_INVALIDARGUMENT, std::move(message)}; }
+        static Status Corruption(std::string message) { return {Code::_CORRUPTION, std::move(message)}; }
         Code code() const { return _code; }
         std::string message() const { return _message; }
         std::string toString() const;
@@ -35,6 +39,8 @@ namespace Kora {
         bool isNotFound() { return _code == Code::_NOTFOUND; }
         bool isIoError() { return _code == Code::_IOERROR; }
         bool isDone() { return _code == Code::_DONE; }
+        bool isInvalidArgument() { return _code == Code::_INVALIDARGUMENT; }
+        bool isCorruption() { return _code == Code::_CORRUPTION; }
 
     private:
         Code _code = Code::_OK;
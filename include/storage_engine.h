@@ -15,33 +15,187 @@
 #include <condition_variable>
 #include <mutex>
 #include "helper.h"
+#include "options.h"
+#include "statistics.h"
+#include "write_controller.h"
+#include "write_batch.h"
+#include "iterator.h"
+#include "range_tombstones.h"
+#include "blob_file.h"
+#include "compaction_pipeline.h"
+#include "log_file.h"
+#include "segment_index.h"
+#include "trace.h"
 #include <limits.h>
+#include <deque>
+#include <list>
+#include <memory>
+#include <set>
+#include <vector>
+#include <atomic>
 namespace Kora {
+    using Memtable = std::map<Data, Data, Kora::Comparator>;
+
+    struct ImmutableMemtable {
+        Memtable table;
+        RangeTombstones range_tombstones;
+        // log file holding the memtable's records, recycled or removed once the memtable is in a segment. nullptr for
+        // memtables rebuilt from the log files on start up, whose log files are only let go once recovery is complete
+        std::shared_ptr<LogWriter> log;
+        // bytes charged to the memory manager for the memtable
+        size_t bytes = 0;
+        // the prefixes of the keys written to the memtable, with Options::prefix_extractor
+        DynamicBloom prefix_filter;
+        // id of the first batch spanning several engines in the log file, 0 if there is none
+        uint64_t first_batch = 0;
+    };
+
+    // range tombstones a segment file starts with, and the offset of its first key-value record after them
+    struct SegmentRangeTombstones {
+        RangeTombstones ranges;
+        size_t data_offset = 0;
+    };
+
+    // blob files by number
+    using BlobFiles = std::map<uint64_t, std::shared_ptr<BlobFile>>;
+
+    // the two segments a compaction merges, and what it needs to know about them, taken under the engine mutex
+    struct CompactionInputs {
+        CompactibleObject newer;
+        CompactibleObject older;
+        SegmentRangeTombstones newer_ranges{};
+        SegmentRangeTombstones older_ranges{};
+        std::shared_ptr<SegmentIndex> newer_index{};
+        std::shared_ptr<SegmentIndex> older_index{};
+        // the records of each input end where its index starts
+        uint64_t newer_end = SIZE_MAX;
+        uint64_t older_end = SIZE_MAX;
+        // nothing is older than the inputs, so tombstones have nothing left to hide and can be dropped
+        bool bottommost = false;
+        BlobFiles blob_files{};
+    };
+
+    // what the versions of a key come to once their merge operands are folded, see StorageEngine::FoldVersions()
+    enum class MergeResult {
+        _VALUE = 0,
+        _DELETED = 1,
+        _OPERANDS = 2, // the operands could not be applied yet and were combined into a single merge record
+        _FAILED = 3 // the merge operator failed, the versions were combined into a single merge record
+    };
+
     class StorageEngine {
     public:
-        StorageEngine() {
-            // build the _sstable map allover once the storage engine starts
-            BuildSSTableMap();
-
-            // setup sparese hash index
-            //BuildIndexes();
+        /**
+         * Opens the database stored in db_path, creating the directory if needed. Every file the engine writes lives
+         * in that directory, so several engines can run side by side in one process as long as their paths differ
+         * @param committed_batches - ids of the batches spanning several engines that were committed before the last
+         * shutdown. Their parts found in the log files are replayed, the parts of any other such batch are dropped
+         */
+        explicit StorageEngine(const fs::path& db_path, const Options& options = Options(), std::set<uint64_t> committed_batches = {}): _db_path{fs::absolute(db_path)}, _options{options}, _write_controller{options}, _committed_batches{std::move(committed_batches)} {
+            createDir(fs::path(_db_path));
+            if (!_options.block_cache) _options.block_cache = std::make_shared<BlockCache>();
+            if (!_options.memory_manager) _options.memory_manager = std::make_shared<MemoryManager>(_options.memory_budget);
+            _options.memory_manager->AddBlockCache(_options.block_cache);
+            if (_options.row_cache) _options.memory_manager->AddBlockCache(_options.row_cache);
+            _memtable = Memtable(Comparator(_options.fixed_key_size));
+            _memtable_prefix_filter = NewMemtablePrefixFilter();
 
-            if(!_writerThread.joinable())
-                _writerThread = std::thread(&StorageEngine::Write, this);
+            // build the _sstable map and open the segment indexes allover once the storage engine starts
+            BuildSSTableMap();
 
             UpdateSSTablesFromLogFile(this);
 
-            _timer.start(10000, Compact);
+            {
+                std::lock_guard<std::mutex> lg(_mutex);
+                UpdateWriteStallState();
+            }
 
+            _timer.start(10000, [this] {
+                MaybeScheduleCompaction();
+                MaybeScheduleBlobGC();
+            });
+
+            if (_options.stats_dump_period_sec > 0)
+                _stats_dump_timer.start(_options.stats_dump_period_sec * 1000, [this] { DumpStats(); }, false);
         }
-        Kora::Status Set(Data&& key, Data&& value, bool from_log=false) noexcept;
-        Kora::Result Get(Data&& key);
-        Kora::Status Delete(const Data&& key);
-        static void LogData(const char* data, size_t key_size, size_t value_size);
+        // trace_sequence, if given, is set to the TraceWriter::NextSequence() taken while the operation is applied, so
+        // that a trace records the operations of the engine in the order they took effect
+        Kora::Status Set(Data&& key, Data&& value, bool from_log=false, const WriteOptions& write_options = WriteOptions(),
+                         uint64_t* trace_sequence = nullptr) noexcept;
+        Kora::Result Get(Data&& key, uint64_t* trace_sequence = nullptr);
+        Kora::Status Delete(const Data&& key, const WriteOptions& write_options = WriteOptions(), uint64_t* trace_sequence = nullptr);
+        // apply all updates of a batch atomically
+        Kora::Status Write(const WriteBatch& batch, const WriteOptions& write_options = WriteOptions(),
+                           uint64_t* trace_sequence = nullptr);
+
+        /**
+         * Building blocks for batches spanning several engines, see DB::Write(). The caller slows down with
+         * DelayWrite(), locks every engine involved with LockForBatch(), logs its part to each with LogBatch(),
+         * commits the batch id, then inserts the parts with InsertBatch(), unlocks and lets each engine switch its
+         * memtable with MaybeSwitchMemtable()
+         */
+        std::unique_lock<std::mutex> LockForBatch();
 
+        /**
+         * Appends the part of a batch spanning several engines to the log file as a single record tagged with
+         * batch_id, which recovery only replays once the id is committed. Readers don't see it until InsertBatch().
+         * Requires the lock returned by LockForBatch()
+         */
+        void LogBatch(const WriteBatch& batch, uint64_t batch_id, bool sync);
+
+        // apply a batch logged with LogBatch() to the memtable. Requires the lock returned by LockForBatch()
+        void InsertBatch(const WriteBatch& batch);
+
+        void MaybeSwitchMemtable();
+
+        // id of the oldest batch spanning several engines still in a log file of this engine, 0 if there is none
+        uint64_t OldestLoggedBatch();
+
+        /**
+         * Switch the memtable, however full, if its log file holds a batch spanning several engines older than
+         * batch_id, so that the batch leaves the log files once the memtable is flushed
+         */
+        void SealBatchesBefore(uint64_t batch_id);
+
+        // slow down or stop the calling writer according to the write controller
+        void DelayWrite(size_t num_bytes);
+
+        // iterate over a snapshot of every live key, in key order, or of those with ReadOptions::prefix
+        std::unique_ptr<Iterator> NewIterator(const ReadOptions& read_options = ReadOptions());
+
+        // fsync a file that has already been written and closed
+        static void SyncFile(const fs::path& path);
+
+        // append a record to the active log file. With sync set, the record is on disk before returning
+        void LogData(const char* key, size_t key_size, const char* value, size_t value_size, bool sync = false);
+
+        /**
+         * Returns the value of a named engine property, e.g. "kora.stats" for a human readable summary of the engine
+         * statistics. NotFound is returned for unknown properties.
+         */
+        Kora::Result GetProperty(const std::string& property);
+
+        /**
+         * Puts a consistent copy of the engine's files into dir, which must exist: hard links to the segments, blob
+         * files and sealed log files, which never change once written, and a copy of the active log file as far as it
+         * was written when the checkpoint was taken. _mutex is only held while the files are linked, so flushes and
+         * compactions can't remove any of them in between. Files that can't be linked, e.g. across filesystems, are
+         * opened under _mutex and copied after it is released, so the copy doesn't hold up the engine however large
+         * the files are. The names of the files are appended to files
+         */
+        Kora::Status CreateCheckpoint(const fs::path& dir, std::vector<std::string>& files);
 
         ~StorageEngine(){
-            _writerThread.join();
+            // stop scheduling new background work, then wait for the jobs already handed to the thread pools
+            _timer.stop();
+            _stats_dump_timer.stop();
+            std::unique_lock<std::mutex> ulock(_mutex);
+            _shutting_down = true;
+            _cond.notify_all();
+            _cond.wait(ulock, [this] { return !_flush_scheduled && !_compaction_scheduled && !_blob_gc_scheduled; });
+            // the memory manager may be shared with other databases that stay open
+            _options.memory_manager->Release(MemoryKind::_MEMTABLE, _memtable_bytes);
+            for (const auto& immutable: _immutable_memtables) _options.memory_manager->Release(MemoryKind::_IMMUTABLE_MEMTABLE, immutable.bytes);
         }
 
     private:
@@ -50,81 +204,429 @@ namespace Kora {
         static const int _MAX_LEVEL2_SIZE = 8000000; // in bytes ~ 8MB
         static const int _MAX_LEVEL3_SIZE = 12000000; // in bytes ~ 12MB
         static const int _MIN_LEVEL4_SIZE = 12000001;
-        static const int _HASH_INDEX_INTERVAL = 10000; // in bytes 10KB
-        std::map<Data, Data, Kora::Comparator> _memtable;
-        std::map<Data, Data, Kora::Comparator> _temp_memtable;
-        static std::map<long, std::string, std::greater<>> _sstables; // filename -> fullpath
+        // tier of segments of the largest tier that were moved up without being merged. They are only merged again
+        // with a segment of the largest tier that overlaps them
+        static const int _SETTLED_LEVEL = 5;
+        Memtable _memtable;
+        // ranges deleted while _memtable was active. Its entries in those ranges were erased at the time
+        RangeTombstones _range_tombstones;
+        // id of the first batch spanning several engines in the active log file, 0 if there is none. Guarded by _mutex
+        uint64_t _memtable_first_batch = 0;
+        // the prefixes of the keys written to _memtable, with Options::prefix_extractor
+        DynamicBloom _memtable_prefix_filter;
+        // memtables waiting to be written out by the writer thread, oldest first
+        std::list<ImmutableMemtable> _immutable_memtables;
+        std::map<long, std::string, std::greater<>> _sstables; // filename -> fullpath. Guarded by _mutex
+        // counts the writes to the active memtable, _MEMTABLE_WRITE_CHARGE per write, so that it is switched after
+        // _MAX_MEMTABLE_SIZE / _MEMTABLE_WRITE_CHARGE writes
         size_t _memtableSize = 0;
-        std::thread _writerThread;
+        static const size_t _MEMTABLE_WRITE_CHARGE = 32;
+        // bytes the active memtable and its range tombstones take, as charged to the memory manager
+        size_t _memtable_bytes = 0;
+        // estimated bytes a memtable entry takes on top of its key and value: the tree node and the allocations
+        static const size_t _MEMTABLE_ENTRY_OVERHEAD = 96;
         static std::string _TOMBSTONE_RECORD;
+        // key of the log file records holding a whole WriteBatch
+        static std::string _BATCH_RECORD;
+        // key of the record holding encoded RangeTombstones: the first record of a segment or log file that has range
+        // tombstones, and a record of its own in log files and batches for every DeleteRange()
+        static std::string _RANGE_TOMBSTONE_RECORD;
+        /**
+         * Values starting with this mark hold merge operands: [mark][base kind][base][operand]..., where the base kind
+         * is one of the _MERGE_* constants, the base (the value the operands apply to) is only present for
+         * _MERGE_ON_VALUE, and the base and each operand are stored as [size_t size][bytes], operands oldest first
+         */
+        static std::string _MERGE_RECORD;
+        // the operands apply to whatever older versions of the key come to
+        static const char _MERGE_PARTIAL = 'p';
+        // the operands apply to the value stored in the record
+        static const char _MERGE_ON_VALUE = 'v';
+        // the operands apply to a deleted key
+        static const char _MERGE_ON_DELETED = 'd';
+        // values starting with this mark stand in for a value moved to a blob file: [mark][encoded BlobIndex]
+        static std::string _BLOB_RECORD;
         std::condition_variable _cond;
         std::mutex _mutex;
-        bool _memtable_is_full = false;
-        bool _update_is_from_logfile = false;
-        bool _done_writing = false;
-        static bool _done_updating_sstables;
+        std::atomic<bool> _shutting_down{false};
+        // a flush or compaction job of this engine is queued in or running on a background thread pool
+        bool _flush_scheduled = false;
+        bool _compaction_scheduled = false;
+        bool _blob_gc_scheduled = false;
+        // the log file records are appended to. Guarded by _log_mutex, which is taken after _mutex when both are
+        // needed, so that appends don't wait on the engine mutex
+        std::shared_ptr<LogWriter> _log;
+        std::mutex _log_mutex;
+        // number of the last log file started. Guarded by _mutex
+        uint64_t _log_number = 0;
+        // obsolete log files, named recycle_<number>.kdb, that the next log files are started in. Guarded by _mutex
+        std::deque<fs::path> _recyclable_logs;
+        // number of the last segment file created. Segment files are named after their number, newest is highest
+        std::atomic<long> _file_number{0};
+        // prefix of the keys of this engine's rows in the row cache. Guarded by _mutex
+        uint64_t _row_cache_id = BlockCache::NewCacheId();
+        bool _done_updating_sstables = false;
         const static long long _MAX_SST_SIZE = 1024;
+        fs::path _db_path;
         Timer _timer;
-        static std::vector<CompactibleObject> L1CompactibleFiles(); // ssts between 50bytes and 100bytes
-        static std::vector<CompactibleObject> L2CompactibleFiles(); // ssts between 101bytes and 300bytes
-        static std::vector<CompactibleObject> L3CompactibleFiles(); // ssts between 301bytes and 500bytes
-        static std::vector<CompactibleObject> L4CompactibleFiles(); // ssts between 501bytes and 1000bytes
+        Options _options;
+        Timer _stats_dump_timer;
+        WriteController _write_controller;
+        // counters and latency histograms shared by the foreground and background paths
+        Statistics _statistics;
+        // only used while replaying the log files on start up
+        std::set<uint64_t> _committed_batches;
+        // two segments of the given size tier that are next to each other in age, newer first. Empty if there are none
+        std::vector<CompactibleObject> CompactibleFiles(int level);
+
+        // hand a flush job to the flush thread pool unless one is already scheduled. Requires _mutex
+        void MaybeScheduleFlush();
+
+        // hand a compaction job to the compaction thread pool unless one is already scheduled
+        void MaybeScheduleCompaction();
+
+        // flush job: writes out immutable memtables to sstables, oldest first, until the queue is empty
+        void BackgroundFlush();
+
+        // compaction job: compacts, then lets stopped writers know the backlog may have shrunk
+        void BackgroundCompaction();
+
+        // hand a blob garbage collection job to the compaction thread pool unless one is already scheduled
+        void MaybeScheduleBlobGC();
+
+        // blob garbage collection job: collects every blob file past options.blob_garbage_collection_ratio
+        void BackgroundBlobGC();
+
+        /**
+         * Writes the live values of a blob file back to the database, where the next flush moves them to a new blob
+         * file, then removes the file. A value is live while it is still the version of its key readers see or one
+         * their merge operands apply to. Returns false if the file is kept, e.g. on shutdown
+         */
+        bool CollectBlobFile(const std::shared_ptr<BlobFile>& blob_file);
+
+        // path of a new segment file, named after the next file number
+        fs::path NewSegmentPath();
+
+        /**
+         * Makes a segment written under a temporary name visible to readers and to compaction: renames it into place
+         * and records it, its range tombstones and its index. Requires _mutex
+         */
+        void InstallSegment(const fs::path& temp_path, const fs::path& path, SegmentRangeTombstones&& range_tombstones);
+
+        /**
+         * Writes the range tombstones and records of a memtable, including tombstones, followed by their index to a new
+         * segment file and fills in its range tombstones. Values of at least options.min_blob_size bytes go to a new
+         * blob file instead, returned in blob_file. Returns false if the segment could not be written
+         */
+        bool WriteSegment(const Memtable& memtable, const RangeTombstones& ranges, const fs::path& path,
+                          SegmentRangeTombstones& range_tombstones, std::shared_ptr<BlobFile>& blob_file);
 
-        // write out memtable to sstable
-        [[noreturn]] void Write();
+        // a builder for the index of a segment whose key-value records start at data_offset
+        SegmentIndexBuilder NewIndexBuilder(size_t data_offset) const {
+            return {data_offset, _options.block_size, _options.index_partition_size, _options.bloom_bits_per_key,
+                    _options.data_block_hash_index ? _options.data_block_hash_util_ratio : 0, _options.learned_index,
+                    _options.learned_index_error, _options.prefix_extractor};
+        }
+
+        // write the range tombstone record a segment starts with, if there are any ranges. Returns the bytes written
+        static size_t WriteRangeTombstones(std::ostream& file, const RangeTombstones& ranges);
+
+        /**
+         * Reads the range tombstone record a segment may start with and leaves the file at its first key-value record.
+         * Returns the offset of that record
+         */
+        static size_t ReadRangeTombstones(std::istream& file, RangeTombstones& ranges);
+
+        /**
+         * Called with _mutex held once the active memtable is full. Moves it to the flush queue together with its
+         * log file, waiting first if the queue is already at its limit
+         * @param ulock - lock on _mutex, released while waiting
+         * @param from_log - true while memtables are being rebuilt from the log files on start up
+         * @param force - switch the memtable even if it isn't full
+         */
+        void SwitchMemtable(std::unique_lock<std::mutex>& ulock, bool from_log, bool force = false);
+
+        // true once the active memtable has reached its size limit or should be flushed early to stay within the
+        // memory budget. Requires _mutex
+        bool MemtableFull() const {
+            return _memtableSize >= _MAX_MEMTABLE_SIZE || (_memtable_bytes > 0 && _options.memory_manager->ShouldFlush());
+        }
+
+        // replace old_bytes of the active memtable's charge with new_bytes. Requires _mutex
+        void ChargeMemtable(size_t old_bytes, size_t new_bytes);
+
+        // feed the flush queue length and the compaction backlog to the write controller. Requires _mutex
+        void UpdateWriteStallState();
+
+        void RecordWriteStall(WriteStallCause cause, WriteStallCondition condition, uint64_t micros);
 
         // compact memtable
-        static void Compact();
+        void Compact();
+
+        /**
+         * The merge stage of a compaction, for the keys in [begin, end) or all keys if end is empty: merges the
+         * records of both inputs into output and index_builder, and adds the bytes of the blob values whose references
+         * it leaves out to dropped_blob_bytes, by blob file. Several key ranges of one compaction can be merged at once
+         */
+        void MergeInputs(const CompactionInputs& inputs, const std::string& begin, const std::string& end, AsyncWritableFile& output,
+                         SegmentIndexBuilder& index_builder, std::map<uint64_t, uint64_t>& dropped_blob_bytes);
+
+        /**
+         * The keys splitting a compaction into key ranges of about the same size for options.max_subcompactions
+         * threads, taken from the index partitions of its inputs. Empty if it is merged on one thread
+         */
+        std::vector<std::string> SubcompactionBoundaries(const CompactionInputs& inputs) const;
 
         /**
-         * This functions sets the log file to zero bytes. Called only when a memtable has been written successfully to an sstable on disk
+         * Merge a compaction split at boundaries into the segment at path, the key ranges at once on the compaction
+         * thread pool and this thread. Each range is written straight into a region of the segment of its own, which
+         * starts on a block boundary and has room for twice the bytes the range reads, and JoinFileRegions() then
+         * makes one run of records of them, so nothing is written twice. The range tombstones of output_ranges go
+         * first, and its data_offset is set. False if a range outgrew its region or anything could not be written,
+         * which leaves the compaction to be merged on one thread
          */
-        static void ClearLogFile();
+        bool MergeSubcompactions(const CompactionInputs& inputs, const std::vector<std::string>& boundaries, const fs::path& path,
+                                 SegmentRangeTombstones& output_ranges, std::map<uint64_t, uint64_t>& dropped_blob_bytes);
+
+        /**
+         * Whether the inputs of a compaction hold key ranges that don't overlap, as segments of keys written in
+         * increasing order do, so that merging them would only write their records again: no range tombstones, no
+         * compaction filter, and segments older than the inputs whose keys tombstones still have to hide. Such inputs
+         * are moved up a tier as they are instead
+         */
+        bool MovableInputs(const CompactionInputs& inputs) const;
+
+        // LogBatch() and InsertBatch() in one, for a batch that is complete on its own. Requires _mutex
+        void ApplyBatch(const WriteBatch& batch, bool sync);
 
-        static void CreateIndexFromCompactedSegment(std::string);
+        // the record each update of a batch is stored as, some of them encoded into encoded
+        static std::vector<const std::string*> BatchValues(const WriteBatch& batch, std::deque<std::string>& encoded);
 
-        static void StoreSegmentpath(long filename, std::string filepath) {
-            Kora::StorageEngine::_sstables.insert(std::make_pair(filename, filepath));
+        /**
+         * Inserts a record into the active memtable. Merge records are stacked on the key's entry instead of
+         * replacing it, without calling the merge operator. Requires _mutex
+         */
+        void AddToMemtable(const Data& key, const Data& value);
+
+        /**
+         * Deletes [begin, end) in the active memtable: erases its entries in the range and records the range so that
+         * it hides older memtables and segments. Requires _mutex
+         */
+        void AddRangeTombstone(const std::string& begin, const std::string& end);
+
+        // apply range tombstones replayed from a log file
+        void ReplayRangeTombstones(const RangeTombstones& ranges);
+
+        /**
+         * Collects the versions of a key that readers need, newest first: down to the first one that is not a merge
+         * record of kind _MERGE_PARTIAL, with a tombstone standing in for a covering range tombstone. Values moved to
+         * blob files are left as blob records. Lookups made by blob garbage collection count towards the memtable and
+         * segment probe statistics just like Get()s. Requires _mutex
+         */
+        void FindVersions(const std::string& key, std::vector<std::string>& versions);
+
+        // the part of FindVersions() that looks at the memtables. Returns true if the search ended there
+        bool FindMemtableVersions(const std::string& key, std::vector<std::string>& versions);
+
+        // the part of FindVersions() that looks at the segments, once the memtables didn't end the search
+        void FindSegmentVersions(const std::string& key, std::vector<std::string>& versions);
+
+        // the value a Get() of key returns, given the versions found for it
+        Result ResolveVersions(const std::string& key, std::vector<std::string>& versions);
+
+        /**
+         * The row cache holds the result of Get()s the segments answered, for keys that no memtable holds: a value, or
+         * nothing for keys that are not found. Writing a key erases its row, and a range delete drops every row of the
+         * engine by moving on to a new _row_cache_id. Requires _mutex
+         */
+        [[nodiscard]] std::string RowKey(const char* key, size_t key_size) const;
+        bool LookupRow(const std::string& key, Result& result);
+        void InsertRow(const std::string& key, Result& result);
+
+        /**
+         * Iterators over a snapshot of the memtables and segments, newest first: the active memtable, the memtables
+         * waiting to be flushed, then the segments. Each child comes with the range tombstones of its memtable or
+         * segment. With a prefix, the children only hold the keys that start with it, and memtables and segments that
+         * can't hold any get an empty child, or none at all if they have no range tombstones. Requires _mutex
+         */
+        void SnapshotChildren(std::vector<std::unique_ptr<Iterator>>& children, std::vector<RangeTombstones>& range_tombstones,
+                              const std::string& prefix = "");
+
+        // a filter for the prefixes of a new memtable, without bits if there is no prefix extractor
+        DynamicBloom NewMemtablePrefixFilter() const {
+            bool enabled = _options.prefix_extractor && _options.memtable_prefix_bloom_size_ratio > 0;
+            return DynamicBloom(enabled ? static_cast<size_t>(_MAX_MEMTABLE_SIZE * _options.memtable_prefix_bloom_size_ratio * 8) : 0);
         }
 
-        static void DeleteSegmentpath(long filename) {
-            Kora::StorageEngine::_sstables.erase(filename);
+        /**
+         * whether a memtable may hold keys with prefix as told by its prefix filter, which is only asked when it has
+         * bits and use_filter is set
+         */
+        bool MemtableMayHavePrefix(const DynamicBloom& filter, std::string_view prefix, bool use_filter);
+
+        static bool IsBlobRecord(const std::string& value) {
+            return value.size() > _BLOB_RECORD.size() && value.compare(0, _BLOB_RECORD.size(), _BLOB_RECORD) == 0;
         }
 
-        static void RemoveIndex(std::string filepath) {
-            Kora::StorageEngine::_hash_indexes.erase(filepath);
+        static std::string EncodeBlobRecord(const BlobIndex& index) { return _BLOB_RECORD + index.Encode(); }
+
+        static bool DecodeBlobRecord(const std::string& record, BlobIndex& index) {
+            return IsBlobRecord(record) && index.Decode(record.data() + _BLOB_RECORD.size(), record.size() - _BLOB_RECORD.size());
         }
 
-        // keep in-memory index of all segments. filepath->index
-        static std::unordered_map<std::string, std::map<std::string, size_t>> _hash_indexes;
+        // read the value a blob record stands in for from one of blob_files
+        Status ReadBlob(const BlobFiles& blob_files, const std::string& record, std::string& value);
+
+        /**
+         * Runs options.compaction_filter on a record compaction keeps. Returns the record to write instead: value
+         * itself, changed, or a tombstone if the filter removed the key. Tombstones and merge records are returned as
+         * they are
+         */
+        const std::string& FilterValue(const BlobFiles& blob_files, const std::string& key, const std::string& value, std::string& changed);
+
+        /**
+         * Takes the bytes of blob records compaction dropped off the live bytes of their blob files, by file number,
+         * and removes the files that have no live values left. Requires _mutex
+         */
+        void DropBlobReferences(const std::map<uint64_t, uint64_t>& dropped_bytes);
+
+        // true unless value is a merge record whose operands still need the older versions of the key
+        static bool IsFinalVersion(const std::string& value) {
+            return !IsMergeRecord(value) || value[_MERGE_RECORD.size()] != _MERGE_PARTIAL;
+        }
+
+        static bool IsMergeRecord(const char* value, size_t size) {
+            return size > _MERGE_RECORD.size() && memcmp(value, _MERGE_RECORD.data(), _MERGE_RECORD.size()) == 0;
+        }
+
+        static bool IsMergeRecord(const std::string& value) { return IsMergeRecord(value.data(), value.size()); }
+
+        static std::string EncodeMergeRecord(char kind, const std::string& base, const std::vector<std::string>& operands);
+
+        // split a merge record into its base kind, base and operands. False if the record is malformed
+        static bool DecodeMergeRecord(const std::string& record, char& kind, std::string& base, std::vector<std::string>& operands);
+
+        /**
+         * Folds the versions of a key, newest first, into what readers see. Versions past the first one that is not a
+         * merge record of kind _MERGE_PARTIAL are ignored. The merge operator is applied once the operands have a
+         * base, or if complete is set, meaning no versions older than the given ones exist. Otherwise result is the
+         * versions combined into a single merge record
+         */
+        MergeResult FoldVersions(const std::string& key, const std::vector<const std::string*>& versions, bool complete, std::string& result);
+
+        // read the next [key size][value size][key][value] record of a segment or log file. False at the end of the file
+        static bool ReadRecord(std::istream& file, std::string& key, std::string& value);
+
+        static void WriteRecord(std::ostream& file, const char* key, size_t key_size, const char* value, size_t value_size);
+
+        void StoreSegmentpath(long filename, std::string filepath) {
+            _sstables.insert(std::make_pair(filename, filepath));
+        }
+
+        void DeleteSegmentpath(long filename) {
+            _sstables.erase(filename);
+        }
+
+        void RemoveIndex(std::string filepath) {
+            _segment_indexes.erase(filepath);
+        }
+
+        // forget and remove a segment file a compaction is done with. Requires _mutex
+        void RemoveSegment(const fs::path& path) {
+            DeleteSegmentpath(getSegmentFileAsLong(path.filename()));
+            RemoveIndex(path);
+            _segment_range_tombstones.erase(path);
+            _segment_levels.erase(path);
+            fs::remove(path);
+        }
+
+        // index of every segment. filepath->index. Guarded by _mutex
+        std::unordered_map<std::string, std::shared_ptr<SegmentIndex>> _segment_indexes;
+
+        // the index of a segment, nullptr if it has none. Requires _mutex
+        std::shared_ptr<SegmentIndex> IndexOf(const std::string& filepath) const {
+            auto it = _segment_indexes.find(filepath);
+            return it == _segment_indexes.end() ? nullptr : it->second;
+        }
+
+        // blob files holding values segments still refer to. Guarded by _mutex
+        BlobFiles _blob_files;
+
+        // tiers of the segments a compaction moved up without merging them, above the tier of their size. Only kept in
+        // memory: after a restart they are moved again, which reads nothing. filepath->tier. Guarded by _mutex
+        std::unordered_map<std::string, int> _segment_levels;
+
+        // size tier of a segment: the tier of its size or the one it was moved up to. Requires _mutex
+        int LevelOf(const std::string& filepath, uintmax_t size) const {
+            auto it = _segment_levels.find(filepath);
+            return it == _segment_levels.end() ? SegmentLevel(size) : std::max(SegmentLevel(size), it->second);
+        }
+
+        // range tombstones of the segments that have any. filepath->range tombstones. Guarded by _mutex
+        std::unordered_map<std::string, SegmentRangeTombstones> _segment_range_tombstones;
+
+        // range tombstones of a segment and where its key-value records start. Requires _mutex
+        SegmentRangeTombstones RangeTombstonesOf(const std::string& filepath) const {
+            auto it = _segment_range_tombstones.find(filepath);
+            return it == _segment_range_tombstones.end() ? SegmentRangeTombstones() : it->second;
+        }
 
         /**
          *
          * @param key - the key we're searching for
          * @param filepath
-         * @param start_offset
-         * @param end_offset
+         * @param start_offset - where the records start, past the range tombstones
+         * @param end_offset - where the records end, e.g. the index of a segment whose index can't be used. The scan
+         * stops there or at the end of the file, whichever comes first
          * @return
          */
-        static Result Search(const char* key, std::string filepath, size_t start_offset, size_t end_offset = SIZE_MAX);
+        Result Search(const std::string& key, std::string filepath, size_t start_offset, size_t end_offset = SIZE_MAX);
 
         /**
-         * When DB is started build an in-memory cache of all sstables from most-recent to least-recent. The cache helps speed up the process of looking for a key as we already know where to start looking from and where to end
+         * Looks a key up in one segment: through its index, which reads at most one data block, or with Search() for
+         * segments written before segments had an index. Requires _mutex
          */
-        static void BuildSSTableMap();
+        Result SearchSegment(const std::string& key, const std::string& filepath);
 
         /**
-         * When DB is started, create a sparse hash index for all sstables to speed up search.. TBD
+         * When DB is started build an in-memory cache of all sstables from most-recent to least-recent. The cache helps speed up the process of looking for a key as we already know where to start looking from and where to end
          */
-        static void BuildIndexes();
+        void BuildSSTableMap();
 
         /***
-         * WHen DB restarts, load all non-persisted data to the memtable for them to eventually be written to disk
+         * WHen DB restarts, load all non-persisted data to the memtable for them to eventually be written to disk.
+         * Log files are replayed oldest first, each up to its first record that is torn or left over from an earlier
+         * use of the file. Once the memtables that filled up during the replay have been flushed, the remaining records
+         * are rewritten into a fresh active log file and the old log files are recycled
          * @param SE - Pointer to the Storage Engine instance
          */
         static void UpdateSSTablesFromLogFile(StorageEngine *SE);
 
-        static void DiscardDeletedKey(std::string, long);
+        // replay the records of one log file into the memtable. False for log files written without checksums
+        static bool ReplayLogFile(const fs::path& path, uint64_t number, StorageEngine *SE);
+
+        // start log file number _log_number + 1 in a recyclable log file if there is one. nullptr if it can't be
+        // opened. Requires _mutex
+        std::shared_ptr<LogWriter> NewLogFile();
+
+        // keep a log file nothing needs any more for NewLogFile() if there is room for it, otherwise remove it.
+        // Requires _mutex
+        void RecycleLogFile(const fs::path& path, uint64_t number);
+
+        // size tier a segment of the given size belongs to: 0 for segments too small to compact, otherwise 1-4
+        static int SegmentLevel(uintmax_t size);
+
+        // bytes a segment takes on disk. The holes a compaction split into subcompactions may leave between its key
+        // ranges don't count, so that they don't move the segment up a tier
+        static uintmax_t SegmentSize(const std::string& filepath, std::error_code& ec);
+
+        // count the segment files and their sizes per size tier, settled segments included. Requires _mutex
+        void TierSizes(uintmax_t level_files[_SETTLED_LEVEL + 1], uintmax_t level_bytes[_SETTLED_LEVEL + 1]);
+
+        // the "kora.stats" property: per tier segment counts, compaction backlog, amplification and the raw statistics
+        std::string StatsString();
+
+        // append the current statistics to the LOG file in the db directory
+        void DumpStats();
     };
 
 }
@@ -0,0 +1,75 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_THREAD_POOL_H
+#define KV_STORE_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Kora {
+    enum class JobPriority {
+        _HIGH = 0, // flushes: writers may be waiting on them
+        _LOW = 1 // compactions
+    };
+
+    /**
+     * A fixed set of threads running background jobs in the order they were scheduled. Every database in the process
+     * shares the two default pools, one per priority, so the number of flush and compaction threads stays bounded no
+     * matter how many databases are open. Flushes get their own pool so that they never queue behind long compactions.
+     *
+     * Each database keeps at most one flush and one compaction job scheduled at a time and waits for them before it is
+     * destroyed, so jobs never outlive the database they belong to.
+     */
+    class ThreadPool {
+    public:
+        explicit ThreadPool(int threads);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void Schedule(std::function<void()> job);
+
+        /**
+         * Changes the number of threads running jobs. Extra threads are started right away; when shrinking, threads
+         * above the new limit finish their current job and then sit idle
+         */
+        void SetBackgroundThreads(int threads);
+
+        // grow the pool to at least the given number of threads
+        void EnsureBackgroundThreads(int threads);
+
+        [[nodiscard]] int GetBackgroundThreads();
+
+        // jobs scheduled but not started yet
+        [[nodiscard]] size_t QueueLength();
+
+        /**
+         * The pool shared by all databases for jobs of the given priority. Starts with one flush thread and one
+         * compaction thread per core; resize them with SetBackgroundThreads() before or after opening databases
+         */
+        static ThreadPool& Default(JobPriority priority);
+
+    private:
+        void Run(int index);
+
+        // requires _mutex
+        void SetLimit(int threads);
+
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _queue;
+        int _limit = 0;
+        bool _shutting_down = false;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+    };
+}
+
+#endif //KV_STORE_THREAD_POOL_H
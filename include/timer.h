@@ -7,6 +7,8 @@
 
 #include <functional>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace Kora {
     class Timer {
@@ -14,21 +16,51 @@ namespace Kora {
         Timer() : _execute{false} {}
 
         ~Timer() {
-            _thread.join();
+            stop();
         }
 
-        void start(int interval, std::function<void(void)> func) {
+        // run func every interval milliseconds. With run_immediately false the first run happens after one interval
+        void start(int interval, std::function<void(void)> func, bool run_immediately = true) {
             _execute = true;
-            _thread = std::thread([this, interval, func] {
+            _thread = std::thread([this, interval, func, run_immediately] {
+                std::unique_lock<std::mutex> ulock(_mutex);
+                if (!run_immediately) {
+                    _cond.wait_for(ulock, std::chrono::milliseconds(interval), [this] { return !_execute || _wake; });
+                }
                 while (_execute) {
+                    _wake = false;
+                    ulock.unlock();
                     func();
-                    std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+                    ulock.lock();
+                    // wait instead of sleeping so that stop() and wake() don't have to sit out the whole interval
+                    _cond.wait_for(ulock, std::chrono::milliseconds(interval), [this] { return !_execute || _wake; });
                 }
             });
         }
+
+        // run func as soon as possible instead of waiting for the rest of the interval
+        void wake() {
+            {
+                std::lock_guard<std::mutex> lg(_mutex);
+                _wake = true;
+            }
+            _cond.notify_all();
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lg(_mutex);
+                _execute = false;
+            }
+            _cond.notify_all();
+            if (_thread.joinable()) _thread.join();
+        }
     private:
         bool _execute = false;
+        bool _wake = false;
         std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _cond;
     };
 }
 
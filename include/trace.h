@@ -0,0 +1,233 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_TRACE_H
+#define KV_STORE_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "helper.h"
+#include "status.h"
+#include "write_batch.h"
+
+namespace Kora {
+    struct TraceOptions {
+        // Tracing stops once the trace file reaches this many bytes, the operations after that are left out. 0 sets
+        // no limit.
+        uint64_t max_trace_file_size = 0;
+    };
+
+    enum class TraceType : uint8_t {
+        _SET = 1,
+        _GET = 2,
+        _DELETE = 3,
+        _WRITE = 4
+    };
+
+    // one operation read back from a trace file
+    struct TraceRecord {
+        TraceType type = TraceType::_GET;
+        // when the operation was called, in microseconds since the trace started
+        uint64_t timestamp = 0;
+        // WriteOptions::sync of Set(), Delete() and Write()
+        bool sync = false;
+        std::string key;
+        // the value of Set()
+        std::string value;
+        // the updates of Write()
+        WriteBatch batch;
+    };
+
+    /**
+     * Writes the operations called on a database to a trace file, to be replayed by koradb_replay. The file starts
+     * with _MAGIC and each operation takes [type][time][operation], the type byte carrying the sync flag in its top
+     * bit, the time the microseconds since the previous operation as a varint, and keys and values their size as a
+     * varint followed by their bytes. A Write() is [count] and [op type][key][value] per update.
+     * Operations are recorded in the order they were applied, by the sequence number the engine takes with
+     * NextSequence() in the same critical section that applies them. Each thread buffers its own records, and once
+     * one has _THREAD_BUFFER_SIZE bytes they are merged by sequence number and written out, up to the first operation
+     * that may still be in flight. Thread-safe
+     */
+    class TraceWriter {
+    public:
+        // records of one thread, waiting to be merged with those of the other threads
+        struct ThreadBuffer {
+            struct Entry {
+                uint64_t sequence = 0;
+                uint64_t micros = 0;
+                // where the record is in data: its type byte, followed by the operation
+                size_t offset = 0;
+                size_t size = 0;
+            };
+
+            std::thread::id owner;
+            std::mutex mutex;
+            std::string data;
+            std::vector<Entry> entries;
+            // the lowest sequence number the operation the thread is applying can get, _NO_SEQUENCE while it applies
+            // none
+            std::atomic<uint64_t> low{_NO_SEQUENCE};
+        };
+
+        TraceWriter(const fs::path& path, const TraceOptions& options);
+
+        ~TraceWriter() { Close(); }
+
+        TraceWriter(const TraceWriter&) = delete;
+        TraceWriter& operator=(const TraceWriter&) = delete;
+
+        [[nodiscard]] bool is_open() const { return _file.is_open(); }
+
+        /**
+         * Mark the calling thread as about to apply an operation, to be recorded with Set(), Get(), Delete() or Write()
+         * once it is applied, or dropped with AbortOperation(). nullptr if the trace is closed or full
+         */
+        ThreadBuffer* StartOperation();
+
+        void AbortOperation(ThreadBuffer* buffer);
+
+        /**
+         * Record the operation started on buffer under sequence, the number NextSequence() gave while it was
+         * applied. An operation that was never applied passes _NO_SEQUENCE and takes the next number
+         */
+        void Set(ThreadBuffer* buffer, uint64_t sequence, const std::string& key, const std::string& value, bool sync);
+        void Get(ThreadBuffer* buffer, uint64_t sequence, const std::string& key);
+        void Delete(ThreadBuffer* buffer, uint64_t sequence, const std::string& key, bool sync);
+        void Write(ThreadBuffer* buffer, uint64_t sequence, const WriteBatch& batch, bool sync);
+
+        /**
+         * Stop recording, wait for the operations in flight, and write out what is buffered and close the file.
+         * IoError if any of the trace could not be written
+         */
+        Status Close();
+
+        // the position of an operation among the operations of every traced database, in the order they are applied
+        static uint64_t NextSequence() { return _next_sequence.fetch_add(1); }
+
+        static const char _MAGIC[8];
+        static const uint64_t _NO_SEQUENCE = UINT64_MAX;
+
+    private:
+        // the buffer of the calling thread, created on its first operation
+        ThreadBuffer* CurrentThreadBuffer();
+
+        // start a record in buffer, whose mutex is held. Returns its offset in buffer.data
+        static size_t BeginRecord(ThreadBuffer& buffer, TraceType type, bool sync);
+
+        /**
+         * Finish the record started at offset and end the operation of the thread. Requires the mutex of buffer.
+         * True once the buffer has grown to _THREAD_BUFFER_SIZE
+         */
+        bool EndRecord(ThreadBuffer& buffer, uint64_t sequence, size_t offset);
+
+        /**
+         * Take the records of every thread and write out, in sequence order, those below the first sequence number
+         * an operation in flight may still get. The others wait for the next merge. With all set every record is
+         * written. Without it the merge is skipped if another thread is merging already
+         */
+        void Merge(bool all);
+
+        // hand _buffer to the file. Requires _merge_mutex
+        void WriteBuffer();
+
+        static const size_t _BUFFER_SIZE = 256 * 1024;
+        static const size_t _THREAD_BUFFER_SIZE = 64 * 1024;
+        static std::atomic<uint64_t> _next_sequence;
+        static std::atomic<uint64_t> _next_id;
+
+        // tells the buffers of this writer apart from those of earlier ones in the thread local cache
+        const uint64_t _id = _next_id.fetch_add(1);
+        std::atomic<bool> _closed{false};
+        std::atomic<bool> _full{false};
+        TraceOptions _options;
+        std::mutex _threads_mutex;
+        // guarded by _threads_mutex
+        std::vector<std::unique_ptr<ThreadBuffer>> _threads;
+
+        // the rest is guarded by _merge_mutex
+        std::mutex _merge_mutex;
+        std::ofstream _file;
+        std::string _buffer;
+        // records taken from the thread buffers that couldn't be written yet, in _pending_data
+        std::vector<ThreadBuffer::Entry> _pending;
+        std::string _pending_data;
+        uint64_t _start_micros;
+        uint64_t _last_micros;
+        // bytes handed to the file so far
+        uint64_t _file_size = 0;
+    };
+
+    /**
+     * An operation a TraceWriter records: started when constructed, before the operation is applied, and recorded
+     * once it has been with the sequence number the engine took for it. Converts to false if no trace is running,
+     * in which case recording does nothing. An operation that is never recorded is dropped
+     */
+    class TracedOperation {
+    public:
+        TracedOperation() = default;
+
+        explicit TracedOperation(std::shared_ptr<TraceWriter> writer): _writer{std::move(writer)} {
+            if (_writer) _buffer = _writer->StartOperation();
+        }
+
+        ~TracedOperation() {
+            if (_buffer) _writer->AbortOperation(_buffer);
+        }
+
+        TracedOperation(const TracedOperation&) = delete;
+        TracedOperation& operator=(const TracedOperation&) = delete;
+
+        explicit operator bool() const { return _buffer != nullptr; }
+
+        void Set(uint64_t sequence, const std::string& key, const std::string& value, bool sync) {
+            if (_buffer) _writer->Set(std::exchange(_buffer, nullptr), sequence, key, value, sync);
+        }
+
+        void Get(uint64_t sequence, const std::string& key) {
+            if (_buffer) _writer->Get(std::exchange(_buffer, nullptr), sequence, key);
+        }
+
+        void Delete(uint64_t sequence, const std::string& key, bool sync) {
+            if (_buffer) _writer->Delete(std::exchange(_buffer, nullptr), sequence, key, sync);
+        }
+
+        void Write(uint64_t sequence, const WriteBatch& batch, bool sync) {
+            if (_buffer) _writer->Write(std::exchange(_buffer, nullptr), sequence, batch, sync);
+        }
+
+    private:
+        std::shared_ptr<TraceWriter> _writer;
+        TraceWriter::ThreadBuffer* _buffer = nullptr;
+    };
+
+    /**
+     * Reads the operations of a trace file written by TraceWriter back, in the order they were called
+     */
+    class TraceReader {
+    public:
+        explicit TraceReader(const fs::path& path);
+
+        // Corruption if the file is not a trace, IoError if it can't be opened
+        [[nodiscard]] Status status() const { return _status; }
+
+        // the next operation. False at the end of the trace, or at a record cut short
+        bool Next(TraceRecord& record);
+
+    private:
+        std::ifstream _file;
+        Status _status;
+        uint64_t _timestamp = 0;
+    };
+}
+
+#endif //KV_STORE_TRACE_H
@@ -0,0 +1,79 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_WRITE_BATCH_H
+#define KV_STORE_WRITE_BATCH_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Kora {
+    /**
+     * A group of updates applied atomically by DB::Write(): after a crash either all of them are in the database or
+     * none are, and iterators never see some of them without the others. Updates are applied in the order they were
+     * added, so a later update of a key wins over an earlier one.
+     *
+     *   Kora::WriteBatch batch;
+     *   batch.Delete("key1");
+     *   batch.Set("key2", value);
+     *   db.Write(batch);
+     */
+    class WriteBatch {
+    public:
+        enum class OpType {
+            _SET = 0,
+            _DELETE = 1,
+            _MERGE = 2,
+            _DELETE_RANGE = 3 // key is the start of the range, value its end
+        };
+
+        struct Op {
+            OpType type;
+            std::string key;
+            std::string value;
+        };
+
+        void Set(std::string key, std::string value) {
+            _byte_size += key.size() + value.size();
+            _ops.push_back({OpType::_SET, std::move(key), std::move(value)});
+        }
+
+        void Delete(std::string key) {
+            _byte_size += key.size();
+            _ops.push_back({OpType::_DELETE, std::move(key), ""});
+        }
+
+        // delete every key in [begin, end), see DB::DeleteRange()
+        void DeleteRange(std::string begin, std::string end) {
+            _byte_size += begin.size() + end.size();
+            _ops.push_back({OpType::_DELETE_RANGE, std::move(begin), std::move(end)});
+        }
+
+        // record an operand for the merge operator to apply to the value of key, see DB::Merge()
+        void Merge(std::string key, std::string operand) {
+            _byte_size += key.size() + operand.size();
+            _ops.push_back({OpType::_MERGE, std::move(key), std::move(operand)});
+        }
+
+        void Clear() {
+            _ops.clear();
+            _byte_size = 0;
+        }
+
+        // number of updates in the batch
+        [[nodiscard]] size_t Count() const { return _ops.size(); }
+
+        // user key and value bytes in the batch
+        [[nodiscard]] size_t ByteSize() const { return _byte_size; }
+
+        [[nodiscard]] const std::vector<Op>& Ops() const { return _ops; }
+
+    private:
+        std::vector<Op> _ops;
+        size_t _byte_size = 0;
+    };
+}
+
+#endif //KV_STORE_WRITE_BATCH_H
@@ -0,0 +1,84 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#ifndef KV_STORE_WRITE_CONTROLLER_H
+#define KV_STORE_WRITE_CONTROLLER_H
+
+#include "options.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace Kora {
+    enum class WriteStallCondition {
+        _NORMAL = 0,
+        _DELAYED = 1, // writes are paced to the delayed write rate
+        _STOPPED = 2 // writes wait until flushes or compactions catch up
+    };
+
+    enum class WriteStallCause {
+        _NONE = 0,
+        _MEMTABLE_LIMIT = 1, // too many memtables waiting to be flushed
+        _SEGMENT_LIMIT = 2, // too many segments waiting to be compacted
+        _PENDING_COMPACTION_BYTES = 3 // too many bytes waiting to be compacted
+    };
+
+    /**
+     * Decides whether writers should run at full speed, be slowed down or be stopped, based on the flush queue length
+     * and the compaction backlog. The storage engine feeds it the current state whenever a memtable is switched or
+     * flushed and whenever compaction makes progress; writers only read the resulting condition, which is atomic.
+     *
+     * While delayed, writes are paced so that they don't exceed the delayed write rate. The rate shrinks linearly from
+     * Options::delayed_write_rate down to an eighth of it as the backlog moves from its slowdown trigger towards its
+     * stop trigger, so writers feel back pressure gradually before they are stopped outright.
+     */
+    class WriteController {
+    public:
+        explicit WriteController(const Options& options);
+
+        void Update(size_t immutable_memtables, size_t backlog_segments, uint64_t pending_compaction_bytes);
+
+        [[nodiscard]] WriteStallCondition Condition() const { return _condition.load(std::memory_order_acquire); }
+
+        [[nodiscard]] WriteStallCause Cause() const { return _cause.load(std::memory_order_acquire); }
+
+        [[nodiscard]] bool IsStopped() const { return Condition() == WriteStallCondition::_STOPPED; }
+
+        // bytes per second writes are paced to while delayed
+        [[nodiscard]] uint64_t DelayedWriteRate() const { return _delayed_write_rate.load(std::memory_order_relaxed); }
+
+        // the most memtables that can wait for a flush before writers have to stop
+        [[nodiscard]] size_t MaxImmutableMemtables() const { return _max_immutable_memtables; }
+
+        /**
+         * Reserves room for a write of num_bytes at the delayed write rate and returns how many microseconds the
+         * writer should sleep before going ahead. Returns 0 unless writes are delayed.
+         */
+        uint64_t GetDelay(uint64_t num_bytes);
+
+        static std::string ConditionName(WriteStallCondition condition);
+        static std::string CauseName(WriteStallCause cause);
+
+    private:
+        size_t _max_immutable_memtables;
+        size_t _memtable_slowdown_trigger;
+        size_t _segment_slowdown_trigger;
+        size_t _segment_stop_trigger;
+        uint64_t _soft_pending_compaction_bytes;
+        uint64_t _hard_pending_compaction_bytes;
+        uint64_t _base_delayed_write_rate;
+
+        std::atomic<WriteStallCondition> _condition{WriteStallCondition::_NORMAL};
+        std::atomic<WriteStallCause> _cause{WriteStallCause::_NONE};
+        std::atomic<uint64_t> _delayed_write_rate;
+
+        std::mutex _mutex;
+        // the time at which the last reserved write is allowed to finish
+        uint64_t _next_write_micros = 0;
+    };
+}
+
+#endif //KV_STORE_WRITE_CONTROLLER_H
@@ -0,0 +1,84 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/blob_file.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+std::string Kora::BlobIndex::Encode() const {
+    std::string encoded;
+    encoded.append(reinterpret_cast<const char*>(&file_number), sizeof file_number);
+    encoded.append(reinterpret_cast<const char*>(&offset), sizeof offset);
+    encoded.append(reinterpret_cast<const char*>(&size), sizeof size);
+    return encoded;
+}
+
+bool Kora::BlobIndex::Decode(const char* data, size_t data_size) {
+    if (data_size != sizeof file_number + sizeof offset + sizeof size) return false;
+    std::memcpy(&file_number, data, sizeof file_number);
+    std::memcpy(&offset, data + sizeof file_number, sizeof offset);
+    std::memcpy(&size, data + sizeof file_number + sizeof offset, sizeof size);
+    return true;
+}
+
+bool Kora::BlobFileWriter::Add(const char* key, size_t key_size, const char* value, size_t value_size, BlobIndex& index) {
+    _file.write(reinterpret_cast<const char*>(&key_size), sizeof key_size);
+    _file.write(reinterpret_cast<const char*>(&value_size), sizeof value_size);
+    _file.write(key, key_size);
+    _file.write(value, value_size);
+    index.file_number = _number;
+    index.offset = _offset + sizeof key_size + sizeof value_size + key_size;
+    index.size = value_size;
+    _offset += index.RecordSize(key_size);
+    return _file.good();
+}
+
+bool Kora::BlobFileWriter::Finish() {
+    _file.close();
+    return !_file.fail();
+}
+
+Kora::BlobFile::BlobFile(fs::path path, uint64_t number): _path{std::move(path)}, _number{number} {
+    // the descriptor stays open for the life of the object, so the file remains readable even once it is unlinked
+    _fd = ::open(_path.c_str(), O_RDONLY);
+    std::error_code ec;
+    _file_size = fs::file_size(_path, ec);
+    if (ec) _file_size = 0;
+}
+
+Kora::BlobFile::~BlobFile() {
+    if (_fd >= 0) ::close(_fd);
+    if (_obsolete) {
+        std::error_code ec;
+        fs::remove(_path, ec);
+    }
+}
+
+Kora::Status Kora::BlobFile::Read(const BlobIndex& index, std::string& value) const {
+    if (_fd < 0) return Status::IoError("Unable to open blob file " + _path.string());
+    if (index.offset + index.size > _file_size) return Status::Corruption("Blob index past the end of " + _path.string());
+    value.resize(index.size);
+    // pread leaves the file offset alone, so concurrent readers don't need to take turns
+    size_t done = 0;
+    while (done < index.size) {
+        auto n = ::pread(_fd, &value[done], index.size - done, static_cast<off_t>(index.offset + done));
+        if (n <= 0) return Status::IoError("Unable to read blob file " + _path.string());
+        done += n;
+    }
+    return {};
+}
+
+void Kora::BlobFile::RemoveLiveBytes(uint64_t bytes) {
+    uint64_t live = _live_bytes.load(std::memory_order_relaxed);
+    // clamp at zero rather than wrap around to a huge live size
+    while (!_live_bytes.compare_exchange_weak(live, live > bytes ? live - bytes : 0, std::memory_order_relaxed)) {}
+}
+
+double Kora::BlobFile::GarbageRatio() const {
+    if (_file_size == 0) return 1.0;
+    uint64_t live = LiveBytes();
+    return live >= _file_size ? 0.0 : 1.0 - static_cast<double>(live) / _file_size;
+}
@@ -0,0 +1,85 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/block_cache.h"
+
+#include <functional>
+
+Kora::BlockCache::BlockCache(size_t capacity, int num_shard_bits): _capacity{capacity} {
+    for (int i = 0; i < (1 << num_shard_bits); i++) _shards.push_back(std::make_unique<Shard>());
+}
+
+Kora::BlockCache::Block Kora::BlockCache::Lookup(const std::string& key) {
+    auto& shard = *_shards[std::hash<std::string>{}(key) % _shards.size()];
+    std::lock_guard<std::mutex> lg(shard.mutex);
+    auto entry = shard.entries.find(key);
+    if (entry == shard.entries.end()) return nullptr;
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry->second);
+    return entry->second->second;
+}
+
+void Kora::BlockCache::Insert(const std::string& key, Block block) {
+    auto& shard = *_shards[std::hash<std::string>{}(key) % _shards.size()];
+    size_t shard_capacity = Capacity() / _shards.size();
+    std::lock_guard<std::mutex> lg(shard.mutex);
+    auto entry = shard.entries.find(key);
+    if (entry != shard.entries.end()) {
+        shard.usage -= Charge(key, entry->second->second);
+        shard.lru.erase(entry->second);
+        shard.entries.erase(entry);
+    }
+    shard.usage += Charge(key, block);
+    shard.lru.emplace_front(key, std::move(block));
+    shard.entries[key] = shard.lru.begin();
+    // the new block itself goes too if it is larger than the whole shard
+    EvictToCapacity(shard, shard_capacity);
+}
+
+void Kora::BlockCache::Erase(const std::string& key) {
+    auto& shard = *_shards[std::hash<std::string>{}(key) % _shards.size()];
+    std::lock_guard<std::mutex> lg(shard.mutex);
+    auto entry = shard.entries.find(key);
+    if (entry == shard.entries.end()) return;
+    shard.usage -= Charge(key, entry->second->second);
+    shard.lru.erase(entry->second);
+    shard.entries.erase(entry);
+}
+
+size_t Kora::BlockCache::Usage() const {
+    size_t usage = 0;
+    for (const auto& shard: _shards) {
+        std::lock_guard<std::mutex> lg(shard->mutex);
+        usage += shard->usage;
+    }
+    return usage;
+}
+
+void Kora::BlockCache::SetCapacity(size_t capacity) {
+    _capacity.store(capacity, std::memory_order_relaxed);
+    size_t shard_capacity = capacity / _shards.size();
+    for (auto& shard: _shards) {
+        std::lock_guard<std::mutex> lg(shard->mutex);
+        EvictToCapacity(*shard, shard_capacity);
+    }
+}
+
+void Kora::BlockCache::EvictToCapacity(Shard& shard, size_t capacity) {
+    while (shard.usage > capacity && !shard.lru.empty()) {
+        auto& oldest = shard.lru.back();
+        shard.usage -= Charge(oldest.first, oldest.second);
+        shard.entries.erase(oldest.first);
+        shard.lru.pop_back();
+    }
+}
+
+std::string Kora::BlockCache::BlockKey(uint64_t cache_id, uint64_t offset) {
+    std::string key(reinterpret_cast<const char*>(&cache_id), sizeof cache_id);
+    key.append(reinterpret_cast<const char*>(&offset), sizeof offset);
+    return key;
+}
+
+uint64_t Kora::BlockCache::NewCacheId() {
+    static std::atomic<uint64_t> next_id{1};
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+}
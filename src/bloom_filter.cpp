@@ -0,0 +1,97 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/bloom_filter.h"
+
+#include <algorithm>
+#include <cstring>
+
+uint64_t Kora::StableHash(std::string_view key) {
+    // MurmurHash64A
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    uint64_t h = 0x4b6f7261ull ^ (key.size() * m);
+    size_t i = 0;
+    for (; i + 8 <= key.size(); i += 8) {
+        uint64_t k;
+        std::memcpy(&k, key.data() + i, sizeof k);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    size_t rest = key.size() - i;
+    if (rest > 0) {
+        for (size_t j = rest; j > 0; j--) h ^= static_cast<uint64_t>(static_cast<unsigned char>(key[i + j - 1])) << (8 * (j - 1));
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+std::string Kora::BloomFilterBuilder::Finish(int bits_per_key) const {
+    // ln 2 * bits per key probes give the lowest false positive rate
+    int num_probes = std::clamp(static_cast<int>(bits_per_key * 0.69), 1, 30);
+    size_t bits = std::max<size_t>(_hashes.size() * bits_per_key, 64);
+    size_t bytes = (bits + 7) / 8;
+    bits = bytes * 8;
+    std::string filter(bytes, '\0');
+    for (uint64_t hash: _hashes) {
+        // double hashing: the probes step through the bit array by a second hash derived from the first
+        uint64_t delta = (hash >> 33) | (hash << 31);
+        for (int probe = 0; probe < num_probes; probe++) {
+            uint64_t bit = hash % bits;
+            filter[bit / 8] |= static_cast<char>(1 << (bit % 8));
+            hash += delta;
+        }
+    }
+    filter.push_back(static_cast<char>(num_probes));
+    return filter;
+}
+
+bool Kora::BloomFilterMayMatch(std::string_view filter, std::string_view key) {
+    if (filter.size() < 2) return true;
+    int num_probes = static_cast<unsigned char>(filter.back());
+    if (num_probes < 1 || num_probes > 30) return true;
+    uint64_t bits = (filter.size() - 1) * 8;
+    uint64_t hash = StableHash(key);
+    uint64_t delta = (hash >> 33) | (hash << 31);
+    for (int probe = 0; probe < num_probes; probe++) {
+        uint64_t bit = hash % bits;
+        if ((filter[bit / 8] & (1 << (bit % 8))) == 0) return false;
+        hash += delta;
+    }
+    return true;
+}
+
+Kora::DynamicBloom::DynamicBloom(size_t bits): _bits{bits == 0 ? 0 : std::max<size_t>((bits + 63) / 64 * 64, 64)} {}
+
+void Kora::DynamicBloom::AddKey(std::string_view key) {
+    if (_bits == 0) return;
+    if (_data.empty()) _data.resize(_bits / 64);
+    uint64_t hash = StableHash(key);
+    uint64_t delta = (hash >> 33) | (hash << 31);
+    for (int probe = 0; probe < _NUM_PROBES; probe++) {
+        uint64_t bit = hash % _bits;
+        _data[bit / 64] |= 1ull << (bit % 64);
+        hash += delta;
+    }
+}
+
+bool Kora::DynamicBloom::MayMatch(std::string_view key) const {
+    if (_bits == 0) return true;
+    // nothing was added yet
+    if (_data.empty()) return false;
+    uint64_t hash = StableHash(key);
+    uint64_t delta = (hash >> 33) | (hash << 31);
+    for (int probe = 0; probe < _NUM_PROBES; probe++) {
+        uint64_t bit = hash % _bits;
+        if ((_data[bit / 64] & (1ull << (bit % 64))) == 0) return false;
+        hash += delta;
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/compaction_filter.h"
+
+#include <chrono>
+#include <cstring>
+
+Kora::CompactionFilter::Decision Kora::TtlCompactionFilter::Filter(const std::string&, const std::string& existing_value,
+                                                                   std::string*) const {
+    uint64_t expiry_time = 0;
+    if (existing_value.size() < sizeof expiry_time) return Decision::_KEEP;
+    std::memcpy(&expiry_time, existing_value.data() + existing_value.size() - sizeof expiry_time, sizeof expiry_time);
+    return expiry_time <= Now() ? Decision::_REMOVE : Decision::_KEEP;
+}
+
+std::string Kora::TtlCompactionFilter::Encode(const std::string& value, uint64_t expiry_time) {
+    std::string stored = value;
+    stored.append(reinterpret_cast<const char*>(&expiry_time), sizeof expiry_time);
+    return stored;
+}
+
+std::string Kora::TtlCompactionFilter::EncodeWithTtl(const std::string& value, uint64_t ttl_seconds) {
+    return Encode(value, Now() + ttl_seconds);
+}
+
+bool Kora::TtlCompactionFilter::Decode(const std::string& stored, std::string* value, uint64_t* expiry_time) {
+    if (stored.size() < sizeof(uint64_t)) return false;
+    size_t value_size = stored.size() - sizeof(uint64_t);
+    std::memcpy(expiry_time, stored.data() + value_size, sizeof(uint64_t));
+    value->assign(stored, 0, value_size);
+    return true;
+}
+
+uint64_t Kora::TtlCompactionFilter::Now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,222 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/compaction_pipeline.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Kora::PrefetchingSegmentReader::PrefetchingSegmentReader(const fs::path& path, uint64_t data_offset, uint64_t data_end,
+                                                         size_t readahead_size, bool use_direct_io):
+        _file{path, readahead_size, use_direct_io}, _pos{data_offset}, _end{data_end} {
+    _file.seekg(static_cast<std::streamoff>(data_offset));
+    _thread = std::thread([this] { Run(); });
+}
+
+Kora::PrefetchingSegmentReader::~PrefetchingSegmentReader() {
+    // a reader that is still ahead of the merge stops at its next batch
+    _queue.Close();
+    if (_thread.joinable()) _thread.join();
+}
+
+void Kora::PrefetchingSegmentReader::Run() {
+    while (true) {
+        uint64_t start = nowMicros();
+        Batch batch;
+        size_t batch_bytes = 0;
+        // [key size][value size][key][value]
+        while (batch_bytes < _BATCH_BYTES && _pos < _end) {
+            size_t key_size = 0, value_size = 0;
+            if (!_file.read(reinterpret_cast<char*>(&key_size), sizeof key_size) ||
+                !_file.read(reinterpret_cast<char*>(&value_size), sizeof value_size)) break;
+            if (key_size == PADDING_RECORD) {
+                _pos += sizeof key_size + sizeof value_size + value_size;
+                _file.seekg(static_cast<std::streamoff>(_pos));
+                continue;
+            }
+            std::string key(key_size, '\0'), value(value_size, '\0');
+            if (!_file.read(&key[0], key_size) || !_file.read(&value[0], value_size)) break;
+            _pos += sizeof key_size + sizeof value_size + key_size + value_size;
+            batch_bytes += key_size + value_size;
+            batch.emplace_back(std::move(key), std::move(value));
+        }
+        _busy_micros.fetch_add(nowMicros() - start, std::memory_order_relaxed);
+        if (batch.empty() || !_queue.Push(std::move(batch))) break;
+    }
+    _queue.Close();
+}
+
+bool Kora::PrefetchingSegmentReader::Next() {
+    if (_next < _batch.size()) {
+        _next++;
+        return true;
+    }
+    uint64_t start = nowMicros();
+    bool more = _queue.Pop(_batch);
+    _wait_micros += nowMicros() - start;
+    if (!more) {
+        _batch.clear();
+        _next = 0;
+        return false;
+    }
+    _next = 1;
+    return true;
+}
+
+Kora::AsyncWritableFile::AsyncWritableFile(const fs::path& path, bool use_direct_io): std::ostream(nullptr), _buffer{path, use_direct_io} {
+    rdbuf(&_buffer);
+    if (!_buffer.IsOpen()) setstate(std::ios::failbit);
+}
+
+Kora::AsyncWritableFile::AsyncWritableFile(const fs::path& path, bool use_direct_io, uint64_t offset): std::ostream(nullptr),
+        _buffer{path, use_direct_io, offset} {
+    rdbuf(&_buffer);
+    if (!_buffer.IsOpen()) setstate(std::ios::failbit);
+}
+
+void Kora::AsyncWritableFile::close() {
+    if (is_open() && !_buffer.Close()) setstate(std::ios::badbit);
+}
+
+Kora::AsyncWritableFile::Buffer::Buffer(const fs::path& path, bool use_direct_io): _file{path, use_direct_io} {
+    Start();
+}
+
+Kora::AsyncWritableFile::Buffer::Buffer(const fs::path& path, bool use_direct_io, uint64_t offset): _file{path, use_direct_io, offset} {
+    Start();
+}
+
+void Kora::AsyncWritableFile::Buffer::Start() {
+    if (!_file.is_open()) return;
+    _current.resize(_BUFFER_SIZE);
+    setp(&_current[0], &_current[0] + _current.size());
+    _free.Push(std::string(_BUFFER_SIZE, '\0'));
+    _thread = std::thread([this] { Run(); });
+}
+
+void Kora::AsyncWritableFile::Buffer::Run() {
+    std::string buffer;
+    while (_full.Pop(buffer)) {
+        uint64_t start = nowMicros();
+        _file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        _busy_micros.fetch_add(nowMicros() - start, std::memory_order_relaxed);
+        _free.Push(std::move(buffer));
+    }
+}
+
+bool Kora::AsyncWritableFile::Buffer::Hand() {
+    _current.resize(pptr() - pbase());
+    if (!_full.Push(std::move(_current))) return false;
+    uint64_t start = nowMicros();
+    bool free = _free.Pop(_current);
+    _wait_micros += nowMicros() - start;
+    if (!free) return false;
+    // the writer thread hands back buffers cut to what it wrote
+    _current.resize(_BUFFER_SIZE);
+    setp(&_current[0], &_current[0] + _current.size());
+    return true;
+}
+
+Kora::AsyncWritableFile::Buffer::int_type Kora::AsyncWritableFile::Buffer::overflow(int_type c) {
+    if (!IsOpen() || _failed) return traits_type::eof();
+    if (!Hand()) {
+        _failed = true;
+        return traits_type::eof();
+    }
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+bool Kora::AsyncWritableFile::Buffer::Close() {
+    if (!IsOpen()) return !_failed;
+    if (!_failed && pptr() > pbase()) {
+        _current.resize(pptr() - pbase());
+        if (!_full.Push(std::move(_current))) _failed = true;
+    }
+    setp(nullptr, nullptr);
+    _full.Close();
+    _thread.join();
+    _file.close();
+    if (_file.fail()) _failed = true;
+    return !_failed;
+}
+
+namespace {
+    // copy size bytes of in from offset on to the current end of out
+    bool CopyRange(int in, uint64_t offset, uint64_t size, int out) {
+        loff_t in_offset = static_cast<loff_t>(offset);
+        uint64_t copied = 0;
+        while (copied < size) {
+            auto n = ::copy_file_range(in, &in_offset, out, nullptr, std::min<uint64_t>(size - copied, 64 * 1024 * 1024), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            copied += n;
+        }
+        if (copied == size) return true;
+        // filesystems that can't copy between the two files leave it to us
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) return false;
+        std::vector<char> buffer(1024 * 1024);
+        while (copied < size) {
+            auto n = ::pread(in, buffer.data(), std::min<uint64_t>(size - copied, buffer.size()), static_cast<off_t>(offset + copied));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            size_t written = 0;
+            while (written < static_cast<size_t>(n)) {
+                auto w = ::write(out, buffer.data() + written, n - written);
+                if (w < 0 && errno == EINTR) continue;
+                if (w <= 0) return false;
+                written += w;
+            }
+            copied += n;
+        }
+        return true;
+    }
+}
+
+bool Kora::CopyOpenFile(int fd, const fs::path& path) {
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) return false;
+    int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) return false;
+    bool ok = CopyRange(fd, 0, st.st_size, out) && ::fsync(out) == 0;
+    if (::close(out) != 0) ok = false;
+    return ok;
+}
+
+bool Kora::JoinFileRegions(const fs::path& path, std::vector<FileRegion>& regions, uint64_t alignment) {
+    if (regions.empty()) return true;
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd < 0) return false;
+    // the padding direct I/O left after the last region goes first
+    bool ok = ::ftruncate(fd, static_cast<off_t>(regions.back().end)) == 0;
+    // the gaps are cut out from the last one down, so that the ones in front stay where they are
+    std::vector<uint64_t> cut(regions.size(), 0);
+    for (size_t i = regions.size() - 1; ok && i-- > 0;) {
+        uint64_t end = regions[i].end, next = regions[i + 1].start;
+        uint64_t cut_start = (end + PADDING_HEADER_SIZE + alignment - 1) / alignment * alignment;
+#ifdef FALLOC_FL_COLLAPSE_RANGE
+        if (next > cut_start && ::fallocate(fd, FALLOC_FL_COLLAPSE_RANGE, static_cast<off_t>(cut_start),
+                                            static_cast<off_t>(next - cut_start)) == 0) {
+            cut[i + 1] = next - cut_start;
+            next = cut_start;
+        }
+#endif
+        size_t header[2] = {PADDING_RECORD, next - end - PADDING_HEADER_SIZE};
+        ok = ::pwrite(fd, header, sizeof header, static_cast<off_t>(end)) == static_cast<ssize_t>(sizeof header);
+    }
+    if (::close(fd) != 0) ok = false;
+    // every region moves down by the bytes cut out in front of it
+    uint64_t shift = 0;
+    for (size_t i = 0; i < regions.size(); i++) {
+        shift += cut[i];
+        regions[i].start -= shift;
+        regions[i].end -= shift;
+    }
+    return ok;
+}
@@ -0,0 +1,247 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/direct_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const size_t Kora::DirectFileBuffer::_MIN_READAHEAD;
+
+Kora::DirectFileBuffer::~DirectFileBuffer() {
+    Close();
+}
+
+bool Kora::DirectFileBuffer::OpenForWrite(const fs::path& path, bool direct) {
+    _writing = true;
+    _truncate = true;
+    if (!Open(path, O_WRONLY | O_CREAT | O_TRUNC, direct, _BUFFER_SIZE)) return false;
+    setp(_buffer, _buffer + _capacity);
+    return true;
+}
+
+bool Kora::DirectFileBuffer::OpenForWriteAt(const fs::path& path, bool direct, uint64_t offset) {
+    _writing = true;
+    _truncate = false;
+    if (!Open(path, O_WRONLY | O_CREAT, direct, _BUFFER_SIZE)) return false;
+    _file_offset = offset;
+    setp(_buffer, _buffer + _capacity);
+    return true;
+}
+
+bool Kora::DirectFileBuffer::OpenForRead(const fs::path& path, bool direct, size_t readahead, bool auto_readahead) {
+    _writing = false;
+    _max_window = std::max(readahead, _MIN_READAHEAD);
+    _auto_readahead = auto_readahead;
+    _window = auto_readahead ? _MIN_READAHEAD : _max_window;
+    _sequential = false;
+    _bytes_read = 0;
+    if (!Open(path, O_RDONLY, direct, _window)) return false;
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (!_direct) ::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    setg(_buffer, _buffer, _buffer);
+    return true;
+}
+
+bool Kora::DirectFileBuffer::Open(const fs::path& path, int flags, bool direct, size_t capacity) {
+    _fd = -1;
+#ifdef O_DIRECT
+    if (direct) {
+        _fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        // EINVAL is how a filesystem without O_DIRECT support says no
+        if (_fd < 0 && errno != EINVAL) return false;
+    }
+#endif
+    _direct = _fd >= 0;
+    if (_fd < 0) _fd = ::open(path.c_str(), flags, 0644);
+    if (_fd < 0) return false;
+
+    struct stat st{};
+    if (::fstat(_fd, &st) == 0 && st.st_blksize > 0) _alignment = std::max<size_t>(st.st_blksize, 512);
+    if (!Reserve(capacity)) {
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    _file_offset = 0;
+    _failed = false;
+    return true;
+}
+
+bool Kora::DirectFileBuffer::Reserve(size_t size) {
+    size = (size + _alignment - 1) / _alignment * _alignment;
+    if (_buffer && size <= _capacity) return true;
+    void* buffer = nullptr;
+    if (::posix_memalign(&buffer, _alignment, size) != 0) return false;
+    std::free(_buffer);
+    _buffer = static_cast<char*>(buffer);
+    _capacity = size;
+    return true;
+}
+
+bool Kora::DirectFileBuffer::Close() {
+    if (_fd < 0) return !_failed;
+    if (_writing && !_failed) {
+        size_t size = pptr() - pbase();
+        // the last transfer is padded to a whole block, and the padding cut off again once it is on disk
+        size_t padded = _direct ? (size + _alignment - 1) / _alignment * _alignment : size;
+        std::memset(pbase() + size, 0, padded - size);
+        if (!Write(padded) || (padded != size && _truncate && ::ftruncate(_fd, static_cast<off_t>(_file_offset + size)) != 0)) {
+            _failed = true;
+        }
+        setp(nullptr, nullptr);
+    }
+    if (::close(_fd) != 0 && _writing) _failed = true;
+    _fd = -1;
+    std::free(_buffer);
+    _buffer = nullptr;
+    _capacity = 0;
+    setg(nullptr, nullptr, nullptr);
+    return !_failed;
+}
+
+bool Kora::DirectFileBuffer::DropDirectIO() {
+#ifdef O_DIRECT
+    int flags = ::fcntl(_fd, F_GETFL);
+    if (flags < 0 || ::fcntl(_fd, F_SETFL, flags & ~O_DIRECT) != 0) return false;
+#endif
+    _direct = false;
+    return true;
+}
+
+bool Kora::DirectFileBuffer::Write(size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        auto n = ::pwrite(_fd, _buffer + done, size - done, static_cast<off_t>(_file_offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL && _direct && DropDirectIO()) continue;
+        if (n <= 0) {
+            _failed = true;
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+Kora::DirectFileBuffer::int_type Kora::DirectFileBuffer::overflow(int_type c) {
+    if (_fd < 0 || !_writing || _failed) return traits_type::eof();
+    // only whole buffers are written before the file is closed, so every direct transfer stays aligned
+    size_t size = pptr() - pbase();
+    if (size > 0) {
+        if (!Write(size)) return traits_type::eof();
+        _file_offset += size;
+        setp(_buffer, _buffer + _capacity);
+    }
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+int Kora::DirectFileBuffer::sync() {
+    // a partial buffer can't be written with O_DIRECT, it waits for Close()
+    if (_fd < 0 || !_writing || _direct || pptr() == pbase()) return _failed ? -1 : 0;
+    size_t size = pptr() - pbase();
+    if (!Write(size)) return -1;
+    _file_offset += size;
+    setp(_buffer, _buffer + _capacity);
+    return 0;
+}
+
+bool Kora::DirectFileBuffer::Fill(uint64_t offset) {
+    // a read that follows on from the last one is likely to be followed by more, so read further ahead each time.
+    // What is left in the buffer has been consumed, so it can be replaced
+    if (_sequential && _window < _max_window && Reserve(std::min(_window * 2, _max_window))) _window = std::min(_window * 2, _max_window);
+    uint64_t aligned = _direct ? offset / _alignment * _alignment : offset;
+    size_t size = std::min(_capacity, (_window + (offset - aligned) + _alignment - 1) / _alignment * _alignment);
+    ssize_t n;
+    while (true) {
+        n = ::pread(_fd, _buffer, size, static_cast<off_t>(aligned));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL && _direct && DropDirectIO()) continue;
+        break;
+    }
+    _file_offset = aligned;
+    _sequential = true;
+    if (n <= static_cast<ssize_t>(offset - aligned)) {
+        _file_offset = offset;
+        setg(_buffer, _buffer, _buffer);
+        return false;
+    }
+    _bytes_read += n;
+#ifdef POSIX_FADV_WILLNEED
+    // have the kernel fetch the next window while this one is consumed
+    if (!_direct && static_cast<size_t>(n) == size) ::posix_fadvise(_fd, static_cast<off_t>(aligned + n), static_cast<off_t>(_window), POSIX_FADV_WILLNEED);
+#endif
+    setg(_buffer, _buffer + (offset - aligned), _buffer + n);
+    return true;
+}
+
+Kora::DirectFileBuffer::int_type Kora::DirectFileBuffer::underflow() {
+    if (_fd < 0 || _writing) return traits_type::eof();
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    if (!Fill(_file_offset + (egptr() - eback()))) return traits_type::eof();
+    return traits_type::to_int_type(*gptr());
+}
+
+Kora::DirectFileBuffer::pos_type Kora::DirectFileBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    if (_fd < 0) return pos_type(off_type(-1));
+    if (_writing) {
+        // only telling the position is supported while writing
+        if (dir != std::ios_base::cur || off != 0) return pos_type(off_type(-1));
+        return pos_type(static_cast<off_type>(_file_offset + (pptr() - pbase())));
+    }
+    off_type base = 0;
+    if (dir == std::ios_base::cur) {
+        base = static_cast<off_type>(_file_offset + (gptr() - eback()));
+    } else if (dir == std::ios_base::end) {
+        struct stat st{};
+        if (::fstat(_fd, &st) != 0) return pos_type(off_type(-1));
+        base = st.st_size;
+    }
+    return seekpos(pos_type(base + off), which);
+}
+
+Kora::DirectFileBuffer::pos_type Kora::DirectFileBuffer::seekpos(pos_type pos, std::ios_base::openmode) {
+    off_type target = pos;
+    if (_fd < 0 || _writing || target < 0) return pos_type(off_type(-1));
+    auto offset = static_cast<uint64_t>(target);
+    if (offset >= _file_offset && offset <= _file_offset + (egptr() - eback())) {
+        setg(eback(), eback() + (offset - _file_offset), egptr());
+    } else {
+        // the block holding the target is read when the next byte is asked for
+        _file_offset = offset;
+        setg(_buffer, _buffer, _buffer);
+        _sequential = false;
+        if (_auto_readahead) _window = _MIN_READAHEAD;
+    }
+    return pos;
+}
+
+Kora::DirectWritableFile::DirectWritableFile(const fs::path& path, bool use_direct_io): std::ostream(nullptr) {
+    rdbuf(&_buffer);
+    if (!_buffer.OpenForWrite(path, use_direct_io)) setstate(std::ios::failbit);
+}
+
+Kora::DirectWritableFile::DirectWritableFile(const fs::path& path, bool use_direct_io, uint64_t offset): std::ostream(nullptr) {
+    rdbuf(&_buffer);
+    if (!_buffer.OpenForWriteAt(path, use_direct_io, offset)) setstate(std::ios::failbit);
+}
+
+void Kora::DirectWritableFile::close() {
+    if (is_open() && !_buffer.Close()) setstate(std::ios::badbit);
+}
+
+Kora::SequentialFileReader::SequentialFileReader(const fs::path& path, size_t readahead_size, bool use_direct_io, bool auto_readahead):
+        std::istream(nullptr) {
+    rdbuf(&_buffer);
+    if (!_buffer.OpenForRead(path, use_direct_io, readahead_size, auto_readahead)) setstate(std::ios::failbit);
+}
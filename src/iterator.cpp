@@ -0,0 +1,138 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/iterator.h"
+
+#include <algorithm>
+
+Kora::MemtableIterator::MemtableIterator(std::vector<std::pair<std::string, std::string>>&& entries, std::shared_ptr<MemoryManager> memory):
+        _entries{std::move(entries)}, _pos{_entries.size()} {
+    if (!memory) return;
+    size_t bytes = _entries.capacity() * sizeof(_entries[0]);
+    for (const auto& [key, value]: _entries) bytes += key.capacity() + value.capacity();
+    _reservation = MemoryReservation(std::move(memory), MemoryKind::_ITERATOR, bytes);
+}
+
+void Kora::MemtableIterator::Seek(const std::string& target) {
+    _pos = std::lower_bound(_entries.begin(), _entries.end(), target,
+                            [](const std::pair<std::string, std::string>& entry, const std::string& key) {
+                                return entry.first < key;
+                            }) - _entries.begin();
+}
+
+Kora::SegmentIterator::SegmentIterator(const std::string& filepath, size_t data_offset, std::shared_ptr<const SegmentIndex> index,
+                                       std::shared_ptr<MemoryManager> memory, size_t readahead_size):
+        _filepath{filepath}, _data_offset{data_offset}, _index{std::move(index)}, _data_end{_index ? _index->DataEnd() : SIZE_MAX},
+        _file{filepath, readahead_size, false, true}, _memory{std::move(memory)} {
+    if (!_file.is_open()) _status = Status::IoError("Unable to open segment " + filepath);
+    else ChargeBuffer();
+}
+
+void Kora::SegmentIterator::ChargeBuffer() {
+    if (!_memory || _charged_buffer == _file.BufferSize()) return;
+    // the file buffer. The current key and value are left out, for most records they are small next to it
+    _charged_buffer = _file.BufferSize();
+    _reservation = MemoryReservation(_memory, MemoryKind::_ITERATOR, sizeof(*this) + _charged_buffer);
+}
+
+void Kora::SegmentIterator::SeekToFirst() {
+    _valid = false;
+    if (!_file.is_open()) return;
+    _file.clear();
+    _pos = _data_offset;
+    _file.seekg(_pos);
+    Next();
+}
+
+void Kora::SegmentIterator::Seek(const std::string& target) {
+    _valid = false;
+    if (!_file.is_open()) return;
+    _file.clear();
+    // start at the block target would be in and skip the smaller keys in front of it
+    _pos = _index ? _index->SeekOffset(target) : _data_offset;
+    _file.seekg(_pos);
+    Next();
+    while (_valid && _key < target) Next();
+}
+
+void Kora::SegmentIterator::Next() {
+    size_t key_size = 0, value_size = 0;
+    if (_pos >= _data_end) {
+        _valid = false;
+        return;
+    }
+    _valid = _file.read(reinterpret_cast<char*>(&key_size), sizeof key_size) &&
+             _file.read(reinterpret_cast<char*>(&value_size), sizeof value_size);
+    if (!_valid) return;
+    if (key_size == PADDING_RECORD) {
+        _pos += sizeof key_size + sizeof value_size + value_size;
+        _file.seekg(static_cast<std::streamoff>(_pos));
+        Next();
+        return;
+    }
+    _key.resize(key_size);
+    _value.resize(value_size);
+    _valid = _file.read(&_key[0], key_size) && _file.read(&_value[0], value_size);
+    _pos += sizeof key_size + sizeof value_size + key_size + value_size;
+    if (!_valid) _status = Status::IoError("Truncated record in segment " + _filepath);
+    ChargeBuffer();
+}
+
+Kora::MergingIterator::MergingIterator(std::vector<std::unique_ptr<Iterator>>&& children,
+                                       Resolver resolver): _children{std::move(children)}, _resolver{std::move(resolver)} {}
+
+void Kora::MergingIterator::SeekToFirst() {
+    for (auto& child: _children) child->SeekToFirst();
+    FindSmallest();
+    Resolve();
+}
+
+void Kora::MergingIterator::Seek(const std::string& target) {
+    for (auto& child: _children) child->Seek(target);
+    FindSmallest();
+    Resolve();
+}
+
+void Kora::MergingIterator::Next() {
+    Advance();
+    Resolve();
+}
+
+Kora::Status Kora::MergingIterator::status() const {
+    for (const auto& child: _children) {
+        auto s = child->status();
+        if (s.code() != Code::_OK) return s;
+    }
+    return {};
+}
+
+void Kora::MergingIterator::FindSmallest() {
+    _current = nullptr;
+    for (auto& child: _children) {
+        if (!child->Valid()) continue;
+        if (_current == nullptr || child->key() < _current->key()) _current = child.get();
+    }
+}
+
+void Kora::MergingIterator::Advance() {
+    // older children may hold the same key, their entries are hidden by the one just returned
+    std::string key = _current->key();
+    for (auto& child: _children) {
+        if (child->Valid() && child->key() == key) child->Next();
+    }
+    FindSmallest();
+}
+
+void Kora::MergingIterator::Resolve() {
+    if (!_resolver) return;
+    while (_current != nullptr) {
+        // children holding the current key sit at it together
+        _versions.clear();
+        for (auto& child: _children) {
+            _versions.push_back(child->Valid() && child->key() == _current->key() ? &child->value() : nullptr);
+        }
+        if (_resolver(_current->key(), _versions, _value)) return;
+        Advance();
+    }
+}
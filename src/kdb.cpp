@@ -5,14 +5,339 @@
 #include <utility>
 
 #include "../include/kdb.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <set>
+#include <unistd.h>
+
+void Kora::DB::Open() {
+    fs::path db_path(_filename);
+    createDir(fs::path(db_path));
+
+    // the number of shards is fixed when the database is created
+    int num_shards = 1;
+    auto shards_path = db_path / "SHARDS";
+    if (fs::exists(shards_path)) {
+        std::ifstream shards_file(shards_path);
+        shards_file >> num_shards;
+        if (num_shards < 1) num_shards = 1;
+    } else if (_dbOptions.num_shards > 1) {
+        if (sstableCount(db_path) > 0 || hasLogFile(db_path)) {
+            std::cout << "Database " << _filename << " was created without shards, opening it unsharded\n";
+        } else {
+            num_shards = _dbOptions.num_shards;
+            std::ofstream shards_file(shards_path);
+            shards_file << num_shards << "\n";
+        }
+    }
+
+    // the shards share one block cache and one memory manager, so the cache capacity and the memory budget bound the
+    // whole database
+    if (!_dbOptions.block_cache) _dbOptions.block_cache = std::make_shared<BlockCache>();
+    if (!_dbOptions.memory_manager) _dbOptions.memory_manager = std::make_shared<MemoryManager>(_dbOptions.memory_budget);
+
+    if (num_shards == 1) {
+        _shards.push_back(std::make_unique<StorageEngine>(db_path, _dbOptions));
+        return;
+    }
+
+    std::set<uint64_t> committed_batches;
+    {
+        std::ifstream commit_log(CommitLogPath(), std::ios::binary);
+        uint64_t batch_id = 0;
+        while (commit_log.read(reinterpret_cast<char*>(&batch_id), sizeof batch_id)) committed_batches.insert(batch_id);
+    }
+    for (int i = 0; i < num_shards; i++) {
+        _shards.push_back(std::make_unique<StorageEngine>(db_path / ("shard_" + std::to_string(i)), _dbOptions, committed_batches));
+    }
+    // every shard has rewritten its log files without batch records by now, so the commit records can go
+    _commit_log_fd = ::open(CommitLogPath().c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (_commit_log_fd < 0) std::cout << "Unable to open commit log " << CommitLogPath() << "\n";
+
+    // let the shards flush in parallel, as far as there are cores for it
+    int flush_threads = std::min<int>(num_shards, std::max(1u, std::thread::hardware_concurrency()));
+    ThreadPool::Default(JobPriority::_HIGH).EnsureBackgroundThreads(flush_threads);
+}
+
+Kora::DB::~DB() {
+    if (_commit_log_fd >= 0) ::close(_commit_log_fd);
+}
+
 Kora::Status Kora::DB::Set(std::string key, std::string value) {
-    return _storage_engine.Set(Data(std::move(key)), Data(std::move(value)));
+    return Set(WriteOptions(), std::move(key), std::move(value));
+}
+
+Kora::Status Kora::DB::Set(const WriteOptions& options, std::string key, std::string value) {
+    auto trace = TraceOperation();
+    if (!trace) return Shard(key).Set(Data(std::move(key)), Data(std::move(value)), false, options);
+    // the operation is recorded in the order the shard applied it in
+    uint64_t sequence = TraceWriter::_NO_SEQUENCE;
+    auto status = Shard(key).Set(Data(key), Data(value), false, options, &sequence);
+    trace.Set(sequence, key, value, options.sync);
+    return status;
 }
 
 Kora::Result Kora::DB::Get(std::string key) {
-    return _storage_engine.Get(Data(key));
+    auto trace = TraceOperation();
+    uint64_t sequence = TraceWriter::_NO_SEQUENCE;
+    auto result = Shard(key).Get(Data(key), trace ? &sequence : nullptr);
+    trace.Get(sequence, key);
+    return result;
 }
 
 Kora::Status Kora::DB::Delete(std::string key) {
-    return _storage_engine.Delete(Data(key));
-}
\ No newline at end of file
+    return Delete(WriteOptions(), std::move(key));
+}
+
+Kora::Status Kora::DB::Delete(const WriteOptions& options, std::string key) {
+    auto trace = TraceOperation();
+    uint64_t sequence = TraceWriter::_NO_SEQUENCE;
+    auto status = Shard(key).Delete(Data(key), options, trace ? &sequence : nullptr);
+    trace.Delete(sequence, key, options.sync);
+    return status;
+}
+
+Kora::Status Kora::DB::DeleteRange(std::string begin, std::string end) {
+    return DeleteRange(WriteOptions(), std::move(begin), std::move(end));
+}
+
+Kora::Status Kora::DB::DeleteRange(const WriteOptions& options, std::string begin, std::string end) {
+    WriteBatch batch;
+    batch.DeleteRange(std::move(begin), std::move(end));
+    return Write(options, batch);
+}
+
+Kora::Status Kora::DB::Merge(std::string key, std::string operand) {
+    return Merge(WriteOptions(), std::move(key), std::move(operand));
+}
+
+Kora::Status Kora::DB::Merge(const WriteOptions& options, std::string key, std::string operand) {
+    WriteBatch batch;
+    batch.Merge(std::move(key), std::move(operand));
+    return Write(options, batch);
+}
+
+Kora::Status Kora::DB::Write(const WriteBatch& batch) {
+    return Write(WriteOptions(), batch);
+}
+
+Kora::Status Kora::DB::Write(const WriteOptions& options, const WriteBatch& batch) {
+    auto trace = TraceOperation();
+    uint64_t sequence = TraceWriter::_NO_SEQUENCE;
+    auto status = WriteToShards(options, batch, trace ? &sequence : nullptr);
+    trace.Write(sequence, batch, options.sync);
+    return status;
+}
+
+Kora::Status Kora::DB::WriteToShards(const WriteOptions& options, const WriteBatch& batch, uint64_t* trace_sequence) {
+    if (!_dbOptions.merge_operator) {
+        for (const auto& op: batch.Ops()) {
+            if (op.type == WriteBatch::OpType::_MERGE) return Status::InvalidArgument("Merge requires Options::merge_operator");
+        }
+    }
+    if (_shards.size() == 1) return _shards[0]->Write(batch, options, trace_sequence);
+
+    // split the batch by shard, keeping the order of the updates within each shard
+    std::map<size_t, WriteBatch> parts;
+    for (const auto& op: batch.Ops()) {
+        if (op.type == WriteBatch::OpType::_DELETE_RANGE) {
+            // keys are spread by hash, so any shard may hold keys in the range
+            for (size_t shard = 0; shard < _shards.size(); shard++) parts[shard].DeleteRange(op.key, op.value);
+            continue;
+        }
+        auto& part = parts[hashKey(op.key.data(), op.key.size()) % _shards.size()];
+        if (op.type == WriteBatch::OpType::_DELETE) part.Delete(op.key);
+        else if (op.type == WriteBatch::OpType::_MERGE) part.Merge(op.key, op.value);
+        else part.Set(op.key, op.value);
+    }
+    if (parts.empty()) return {};
+    // a batch that lands on one shard is atomic on its own
+    if (parts.size() == 1) return _shards[parts.begin()->first]->Write(parts.begin()->second, options, trace_sequence);
+
+    for (auto& [shard, part]: parts) _shards[shard]->DelayWrite(part.ByteSize());
+    Status status;
+    {
+        std::lock_guard<std::mutex> lg(_batch_mutex);
+        uint64_t batch_id = ++_batch_number;
+        // lock every shard involved, always in shard order, so that no reader sees part of the batch
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (auto& [shard, part]: parts) locks.push_back(_shards[shard]->LockForBatch());
+        for (auto& [shard, part]: parts) _shards[shard]->LogBatch(part, batch_id, options.sync);
+
+        // the batch is committed once its id is in the commit log, and only then do readers see it. The parts of a
+        // batch that couldn't be committed stay out of the memtables, and recovery drops them from the log files
+        status = CommitBatch(batch_id, options.sync);
+        if (trace_sequence) *trace_sequence = TraceWriter::NextSequence();
+        if (status.isOk()) {
+            for (auto& [shard, part]: parts) _shards[shard]->InsertBatch(part);
+        }
+        locks.clear();
+        TrimCommitLog();
+    }
+    for (auto& [shard, part]: parts) _shards[shard]->MaybeSwitchMemtable();
+    return status;
+}
+
+Kora::Status Kora::DB::CommitBatch(uint64_t batch_id, bool sync) {
+    ssize_t written = _commit_log_fd < 0 ? -1 : ::write(_commit_log_fd, &batch_id, sizeof batch_id);
+    if (written == static_cast<ssize_t>(sizeof batch_id) && (!sync || ::fdatasync(_commit_log_fd) == 0)) {
+        _commit_log_ids++;
+        return {};
+    }
+    // part of an id would shift every id after it, and an id that may not be on disk must not commit the batch
+    if (written > 0 && ::ftruncate(_commit_log_fd, static_cast<off_t>(_commit_log_ids * sizeof batch_id)) != 0) {
+        std::cout << "Unable to cut back commit log " << CommitLogPath() << "\n";
+    }
+    return Status::IoError("Unable to commit batch to " + CommitLogPath().string());
+}
+
+void Kora::DB::TrimCommitLog() {
+    if (_commit_log_fd < 0 || _commit_log_ids < _commit_log_trim_at) return;
+    _commit_log_trim_at = _commit_log_ids + _COMMIT_LOG_TRIM_IDS;
+    uint64_t oldest = 0;
+    for (auto& shard: _shards) {
+        uint64_t batch_id = shard->OldestLoggedBatch();
+        if (batch_id != 0 && (oldest == 0 || batch_id < oldest)) oldest = batch_id;
+    }
+    // ids are committed in increasing order, so the ones still needed are the end of the log
+    std::vector<uint64_t> ids(_commit_log_ids);
+    auto bytes = static_cast<ssize_t>(ids.size() * sizeof(uint64_t));
+    if (::pread(_commit_log_fd, ids.data(), bytes, 0) != bytes) return;
+    auto first_kept = oldest == 0 ? ids.end() : std::lower_bound(ids.begin(), ids.end(), oldest);
+    if (first_kept == ids.end()) {
+        if (::ftruncate(_commit_log_fd, 0) == 0) _commit_log_ids = 0;
+        _commit_log_trim_at = _COMMIT_LOG_TRIM_IDS;
+        return;
+    }
+    if (first_kept - ids.begin() < static_cast<ptrdiff_t>(ids.size() / 2)) {
+        for (auto& shard: _shards) shard->SealBatchesBefore(ids[ids.size() / 2]);
+        return;
+    }
+    // the ids still needed go into a new commit log that replaces the old one in one step
+    auto temp_path = CommitLogPath().string() + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return;
+    auto kept_bytes = static_cast<ssize_t>((ids.end() - first_kept) * sizeof(uint64_t));
+    if (::write(fd, &*first_kept, kept_bytes) != kept_bytes || ::fsync(fd) != 0 ||
+        ::rename(temp_path.c_str(), CommitLogPath().c_str()) != 0) {
+        ::close(fd);
+        ::unlink(temp_path.c_str());
+        return;
+    }
+    ::close(_commit_log_fd);
+    _commit_log_fd = fd;
+    _commit_log_ids = ids.end() - first_kept;
+    _commit_log_trim_at = _commit_log_ids + _COMMIT_LOG_TRIM_IDS;
+}
+
+std::unique_ptr<Kora::Iterator> Kora::DB::NewIterator() {
+    return NewIterator(ReadOptions());
+}
+
+std::unique_ptr<Kora::Iterator> Kora::DB::NewIterator(const ReadOptions& options) {
+    if (_shards.size() == 1) return _shards[0]->NewIterator(options);
+    // no batch spanning several shards can be half applied while the shard snapshots are taken
+    std::lock_guard<std::mutex> lg(_batch_mutex);
+    std::vector<std::unique_ptr<Iterator>> children;
+    for (auto& shard: _shards) children.push_back(shard->NewIterator(options));
+    // shards hold disjoint keys, so there is nothing to hide
+    return std::make_unique<MergingIterator>(std::move(children));
+}
+
+Kora::Result Kora::DB::GetProperty(const std::string& property) {
+    // the shards share their memory manager
+    if (_shards.size() == 1 || property == "kora.memory-usage") return _shards[0]->GetProperty(property);
+    uint64_t sum = 0;
+    bool numeric = true;
+    std::string per_shard;
+    for (size_t i = 0; i < _shards.size(); i++) {
+        auto result = _shards[i]->GetProperty(property);
+        if (!result.status().isOk()) return result;
+        auto value = result.data();
+        if (numeric && !value.empty() && std::all_of(value.begin(), value.end(), ::isdigit)) sum += std::stoull(value);
+        else numeric = false;
+        per_shard += "** Shard " + std::to_string(i) + " **\n" + value + "\n";
+    }
+    return Result(Kora::Status::OK(), numeric ? std::to_string(sum) : std::move(per_shard));
+}
+Kora::Status Kora::DB::CreateCheckpoint(const std::string& checkpoint_dir) {
+    fs::path dir(checkpoint_dir);
+    std::error_code ec;
+    if (fs::exists(dir, ec)) return Status::InvalidArgument("Checkpoint directory " + checkpoint_dir + " already exists");
+    // the checkpoint is built under a temporary name and renamed once complete, so a checkpoint cut short is never
+    // mistaken for a whole one
+    fs::path temp_dir(checkpoint_dir + ".tmp");
+    fs::remove_all(temp_dir, ec);
+    if (!fs::create_directories(temp_dir, ec)) return Status::IoError("Unable to create checkpoint directory " + temp_dir.string());
+
+    std::vector<std::string> files;
+    Status status;
+    if (_shards.size() == 1) {
+        status = _shards[0]->CreateCheckpoint(temp_dir, files);
+    } else {
+        // no batch spanning several shards is half applied or half committed while the shards are checkpointed
+        std::lock_guard<std::mutex> lg(_batch_mutex);
+        fs::path db_path(_filename);
+        for (const auto& name: {"SHARDS", "COMMIT"}) {
+            if (!fs::exists(db_path / name)) continue;
+            if (!fs::copy_file(db_path / name, temp_dir / name, ec)) {
+                status = Status::IoError("Unable to copy " + (db_path / name).string() + " into checkpoint");
+                break;
+            }
+            StorageEngine::SyncFile(temp_dir / name);
+            files.emplace_back(name);
+        }
+        for (size_t i = 0; i < _shards.size() && status.isOk(); i++) {
+            auto shard = "shard_" + std::to_string(i);
+            std::vector<std::string> shard_files;
+            if (!fs::create_directories(temp_dir / shard, ec)) {
+                status = Status::IoError("Unable to create checkpoint directory " + (temp_dir / shard).string());
+                break;
+            }
+            status = _shards[i]->CreateCheckpoint(temp_dir / shard, shard_files);
+            for (const auto& file: shard_files) files.push_back(shard + "/" + file);
+        }
+    }
+    if (!status.isOk()) {
+        fs::remove_all(temp_dir, ec);
+        return status;
+    }
+
+    {
+        std::ofstream manifest(temp_dir / "MANIFEST", std::ios::trunc);
+        for (const auto& file: files) manifest << file << " " << fs::file_size(temp_dir / file, ec) << "\n";
+        manifest.close();
+        if (manifest.fail()) status = Status::IoError("Unable to write the manifest of checkpoint " + checkpoint_dir);
+    }
+    if (status.isOk()) {
+        StorageEngine::SyncFile(temp_dir / "MANIFEST");
+        fs::rename(temp_dir, dir, ec);
+        if (ec) status = Status::IoError("Unable to rename checkpoint " + temp_dir.string() + " to " + checkpoint_dir);
+    }
+    if (!status.isOk()) fs::remove_all(temp_dir, ec);
+    return status;
+}
+
+Kora::Status Kora::DB::StartTrace(const std::string& trace_path, const TraceOptions& options) {
+    std::lock_guard<std::mutex> lg(_trace_mutex);
+    if (_tracer) return Status::InvalidArgument("A trace is already running");
+    auto tracer = std::make_shared<TraceWriter>(trace_path, options);
+    if (!tracer->is_open()) return Status::IoError("Unable to create trace file " + trace_path);
+    std::atomic_store(&_tracer, std::move(tracer));
+    _tracing = true;
+    return {};
+}
+
+Kora::Status Kora::DB::EndTrace() {
+    std::lock_guard<std::mutex> lg(_trace_mutex);
+    if (!_tracer) return Status::InvalidArgument("No trace is running");
+    _tracing = false;
+    auto tracer = std::atomic_exchange(&_tracer, std::shared_ptr<TraceWriter>());
+    // operations that loaded the trace before it was taken away are still recorded, those that start now aren't
+    return tracer->Close();
+}
@@ -0,0 +1,164 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/log_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+const char Kora::LogWriter::_MAGIC[8] = {'k', 'o', 'r', 'a', 'w', 'a', 'l', '1'};
+const size_t Kora::LogWriter::_RECORD_HEADER_SIZE;
+const size_t Kora::LogWriter::_PREALLOCATE_SIZE;
+
+namespace {
+    struct Crc32cTable {
+        uint32_t entries[256];
+
+        Crc32cTable() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+                entries[i] = crc;
+            }
+        }
+    };
+
+    bool WriteFully(int fd, const char* data, size_t size, uint64_t offset) {
+        size_t done = 0;
+        while (done < size) {
+            auto n = ::pwrite(fd, data + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += n;
+        }
+        return true;
+    }
+}
+
+uint32_t Kora::Crc32c(const char* data, size_t size, uint32_t crc) {
+    static const Crc32cTable table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table.entries[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+std::shared_ptr<Kora::LogWriter> Kora::LogWriter::Open(const fs::path& path, uint64_t number) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return nullptr;
+    std::shared_ptr<LogWriter> log(new LogWriter(fd, path, number));
+    // a recycled file is already allocated up to its size
+    struct stat st{};
+    if (::fstat(fd, &st) == 0) log->_allocated = st.st_size;
+    if (!WriteFully(fd, _MAGIC, sizeof _MAGIC, 0)) return nullptr;
+    return log;
+}
+
+Kora::LogWriter::~LogWriter() {
+    ::close(_fd);
+}
+
+bool Kora::LogWriter::AddRecord(const char* key, size_t key_size, const char* value, size_t value_size) {
+    std::string record(_RECORD_HEADER_SIZE, '\0');
+    record.reserve(_RECORD_HEADER_SIZE + sizeof key_size + sizeof value_size + key_size + value_size);
+    std::memcpy(&record[sizeof(uint32_t)], &_number, sizeof _number);
+    record.append(reinterpret_cast<const char*>(&key_size), sizeof key_size);
+    record.append(reinterpret_cast<const char*>(&value_size), sizeof value_size);
+    record.append(key, key_size);
+    record.append(value, value_size);
+    uint32_t crc = Crc32c(record.data() + sizeof(uint32_t), record.size() - sizeof(uint32_t));
+    std::memcpy(&record[0], &crc, sizeof crc);
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        if (_offset + record.size() > _allocated) {
+            // allocating ahead keeps appends from changing the file size, which a synced append would pay for.
+            // Filesystems without fallocate() grow the file as it is written instead
+            uint64_t allocate = std::max<uint64_t>(_PREALLOCATE_SIZE, record.size());
+#ifdef __linux__
+            if (::fallocate(_fd, 0, static_cast<off_t>(_allocated), static_cast<off_t>(allocate)) == 0) _allocated += allocate;
+#else
+            if (::posix_fallocate(_fd, static_cast<off_t>(_allocated), static_cast<off_t>(allocate)) == 0) _allocated += allocate;
+#endif
+        }
+        // one write per record, so records appended by concurrent writers never interleave
+        if (!WriteFully(_fd, record.data(), record.size(), _offset)) return false;
+        _offset += record.size();
+    }
+    return true;
+}
+
+bool Kora::LogWriter::Sync() {
+    return ::fdatasync(_fd) == 0;
+}
+
+uint64_t Kora::LogWriter::Size() {
+    std::lock_guard<std::mutex> lg(_mutex);
+    return _offset;
+}
+
+bool Kora::LogWriter::CopyTo(const fs::path& path) {
+    uint64_t size = Size();
+    int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) return false;
+    std::vector<char> buffer(1024 * 1024);
+    uint64_t copied = 0;
+    while (copied < size) {
+        auto n = ::pread(_fd, buffer.data(), std::min<uint64_t>(buffer.size(), size - copied), static_cast<off_t>(copied));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || !WriteFully(out, buffer.data(), n, copied)) break;
+        copied += n;
+    }
+    bool ok = copied == size && ::fsync(out) == 0;
+    if (::close(out) != 0) ok = false;
+    return ok;
+}
+
+Kora::LogReader::LogReader(const fs::path& path, uint64_t number, size_t readahead_size): _file{path, readahead_size}, _number{number} {
+    std::error_code ec;
+    _remaining = fs::file_size(path, ec);
+    if (ec) _remaining = 0;
+    char magic[sizeof LogWriter::_MAGIC];
+    if (_remaining >= sizeof magic && _file.read(magic, sizeof magic) && std::memcmp(magic, LogWriter::_MAGIC, sizeof magic) == 0) {
+        _checksummed = true;
+        _remaining -= sizeof magic;
+        return;
+    }
+    _file.clear();
+    _file.seekg(0);
+}
+
+bool Kora::LogReader::ReadRecord(std::string& key, std::string& value) {
+    uint32_t crc = 0;
+    uint64_t number = 0;
+    if (_checksummed) {
+        if (_remaining < LogWriter::_RECORD_HEADER_SIZE || !_file.read(reinterpret_cast<char*>(&crc), sizeof crc) ||
+            !_file.read(reinterpret_cast<char*>(&number), sizeof number) || number != _number) {
+            return false;
+        }
+        _remaining -= LogWriter::_RECORD_HEADER_SIZE;
+    }
+    size_t key_size = 0, value_size = 0;
+    if (_remaining < sizeof key_size + sizeof value_size || !_file.read(reinterpret_cast<char*>(&key_size), sizeof key_size) ||
+        !_file.read(reinterpret_cast<char*>(&value_size), sizeof value_size)) {
+        return false;
+    }
+    _remaining -= sizeof key_size + sizeof value_size;
+    if (key_size > _remaining || value_size > _remaining - key_size) return false;
+    key.resize(key_size);
+    value.resize(value_size);
+    if (!_file.read(&key[0], key_size) || !_file.read(&value[0], value_size)) return false;
+    _remaining -= key_size + value_size;
+    if (!_checksummed) return true;
+
+    uint32_t actual = Crc32c(reinterpret_cast<const char*>(&number), sizeof number);
+    actual = Crc32c(reinterpret_cast<const char*>(&key_size), sizeof key_size, actual);
+    actual = Crc32c(reinterpret_cast<const char*>(&value_size), sizeof value_size, actual);
+    actual = Crc32c(key.data(), key.size(), actual);
+    actual = Crc32c(value.data(), value.size(), actual);
+    return actual == crc;
+}
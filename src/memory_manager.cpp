@@ -0,0 +1,110 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/memory_manager.h"
+
+#include <algorithm>
+#include <sstream>
+
+Kora::MemoryManager::MemoryManager(size_t budget): _budget{budget} {}
+
+void Kora::MemoryManager::Reserve(MemoryKind kind, size_t bytes) {
+    if (bytes == 0) return;
+    _usage[static_cast<uint32_t>(kind)].fetch_add(bytes, std::memory_order_relaxed);
+    size_t reserved = _reserved.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (_budget > 0 && _reserved_step.exchange(reserved / _CACHE_RESIZE_STEP) != reserved / _CACHE_RESIZE_STEP) {
+        UpdateBlockCacheCapacity();
+    }
+}
+
+void Kora::MemoryManager::Release(MemoryKind kind, size_t bytes) {
+    if (bytes == 0) return;
+    _usage[static_cast<uint32_t>(kind)].fetch_sub(bytes, std::memory_order_relaxed);
+    size_t reserved = _reserved.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+    if (_budget > 0 && _reserved_step.exchange(reserved / _CACHE_RESIZE_STEP) != reserved / _CACHE_RESIZE_STEP) {
+        UpdateBlockCacheCapacity();
+    }
+}
+
+void Kora::MemoryManager::Move(MemoryKind from, MemoryKind to, size_t bytes) {
+    _usage[static_cast<uint32_t>(from)].fetch_sub(bytes, std::memory_order_relaxed);
+    _usage[static_cast<uint32_t>(to)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+size_t Kora::MemoryManager::BlockCacheUsage() const {
+    std::lock_guard<std::mutex> lg(_mutex);
+    size_t usage = 0;
+    for (const auto& [cache, capacity]: _caches) usage += cache->Usage();
+    return usage;
+}
+
+bool Kora::MemoryManager::ShouldFlush() const {
+    if (_budget == 0) return false;
+    size_t limit = _budget / 2;
+    size_t active = Usage(MemoryKind::_MEMTABLE);
+    if (active > limit / 8 * 7) return true;
+    // memtables waiting to be flushed only free their memory once they are written out, so the active ones go early
+    // while they are a fair part of the total
+    if (active + Usage(MemoryKind::_IMMUTABLE_MEMTABLE) >= limit && active >= limit / 2) return true;
+    return _reserved.load(std::memory_order_relaxed) >= _budget && active >= limit / 4;
+}
+
+void Kora::MemoryManager::AddBlockCache(const std::shared_ptr<BlockCache>& cache) {
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        for (const auto& added: _caches) {
+            if (added.first == cache) return;
+        }
+        _caches.emplace_back(cache, cache->Capacity());
+    }
+    if (_budget > 0) UpdateBlockCacheCapacity();
+}
+
+void Kora::MemoryManager::UpdateBlockCacheCapacity() {
+    std::lock_guard<std::mutex> lg(_mutex);
+    size_t reserved = _reserved.load(std::memory_order_relaxed);
+    size_t available = _budget > reserved ? _budget - reserved : 0;
+    size_t configured = 0;
+    for (const auto& [cache, capacity]: _caches) configured += capacity;
+    if (configured == 0) return;
+    // the caches share what is left in proportion to the capacity they were given
+    for (const auto& [cache, capacity]: _caches) {
+        double share = static_cast<double>(capacity) / configured;
+        cache->SetCapacity(std::min(capacity, static_cast<size_t>(available * share)));
+    }
+}
+
+std::string Kora::MemoryManager::ToString() const {
+    std::stringstream ss;
+    ss << "budget: " << _budget << "\n";
+    ss << "total: " << TotalUsage() << "\n";
+    ss << "memtables: " << Usage(MemoryKind::_MEMTABLE) << "\n";
+    ss << "immutable memtables: " << Usage(MemoryKind::_IMMUTABLE_MEMTABLE) << "\n";
+    ss << "block cache: " << BlockCacheUsage() << "\n";
+    ss << "pinned index: " << Usage(MemoryKind::_PINNED_INDEX) << "\n";
+    ss << "iterators: " << Usage(MemoryKind::_ITERATOR) << "\n";
+    return ss.str();
+}
+
+Kora::MemoryReservation::MemoryReservation(std::shared_ptr<MemoryManager> manager, MemoryKind kind, size_t bytes):
+        _manager{std::move(manager)}, _kind{kind}, _bytes{bytes} {
+    if (_manager) _manager->Reserve(_kind, _bytes);
+}
+
+Kora::MemoryReservation& Kora::MemoryReservation::operator=(MemoryReservation&& other) noexcept {
+    if (this == &other) return *this;
+    Reset();
+    _manager = std::move(other._manager);
+    _kind = other._kind;
+    _bytes = other._bytes;
+    other._manager = nullptr;
+    other._bytes = 0;
+    return *this;
+}
+
+void Kora::MemoryReservation::Reset() {
+    if (_manager) _manager->Release(_kind, _bytes);
+    _manager = nullptr;
+    _bytes = 0;
+}
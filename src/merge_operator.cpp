@@ -0,0 +1,46 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/merge_operator.h"
+
+#include <cstring>
+
+bool Kora::UInt64AddOperator::FullMerge(const std::string&, const std::string* existing_value,
+                                        const std::vector<std::string>& operands, std::string* new_value) const {
+    uint64_t sum = 0;
+    if (existing_value != nullptr && !Decode(*existing_value, &sum)) return false;
+    for (const auto& operand: operands) {
+        uint64_t addend = 0;
+        if (!Decode(operand, &addend)) return false;
+        sum += addend;
+    }
+    *new_value = Encode(sum);
+    return true;
+}
+
+std::string Kora::UInt64AddOperator::Encode(uint64_t value) {
+    return std::string(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+bool Kora::UInt64AddOperator::Decode(const std::string& value, uint64_t* result) {
+    if (value.size() != sizeof(uint64_t)) return false;
+    std::memcpy(result, value.data(), sizeof(uint64_t));
+    return true;
+}
+
+bool Kora::StringAppendOperator::FullMerge(const std::string&, const std::string* existing_value,
+                                           const std::vector<std::string>& operands, std::string* new_value) const {
+    size_t size = existing_value != nullptr ? existing_value->size() : 0;
+    for (const auto& operand: operands) size += operand.size() + 1;
+    new_value->clear();
+    new_value->reserve(size);
+    bool first = existing_value == nullptr;
+    if (!first) new_value->append(*existing_value);
+    for (const auto& operand: operands) {
+        if (!first) new_value->push_back(_delimiter);
+        first = false;
+        new_value->append(operand);
+    }
+    return true;
+}
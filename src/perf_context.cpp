@@ -0,0 +1,65 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/perf_context.h"
+#include <sstream>
+
+#ifdef KORA_PERF_CONTEXT
+thread_local Kora::PerfContext Kora::perf_context;
+thread_local Kora::PerfLevel Kora::perf_level = Kora::PerfLevel::_DISABLE;
+#else
+namespace {
+    // handed out when the instrumentation is compiled out so that callers can still read (all zero) counters
+    thread_local Kora::PerfContext disabled_perf_context;
+}
+#endif
+
+Kora::PerfContext* Kora::GetPerfContext() {
+#ifdef KORA_PERF_CONTEXT
+    return &perf_context;
+#else
+    return &disabled_perf_context;
+#endif
+}
+
+void Kora::SetPerfLevel(PerfLevel level) {
+#ifdef KORA_PERF_CONTEXT
+    perf_level = level;
+#else
+    (void) level;
+#endif
+}
+
+Kora::PerfLevel Kora::GetPerfLevel() {
+#ifdef KORA_PERF_CONTEXT
+    return perf_level;
+#else
+    return PerfLevel::_DISABLE;
+#endif
+}
+
+void Kora::PerfContext::Reset() {
+    *this = PerfContext();
+}
+
+std::string Kora::PerfContext::ToString(bool exclude_zero_counters) const {
+    std::stringstream ss;
+    auto print = [&](const char* name, uint64_t value) {
+        if (exclude_zero_counters && value == 0) return;
+        ss << name << " = " << value << ", ";
+    };
+    print("mutex_wait_nanos", mutex_wait_nanos);
+    print("memtable_probe_nanos", memtable_probe_nanos);
+    print("segments_probed", segments_probed);
+    print("block_read_count", block_read_count);
+    print("block_read_byte", block_read_byte);
+    print("search_nanos", search_nanos);
+    print("wal_append_nanos", wal_append_nanos);
+    print("wal_sync_nanos", wal_sync_nanos);
+    print("write_stall_nanos", write_stall_nanos);
+    auto result = ss.str();
+    // drop the trailing separator
+    if (result.size() >= 2) result.resize(result.size() - 2);
+    return result;
+}
@@ -0,0 +1,11 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/prefix_extractor.h"
+
+Kora::FixedPrefixExtractor::FixedPrefixExtractor(size_t length):
+        _length{length}, _name{"FixedPrefixExtractor." + std::to_string(length)} {}
+
+Kora::DelimitedPrefixExtractor::DelimitedPrefixExtractor(char delimiter):
+        _delimiter{delimiter}, _name{"DelimitedPrefixExtractor." + std::to_string(static_cast<unsigned char>(delimiter))} {}
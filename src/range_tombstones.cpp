@@ -0,0 +1,79 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/range_tombstones.h"
+
+#include <cstring>
+#include <iterator>
+
+void Kora::RangeTombstones::Add(const std::string& begin, const std::string& end) {
+    if (!(begin < end)) return;
+    std::string merged_begin = begin, merged_end = end;
+    auto it = _ranges.upper_bound(begin);
+    if (it != _ranges.begin()) {
+        auto previous = std::prev(it);
+        if (previous->second >= begin) {
+            merged_begin = previous->first;
+            if (previous->second > merged_end) merged_end = previous->second;
+            it = _ranges.erase(previous);
+        }
+    }
+    while (it != _ranges.end() && it->first <= merged_end) {
+        if (it->second > merged_end) merged_end = it->second;
+        it = _ranges.erase(it);
+    }
+    _ranges.emplace(std::move(merged_begin), std::move(merged_end));
+}
+
+void Kora::RangeTombstones::Add(const RangeTombstones& other) {
+    for (const auto& [begin, end]: other._ranges) Add(begin, end);
+}
+
+bool Kora::RangeTombstones::Covers(std::string_view key) const {
+    // the only range that can hold key is the last one starting at or before it
+    auto it = _ranges.upper_bound(key);
+    if (it == _ranges.begin()) return false;
+    return key < std::prev(it)->second;
+}
+
+std::string Kora::RangeTombstones::Encode() const {
+    std::string encoded;
+    auto append = [&encoded](const std::string& part) {
+        size_t size = part.size();
+        encoded.append(reinterpret_cast<const char*>(&size), sizeof size);
+        encoded.append(part);
+    };
+    size_t count = _ranges.size();
+    encoded.append(reinterpret_cast<const char*>(&count), sizeof count);
+    for (const auto& [begin, end]: _ranges) {
+        append(begin);
+        append(end);
+    }
+    return encoded;
+}
+
+bool Kora::RangeTombstones::Decode(const std::string& encoded) {
+    _ranges.clear();
+    size_t pos = 0;
+    auto read = [&encoded, &pos](std::string& part) {
+        size_t size = 0;
+        if (encoded.size() - pos < sizeof size) return false;
+        std::memcpy(&size, encoded.data() + pos, sizeof size);
+        pos += sizeof size;
+        if (encoded.size() - pos < size) return false;
+        part.assign(encoded, pos, size);
+        pos += size;
+        return true;
+    };
+    size_t count = 0;
+    if (encoded.size() < sizeof count) return false;
+    std::memcpy(&count, encoded.data(), sizeof count);
+    pos = sizeof count;
+    std::string begin, end;
+    for (size_t i = 0; i < count; i++) {
+        if (!read(begin) || !read(end)) return false;
+        Add(begin, end);
+    }
+    return true;
+}
@@ -0,0 +1,652 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/segment_index.h"
+#include "../include/perf_context.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <unistd.h>
+
+namespace {
+    // marks the end of a segment that has an index, and of one whose block entries carry hash indexes
+    const uint64_t SEGMENT_INDEX_MAGIC = 0x6b6f7261696478ull;
+    const uint64_t SEGMENT_INDEX_HASH_MAGIC = 0x6b6f7261696468ull;
+    // hash index buckets hold the offset of a record in its block, or one of these
+    const uint16_t HASH_BUCKET_EMPTY = 0xffff;
+    const uint16_t HASH_BUCKET_COLLISION = 0xfffe;
+    // [top-level index offset][top-level index size][end of the key-value records][magic]
+    const size_t FOOTER_SIZE = 4 * sizeof(uint64_t);
+    // sections of the top-level index after its partition entries, each [type][size][section]
+    const uint64_t LEARNED_INDEX_SECTION = 1;
+    const uint64_t PREFIX_FILTER_SECTION = 2;
+
+    void PutFixed64(std::string& dst, uint64_t value) {
+        dst.append(reinterpret_cast<const char*>(&value), sizeof value);
+    }
+
+    void PutKey(std::string& dst, const std::string& key) {
+        PutFixed64(dst, key.size());
+        dst.append(key);
+    }
+
+    void PutSection(std::string& dst, uint64_t type, const std::string& section) {
+        if (section.empty()) return;
+        PutFixed64(dst, type);
+        PutKey(dst, section);
+    }
+
+    bool GetFixed64(const std::string& src, size_t& pos, uint64_t& value) {
+        if (src.size() - pos < sizeof value) return false;
+        std::memcpy(&value, src.data() + pos, sizeof value);
+        pos += sizeof value;
+        return true;
+    }
+
+    bool GetKey(const std::string& src, size_t& pos, std::string& key) {
+        uint64_t size;
+        if (!GetFixed64(src, pos, size) || src.size() - pos < size) return false;
+        key.assign(src, pos, size);
+        pos += size;
+        return true;
+    }
+
+    bool GetHandle(const std::string& src, size_t& pos, Kora::BlockHandle& handle) {
+        return GetFixed64(src, pos, handle.offset) && GetFixed64(src, pos, handle.size);
+    }
+
+    // the block entries of an index partition with their block offsets moved by shift
+    std::string ShiftBlockOffsets(const std::string& partition, uint64_t shift, bool block_hash) {
+        std::string index, last_key, hash_index;
+        Kora::BlockHandle handle;
+        size_t pos = 0;
+        while (pos < partition.size() && GetKey(partition, pos, last_key) && GetHandle(partition, pos, handle)) {
+            PutKey(index, last_key);
+            PutFixed64(index, handle.offset + shift);
+            PutFixed64(index, handle.size);
+            // hash indexes hold offsets within the block, which stay as they are
+            if (block_hash) {
+                if (!GetKey(partition, pos, hash_index)) break;
+                PutKey(index, hash_index);
+            }
+        }
+        return index;
+    }
+
+    // the 8 bytes of key after its first prefix_size as a big-endian number, missing bytes taken as 0. Keys in order
+    // have their numbers in order
+    uint64_t KeyNumber(const std::string& key, size_t prefix_size) {
+        uint64_t number = 0;
+        for (size_t i = prefix_size; i < prefix_size + sizeof number; i++) {
+            number = number << 8 | (i < key.size() ? static_cast<uint8_t>(key[i]) : 0);
+        }
+        return number;
+    }
+
+    bool ReadFully(int fd, char* dst, size_t size, uint64_t offset) {
+        size_t done = 0;
+        while (done < size) {
+            auto n = ::pread(fd, dst + done, size - done, static_cast<off_t>(offset + done));
+            if (n <= 0) return false;
+            done += n;
+        }
+        return true;
+    }
+}
+
+const std::string Kora::SegmentIndex::_NO_KEY;
+const uint64_t Kora::SegmentIndexBuilder::_MAX_LEARNED_PADDING;
+
+Kora::SegmentIndexBuilder::SegmentIndexBuilder(size_t data_offset, size_t block_size, size_t partition_size, int bloom_bits_per_key,
+                                               double hash_util_ratio, bool learned_index, size_t learned_index_error,
+                                               std::shared_ptr<const PrefixExtractor> prefix_extractor):
+        _data_offset{data_offset}, _block_size{std::max<size_t>(block_size, 1)}, _partition_size{std::max<size_t>(partition_size, 1)},
+        _bloom_bits_per_key{bloom_bits_per_key}, _hash_util_ratio{hash_util_ratio}, _offset{data_offset}, _block{data_offset, 0},
+        _learned_index{learned_index}, _learned_index_error{learned_index_error}, _prefix_extractor{std::move(prefix_extractor)} {}
+
+void Kora::SegmentIndexBuilder::Add(const char* key, size_t key_size, size_t record_size) {
+    _last_key.assign(key, key_size);
+    if (_learned_index && (!_has_keys || key_size != _key_size)) AddKeys(_last_key, key_size);
+    if (_prefix_extractor && _prefix_extractor->InDomain(_last_key)) {
+        auto prefix = _prefix_extractor->Transform(_last_key);
+        if (_prefixes.NumKeys() == 0 || prefix != _last_prefix) {
+            _prefixes.AddKey(prefix);
+            _last_prefix.assign(prefix);
+        }
+    }
+    if (_bloom_bits_per_key > 0) _filter.AddKey(_last_key);
+    if (_hash_util_ratio > 0 && _block.size < HASH_BUCKET_COLLISION) {
+        _block_entries.emplace_back(StableHash(_last_key), static_cast<uint16_t>(_block.size));
+    }
+    _block_records++;
+    _offset += record_size;
+    _block.size += record_size;
+    if (_block.size >= _block_size) FinishBlock();
+}
+
+void Kora::SegmentIndexBuilder::FinishBlock() {
+    if (_block.size == 0) return;
+    // [last key size][last key][block offset][block size]
+    PutKey(_partition, _last_key);
+    PutFixed64(_partition, _block.offset);
+    PutFixed64(_partition, _block.size);
+    // [hash index size][hash index]
+    if (_hash_util_ratio > 0) PutKey(_partition, BuildBlockHashIndex());
+    _block_entries.clear();
+    _block_records = 0;
+    _block = {_offset, 0};
+    if (_partition.size() >= _partition_size) FinishPartition();
+}
+
+std::string Kora::SegmentIndexBuilder::BuildBlockHashIndex() const {
+    // a record starting past the reach of a bucket leaves the block without a hash index
+    if (_block_entries.empty() || _block_entries.size() != _block_records) return "";
+    // one 16 bit bucket per slot, each holding the offset of the only record hashing to it
+    size_t num_buckets = std::max<size_t>(static_cast<size_t>(_block_entries.size() / _hash_util_ratio), 1);
+    std::vector<uint16_t> buckets(num_buckets, HASH_BUCKET_EMPTY);
+    for (const auto& [hash, offset]: _block_entries) {
+        auto& bucket = buckets[hash % num_buckets];
+        bucket = bucket == HASH_BUCKET_EMPTY ? offset : HASH_BUCKET_COLLISION;
+    }
+    return {reinterpret_cast<const char*>(buckets.data()), buckets.size() * sizeof(uint16_t)};
+}
+
+void Kora::SegmentIndexBuilder::AddKeys(const std::string& first_key, size_t key_size) {
+    if (!_learned_index) return;
+    if (!_has_keys) {
+        _has_keys = true;
+        _first_key = first_key;
+        _key_size = key_size;
+    } else if (key_size != _key_size) {
+        _key_size = SIZE_MAX;
+    }
+}
+
+void Kora::SegmentIndexBuilder::FinishPartition() {
+    if (_partition.empty()) return;
+    Partition partition{_last_key, std::move(_partition), _filter.NumKeys() > 0 ? _filter.Finish(_bloom_bits_per_key) : ""};
+    _partitions.push_back(std::move(partition));
+    _partition.clear();
+    _filter.Clear();
+}
+
+void Kora::SegmentIndexBuilder::Append(SegmentIndexBuilder&& part, uint64_t offset) {
+    FinishBlock();
+    FinishPartition();
+    part.FinishBlock();
+    part.FinishPartition();
+    // the blocks of part move up to where its records start
+    for (auto& partition: part._partitions) {
+        partition.index = ShiftBlockOffsets(partition.index, offset, _hash_util_ratio > 0);
+        _partitions.push_back(std::move(partition));
+    }
+    if (!part._partitions.empty()) _last_key = part._last_key;
+    if (part._has_keys) AddKeys(part._first_key, part._key_size);
+    _prefixes.AddKeys(part._prefixes);
+    _offset = offset + part._offset;
+    _block = {_offset, 0};
+}
+
+std::string Kora::SegmentIndexBuilder::BuildLearnedIndex() const {
+    if (!_learned_index || !_has_keys || _key_size == SIZE_MAX || _first_key.size() != _key_size) return "";
+    // every key of the segment lies between the first and the last, and so shares their prefix
+    size_t prefix_size = std::mismatch(_first_key.begin(), _first_key.end(), _last_key.begin(), _last_key.end()).first - _first_key.begin();
+    if (_key_size - prefix_size > sizeof(uint64_t)) return "";
+
+    std::vector<uint64_t> block_keys, block_offsets, partition_blocks;
+    std::string last_key, hash_index;
+    BlockHandle handle;
+    uint64_t end = 0;
+    for (const auto& partition: _partitions) {
+        partition_blocks.push_back(block_keys.size());
+        size_t pos = 0;
+        while (pos < partition.index.size()) {
+            if (!GetKey(partition.index, pos, last_key) || !GetHandle(partition.index, pos, handle) ||
+                (_hash_util_ratio > 0 && !GetKey(partition.index, pos, hash_index))) {
+                return "";
+            }
+            // the blocks have to follow each other, with little padding in between as a block is read up to the
+            // next one, and keys of that size are told apart by their numbers
+            uint64_t number = KeyNumber(last_key, prefix_size);
+            if (!block_keys.empty() && (handle.offset < end || handle.offset - end > _MAX_LEARNED_PADDING ||
+                                        number <= block_keys.back())) {
+                return "";
+            }
+            block_keys.push_back(number);
+            block_offsets.push_back(handle.offset);
+            end = handle.offset + handle.size;
+        }
+    }
+    if (block_keys.empty() || end != _offset) return "";
+
+    // Greedy piecewise linear fit: each model starts at a block and takes the blocks after it for as long as one slope
+    // keeps every one of them within the error bound. [low, high] is the range of slopes that still does
+    struct Model {
+        uint64_t first;
+        uint64_t block;
+        double slope;
+    };
+    std::vector<Model> models;
+    auto error = static_cast<double>(_learned_index_error);
+    size_t first = 0;
+    double low = 0, high = std::numeric_limits<double>::infinity();
+    auto finish_model = [&] {
+        models.push_back({block_keys[first], first, std::isinf(high) ? 0 : (low + high) / 2});
+    };
+    for (size_t i = 1; i < block_keys.size(); i++) {
+        auto dx = static_cast<double>(block_keys[i] - block_keys[first]);
+        auto dy = static_cast<double>(i - first);
+        double new_low = std::max(low, (dy - error) / dx), new_high = std::min(high, (dy + error) / dx);
+        if (new_low <= new_high) {
+            low = new_low;
+            high = new_high;
+            continue;
+        }
+        finish_model();
+        first = i;
+        low = 0;
+        high = std::numeric_limits<double>::infinity();
+    }
+    finish_model();
+
+    // [key size][prefix size][error][number of blocks]([last key number][offset])...
+    // [number of models]([first key number][first block][slope])...([first block of partition])...
+    std::string learned;
+    PutFixed64(learned, _key_size);
+    PutFixed64(learned, prefix_size);
+    PutFixed64(learned, _learned_index_error);
+    PutFixed64(learned, block_keys.size());
+    for (size_t i = 0; i < block_keys.size(); i++) {
+        PutFixed64(learned, block_keys[i]);
+        PutFixed64(learned, block_offsets[i]);
+    }
+    PutFixed64(learned, models.size());
+    for (const auto& model: models) {
+        uint64_t slope;
+        std::memcpy(&slope, &model.slope, sizeof slope);
+        PutFixed64(learned, model.first);
+        PutFixed64(learned, model.block);
+        PutFixed64(learned, slope);
+    }
+    for (auto block: partition_blocks) PutFixed64(learned, block);
+    return learned;
+}
+
+std::string Kora::SegmentIndexBuilder::BuildPrefixFilters() const {
+    if (!_prefix_extractor || _bloom_bits_per_key <= 0) return "";
+    // a segment without keys in the domain of the extractor gets no filter at all, and rules out every prefix
+    std::string filters;
+    PutFixed64(filters, _prefixes.NumKeys() > 0 ? 1 : 0);
+    if (_prefixes.NumKeys() > 0) PutKey(filters, _prefixes.Finish(_bloom_bits_per_key));
+    return filters;
+}
+
+void Kora::SegmentIndexBuilder::Finish(std::ostream& file) {
+    FinishBlock();
+    FinishPartition();
+    if (_partitions.empty() && _data_offset == 0) return;
+
+    // each partition is written with its filter next to it, then the top-level index:
+    // [number of partitions]([last key size][last key][index handle][filter handle])...
+    std::string top_level;
+    PutFixed64(top_level, _partitions.size());
+    uint64_t offset = _offset;
+    for (const auto& partition: _partitions) {
+        file.write(partition.index.data(), static_cast<std::streamsize>(partition.index.size()));
+        file.write(partition.filter.data(), static_cast<std::streamsize>(partition.filter.size()));
+        PutKey(top_level, partition.last_key);
+        PutFixed64(top_level, offset);
+        PutFixed64(top_level, partition.index.size());
+        PutFixed64(top_level, offset + partition.index.size());
+        PutFixed64(top_level, partition.filter.size());
+        offset += partition.index.size() + partition.filter.size();
+    }
+    auto prefix_filters = BuildPrefixFilters();
+    file.write(prefix_filters.data(), static_cast<std::streamsize>(prefix_filters.size()));
+    // readers skip the sections they don't know, and readers from before sections stop after the partition entries
+    PutSection(top_level, LEARNED_INDEX_SECTION, BuildLearnedIndex());
+    if (!prefix_filters.empty()) {
+        std::string section;
+        PutKey(section, _prefix_extractor->Name());
+        PutFixed64(section, offset);
+        PutFixed64(section, prefix_filters.size());
+        PutSection(top_level, PREFIX_FILTER_SECTION, section);
+        offset += prefix_filters.size();
+    }
+    file.write(top_level.data(), static_cast<std::streamsize>(top_level.size()));
+
+    std::string footer;
+    PutFixed64(footer, offset);
+    PutFixed64(footer, top_level.size());
+    PutFixed64(footer, _offset);
+    PutFixed64(footer, _hash_util_ratio > 0 ? SEGMENT_INDEX_HASH_MAGIC : SEGMENT_INDEX_MAGIC);
+    file.write(footer.data(), static_cast<std::streamsize>(footer.size()));
+}
+
+Kora::SegmentIndex::SegmentIndex(const fs::path& path, size_t data_offset, std::shared_ptr<BlockCache> cache, Statistics* statistics):
+        _path{path}, _cache{std::move(cache)}, _cache_id{BlockCache::NewCacheId()}, _statistics{statistics}, _data_offset{data_offset} {}
+
+Kora::SegmentIndex::~SegmentIndex() {
+    if (_fd >= 0) ::close(_fd);
+}
+
+std::shared_ptr<Kora::SegmentIndex> Kora::SegmentIndex::Open(const fs::path& path, size_t data_offset, std::shared_ptr<BlockCache> cache,
+                                                             std::shared_ptr<MemoryManager> memory, Statistics* statistics) {
+    std::shared_ptr<SegmentIndex> index(new SegmentIndex(path, data_offset, std::move(cache), statistics));
+    index->_fd = ::open(path.c_str(), O_RDONLY);
+    std::error_code ec;
+    uint64_t file_size = fs::file_size(path, ec);
+    if (ec) file_size = 0;
+    // without a footer the records run to the end of the file
+    index->_data_end = file_size;
+    if (index->_fd < 0 || file_size < data_offset + FOOTER_SIZE) return index;
+
+    std::string footer(FOOTER_SIZE, '\0');
+    uint64_t top_level_offset, top_level_size, data_end, magic;
+    size_t pos = 0;
+    if (!ReadFully(index->_fd, &footer[0], FOOTER_SIZE, file_size - FOOTER_SIZE) || !GetFixed64(footer, pos, top_level_offset) ||
+        !GetFixed64(footer, pos, top_level_size) || !GetFixed64(footer, pos, data_end) || !GetFixed64(footer, pos, magic) ||
+        (magic != SEGMENT_INDEX_MAGIC && magic != SEGMENT_INDEX_HASH_MAGIC) || data_end < data_offset || top_level_offset < data_end ||
+        top_level_offset + top_level_size > file_size - FOOTER_SIZE) {
+        return index;
+    }
+    index->_data_end = data_end;
+    index->_block_hash = magic == SEGMENT_INDEX_HASH_MAGIC;
+
+    // a segment with a footer is searched through its index only, so a damaged top level leaves the records to be
+    // scanned in full
+    std::string top_level(top_level_size, '\0');
+    if (!ReadFully(index->_fd, &top_level[0], top_level_size, top_level_offset)) return index;
+    pos = 0;
+    uint64_t num_partitions;
+    if (!GetFixed64(top_level, pos, num_partitions)) return index;
+    std::vector<Partition> partitions;
+    for (uint64_t i = 0; i < num_partitions; i++) {
+        Partition partition;
+        if (!GetKey(top_level, pos, partition.last_key) || !GetHandle(top_level, pos, partition.index) ||
+            !GetHandle(top_level, pos, partition.filter)) {
+            return index;
+        }
+        index->_index_bytes += partition.index.size;
+        index->_filter_bytes += partition.filter.size;
+        partitions.push_back(std::move(partition));
+    }
+    index->_partitions = std::move(partitions);
+    index->_has_index = true;
+    // [key size][value size][key] of the first record, past the padding an empty key range of a compaction split into
+    // subcompactions leaves
+    uint64_t sizes[2], first = data_offset;
+    bool read = false;
+    while (!index->_partitions.empty() && data_end - first >= sizeof sizes &&
+           (read = ReadFully(index->_fd, reinterpret_cast<char*>(sizes), sizeof sizes, first)) && sizes[0] == PADDING_RECORD &&
+           sizes[1] <= data_end - first - sizeof sizes) {
+        first += sizeof sizes + sizes[1];
+        read = false;
+    }
+    if (read && sizes[0] <= data_end - first - sizeof sizes) {
+        index->_smallest_key.resize(sizes[0]);
+        if (!ReadFully(index->_fd, &index->_smallest_key[0], sizes[0], first + sizeof sizes)) index->_smallest_key.clear();
+    }
+    uint64_t type;
+    std::string section;
+    while (pos < top_level.size() && GetFixed64(top_level, pos, type) && GetKey(top_level, pos, section)) {
+        // a damaged learned index leaves the segment to be searched through its partitions
+        if (type == LEARNED_INDEX_SECTION && !index->ReadLearnedIndex(section)) {
+            index->_models.clear();
+            index->_block_keys.clear();
+            index->_block_offsets.clear();
+            index->_partition_blocks.clear();
+        }
+        // and damaged prefix filters leave it to be read by every prefix iterator
+        size_t section_pos = 0;
+        if (type == PREFIX_FILTER_SECTION && (!GetKey(section, section_pos, index->_prefix_extractor_name) ||
+                                              !GetHandle(section, section_pos, index->_prefix_filters) ||
+                                              index->_prefix_filters.offset < data_end ||
+                                              index->_prefix_filters.offset + index->_prefix_filters.size > top_level_offset)) {
+            index->_prefix_filters = {};
+        }
+    }
+    index->_pinned = MemoryReservation(std::move(memory), MemoryKind::_PINNED_INDEX, index->MemoryUsage());
+    return index;
+}
+
+bool Kora::SegmentIndex::ReadLearnedIndex(const std::string& section) {
+    size_t pos = 0;
+    uint64_t key_size, prefix_size, num_blocks, num_models;
+    if (!GetFixed64(section, pos, key_size) || !GetFixed64(section, pos, prefix_size) || !GetFixed64(section, pos, _learned_error) ||
+        !GetFixed64(section, pos, num_blocks) || key_size != _smallest_key.size() || prefix_size > key_size ||
+        num_blocks == 0 || num_blocks > (section.size() - pos) / (2 * sizeof(uint64_t))) {
+        return false;
+    }
+    _key_size = key_size;
+    _prefix_size = prefix_size;
+    _block_keys.resize(num_blocks);
+    _block_offsets.resize(num_blocks);
+    for (uint64_t i = 0; i < num_blocks; i++) {
+        if (!GetFixed64(section, pos, _block_keys[i]) || !GetFixed64(section, pos, _block_offsets[i])) return false;
+        if (_block_offsets[i] < (i == 0 ? _data_offset : _block_offsets[i - 1] + 1) || _block_offsets[i] >= _data_end ||
+            (i > 0 && _block_keys[i] <= _block_keys[i - 1])) {
+            return false;
+        }
+    }
+    if (!GetFixed64(section, pos, num_models) || num_models == 0 || num_models > num_blocks) return false;
+    _models.resize(num_models);
+    for (auto& model: _models) {
+        uint64_t slope;
+        if (!GetFixed64(section, pos, model.first) || !GetFixed64(section, pos, model.block) || !GetFixed64(section, pos, slope) ||
+            model.block >= num_blocks || model.first != _block_keys[model.block] || (&model != &_models[0] && model.block <= (&model - 1)->block)) {
+            return false;
+        }
+        std::memcpy(&model.slope, &slope, sizeof slope);
+    }
+    if (_models[0].block != 0) return false;
+    _partition_blocks.resize(_partitions.size());
+    for (auto& block: _partition_blocks) {
+        if (!GetFixed64(section, pos, block) || block >= num_blocks) return false;
+    }
+    return true;
+}
+
+size_t Kora::SegmentIndex::LearnedBlock(const std::string& key) const {
+    uint64_t number = KeyNumber(key, _prefix_size);
+    if (number > _block_keys.back()) return SIZE_MAX;
+    // the model of the keys from the last first key at or below number on. The blocks it covers, and the first block
+    // of the next model for keys past its last block, are the only ones that can hold the key
+    auto model = std::upper_bound(_models.begin(), _models.end(), number, [](uint64_t n, const LearnedModel& m) {
+        return n < m.first;
+    });
+    if (model == _models.begin()) return 0;
+    --model;
+    size_t first = model->block;
+    size_t last = model + 1 == _models.end() ? _block_keys.size() - 1 : (model + 1)->block;
+    double predicted = static_cast<double>(model->block) + model->slope * static_cast<double>(number - model->first);
+    // the blocks before and after the key are both within the error bound, and the key lies between them
+    auto error = static_cast<double>(_learned_error);
+    double low = std::floor(predicted - error), high = std::floor(predicted + error) + 1;
+    size_t window_first = low <= static_cast<double>(first) ? first : low >= static_cast<double>(last) ? last : static_cast<size_t>(low);
+    size_t window_last = high >= static_cast<double>(last) ? last : high <= static_cast<double>(window_first) ? window_first : static_cast<size_t>(high);
+
+    auto begin = _block_keys.begin();
+    auto block = std::lower_bound(begin + window_first, begin + window_last + 1, number);
+    // the window holds the block unless rounding put it off by one or two
+    if ((block == begin + window_last + 1 && window_last < last) || (block == begin + window_first && window_first > first && *(block - 1) >= number)) {
+        if (_statistics) _statistics->RecordTick(LEARNED_INDEX_MISS);
+        block = std::lower_bound(begin + first, begin + last + 1, number);
+    } else if (_statistics) {
+        _statistics->RecordTick(LEARNED_INDEX_HIT);
+    }
+    return block - begin;
+}
+
+Kora::Status Kora::SegmentIndex::ReadBlock(const BlockHandle& handle, BlockCache::Block& block) const {
+    auto key = BlockCache::BlockKey(_cache_id, handle.offset);
+    if (_cache && (block = _cache->Lookup(key))) {
+        if (_statistics) _statistics->RecordTick(BLOCK_CACHE_HIT);
+        return {};
+    }
+    if (_statistics) _statistics->RecordTick(BLOCK_CACHE_MISS);
+    auto contents = std::make_shared<std::string>(handle.size, '\0');
+    if (_fd < 0 || !ReadFully(_fd, &(*contents)[0], handle.size, handle.offset)) {
+        return Status::IoError("Unable to read segment " + _path.string());
+    }
+    PERF_COUNTER_ADD(block_read_count, 1);
+    PERF_COUNTER_ADD(block_read_byte, handle.size);
+    if (_statistics) _statistics->RecordTick(SEGMENT_BYTES_READ, handle.size);
+    block = std::move(contents);
+    if (_cache) _cache->Insert(key, block);
+    return {};
+}
+
+const Kora::SegmentIndex::Partition* Kora::SegmentIndex::FindPartition(const std::string& key) const {
+    auto partition = std::lower_bound(_partitions.begin(), _partitions.end(), key, [](const Partition& p, const std::string& k) {
+        return p.last_key < k;
+    });
+    return partition == _partitions.end() ? nullptr : &*partition;
+}
+
+bool Kora::SegmentIndex::FindBlockHandle(const std::string& partition, const std::string& key, BlockHandle& handle,
+                                         std::string_view* hash_index) const {
+    std::string last_key;
+    size_t pos = 0;
+    uint64_t hash_size = 0;
+    while (pos < partition.size()) {
+        if (!GetKey(partition, pos, last_key) || !GetHandle(partition, pos, handle)) return false;
+        if (_block_hash && (!GetFixed64(partition, pos, hash_size) || partition.size() - pos < hash_size)) return false;
+        if (last_key >= key) {
+            if (hash_index) *hash_index = std::string_view(partition.data() + pos, hash_size);
+            return true;
+        }
+        pos += hash_size;
+    }
+    return false;
+}
+
+Kora::Status Kora::SegmentIndex::FindBlock(const std::string& key, BlockCache::Block& block, size_t* entry_offset) const {
+    block = nullptr;
+    if (entry_offset) *entry_offset = SIZE_MAX;
+    if (key < _smallest_key) return {};
+    const Partition* partition;
+    BlockHandle handle;
+    if (HasLearnedIndex()) {
+        // a key of another size, or without the prefix of the keys, is not one of them
+        if (key.size() != _key_size || key.compare(0, _prefix_size, _smallest_key, 0, _prefix_size) != 0) return {};
+        size_t i = LearnedBlock(key);
+        if (i == SIZE_MAX) return {};
+        partition = &_partitions[std::upper_bound(_partition_blocks.begin(), _partition_blocks.end(), i) - _partition_blocks.begin() - 1];
+        handle = {_block_offsets[i], (i + 1 < _block_offsets.size() ? _block_offsets[i + 1] : _data_end) - _block_offsets[i]};
+    } else {
+        partition = FindPartition(key);
+        if (!partition) return {};
+    }
+    BlockCache::Block contents;
+    if (partition->filter.size > 0) {
+        auto s = ReadBlock(partition->filter, contents);
+        if (!s.isOk()) return s;
+        if (!BloomFilterMayMatch(*contents, key)) {
+            if (_statistics) _statistics->RecordTick(BLOOM_FILTER_USEFUL);
+            return {};
+        }
+    }
+    if (HasLearnedIndex()) return ReadBlock(handle, block);
+    auto s = ReadBlock(partition->index, contents);
+    if (!s.isOk()) return s;
+    std::string_view hash_index;
+    if (!FindBlockHandle(*contents, key, handle, &hash_index)) return Status::Corruption("Malformed index partition in " + _path.string());
+    if (entry_offset && hash_index.size() >= sizeof(uint16_t)) {
+        uint16_t bucket;
+        std::memcpy(&bucket, hash_index.data() + StableHash(key) % (hash_index.size() / sizeof bucket) * sizeof bucket, sizeof bucket);
+        if (bucket == HASH_BUCKET_COLLISION) {
+            if (_statistics) _statistics->RecordTick(BLOCK_HASH_INDEX_COLLISION);
+        } else {
+            if (_statistics) _statistics->RecordTick(BLOCK_HASH_INDEX_HIT);
+            // no record of the block hashes to an empty bucket, so the key isn't there
+            if (bucket == HASH_BUCKET_EMPTY) return {};
+            *entry_offset = bucket;
+        }
+    }
+    return ReadBlock(handle, block);
+}
+
+uint64_t Kora::SegmentIndex::SeekOffset(const std::string& target) const {
+    if (!_has_index) return _data_offset;
+    // targets of any size order like the numbers of their bytes after the prefix, so the block found never starts
+    // past the first key that reaches target
+    if (HasLearnedIndex() && target.compare(0, _prefix_size, _smallest_key, 0, _prefix_size) == 0) {
+        size_t i = LearnedBlock(target);
+        return i == SIZE_MAX ? _data_end : _block_offsets[i];
+    }
+    auto partition = FindPartition(target);
+    if (!partition) return _data_end;
+    BlockCache::Block contents;
+    BlockHandle handle;
+    // scanning from the start is slow but still finds target
+    if (!ReadBlock(partition->index, contents).isOk() || !FindBlockHandle(*contents, target, handle)) return _data_offset;
+    return handle.offset;
+}
+
+uint64_t Kora::SegmentIndex::DataBytes(const std::string& begin, const std::string& end) const {
+    if (!_has_index) return _data_end - _data_offset;
+    auto first = begin.empty() ? _partitions.data() : FindPartition(begin);
+    auto last = end.empty() ? nullptr : FindPartition(end);
+    if (!first) return 0;
+    if (!last) last = &_partitions.back();
+    uint64_t bytes = 0;
+    for (auto partition = first; partition <= last; ++partition) {
+        BlockCache::Block contents;
+        if (!ReadBlock(partition->index, contents).isOk()) return _data_end - _data_offset;
+        std::string last_key;
+        BlockHandle handle;
+        size_t pos = 0;
+        uint64_t hash_size = 0;
+        while (pos < contents->size()) {
+            if (!GetKey(*contents, pos, last_key) || !GetHandle(*contents, pos, handle)) return _data_end - _data_offset;
+            if (_block_hash && (!GetFixed64(*contents, pos, hash_size) || contents->size() - pos < hash_size)) {
+                return _data_end - _data_offset;
+            }
+            pos += hash_size;
+            if (!begin.empty() && last_key < begin) continue;
+            bytes += handle.size;
+            if (!end.empty() && last_key >= end) return bytes;
+        }
+    }
+    return bytes;
+}
+
+std::vector<std::string> Kora::SegmentIndex::PartitionKeys() const {
+    std::vector<std::string> keys;
+    keys.reserve(_partitions.size());
+    for (const auto& partition: _partitions) keys.push_back(partition.last_key);
+    return keys;
+}
+
+bool Kora::SegmentIndex::PrefixMayMatch(const std::string& prefix, const PrefixExtractor* extractor) const {
+    if (!_has_index) return true;
+    // the keys that start with prefix sort from prefix on, and before any larger key that doesn't start with it
+    if (_partitions.empty() || LargestKey() < prefix) return false;
+    if (_smallest_key > prefix && _smallest_key.compare(0, prefix.size(), prefix) != 0) return false;
+    if (!extractor || !HasPrefixFilters(*extractor)) return true;
+    if (_statistics) _statistics->RecordTick(PREFIX_FILTER_CHECKED);
+    BlockCache::Block filters;
+    if (!ReadBlock(_prefix_filters, filters).isOk()) return true;
+    size_t pos = 0;
+    uint64_t num_filters;
+    std::string filter;
+    if (!GetFixed64(*filters, pos, num_filters)) return true;
+    for (uint64_t i = 0; i < num_filters; i++) {
+        if (!GetKey(*filters, pos, filter) || BloomFilterMayMatch(filter, prefix)) return true;
+    }
+    if (_statistics) _statistics->RecordTick(PREFIX_FILTER_USEFUL);
+    return false;
+}
+
+size_t Kora::SegmentIndex::MemoryUsage() const {
+    size_t usage = sizeof(*this) + _smallest_key.capacity() + _prefix_extractor_name.capacity() + _partitions.capacity() * sizeof(Partition);
+    for (const auto& partition: _partitions) usage += partition.last_key.capacity();
+    usage += _models.capacity() * sizeof(LearnedModel) +
+             (_block_keys.capacity() + _block_offsets.capacity() + _partition_blocks.capacity()) * sizeof(uint64_t);
+    return usage;
+}
@@ -0,0 +1,137 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/statistics.h"
+#include <cstdio>
+
+namespace {
+    const char* const TICKER_NAMES[Kora::TICKER_ENUM_MAX] = {
+            "kora.number.keys.written",
+            "kora.number.keys.deleted",
+            "kora.number.keys.read",
+            "kora.number.keys.found",
+            "kora.bytes.written",
+            "kora.bytes.read",
+            "kora.memtable.hit",
+            "kora.memtable.miss",
+            "kora.segments.probed",
+            "kora.segment.bytes.read",
+            "kora.wal.writes",
+            "kora.wal.bytes",
+            "kora.stall.micros",
+            "kora.stall.delayed.writes",
+            "kora.stall.stopped.writes",
+            "kora.stall.memtable.limit.micros",
+            "kora.stall.segment.limit.micros",
+            "kora.stall.pending.compaction.micros",
+            "kora.flush.count",
+            "kora.flush.bytes.written",
+            "kora.compaction.count",
+            "kora.compact.read.bytes",
+            "kora.compact.write.bytes",
+            "kora.compact.keys.dropped",
+            "kora.compact.tombstones.dropped",
+            "kora.number.merges",
+            "kora.number.range.deletes",
+            "kora.compact.range.deleted.keys",
+            "kora.merge.operations",
+            "kora.merge.failures",
+            "kora.blob.file.bytes.written",
+            "kora.blob.file.bytes.read",
+            "kora.blob.gc.files",
+            "kora.blob.gc.bytes.relocated",
+            "kora.compact.filter.removed.keys",
+            "kora.compact.filter.changed.values",
+            "kora.block.cache.hit",
+            "kora.block.cache.miss",
+            "kora.bloom.filter.useful",
+            "kora.memory.budget.flushes",
+            "kora.direct.io.fallbacks",
+            "kora.block.hash.index.hit",
+            "kora.block.hash.index.collision",
+            "kora.row.cache.hit",
+            "kora.row.cache.miss",
+            "kora.compact.read.stage.micros",
+            "kora.compact.merge.stage.micros",
+            "kora.compact.write.stage.micros",
+            "kora.subcompactions",
+            "kora.wal.files.recycled",
+            "kora.compact.trivial.moves",
+            "kora.memtable.appends",
+            "kora.learned.index.hit",
+            "kora.learned.index.miss",
+            "kora.prefix.filter.checked",
+            "kora.prefix.filter.useful",
+    };
+
+    const char* const HISTOGRAM_NAMES[Kora::HISTOGRAM_ENUM_MAX] = {
+            "kora.get.micros",
+            "kora.set.micros",
+            "kora.delete.micros",
+            "kora.get.segments.probed",
+            "kora.wal.append.micros",
+            "kora.write.stall.micros",
+            "kora.flush.micros",
+            "kora.compaction.micros",
+            "kora.blob.gc.micros",
+    };
+
+    size_t ThreadShard(size_t shards) {
+        static std::atomic<size_t> next_shard{0};
+        static thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed);
+        return shard % shards;
+    }
+}
+
+const char* Kora::Statistics::TickerName(Ticker ticker) {
+    return TICKER_NAMES[ticker];
+}
+
+const char* Kora::Statistics::HistogramName(HistogramType type) {
+    return HISTOGRAM_NAMES[type];
+}
+
+void Kora::Statistics::MeasureTime(HistogramType type, uint64_t value) {
+    auto& shard = _histograms[type][ThreadShard(_HISTOGRAM_SHARDS)];
+    std::lock_guard<std::mutex> lg(shard.mutex);
+    shard.histogram.Add(static_cast<double>(value));
+}
+
+Kora::Histogram Kora::Statistics::GetHistogram(HistogramType type) const {
+    Histogram result;
+    for (const auto& shard: _histograms[type]) {
+        std::lock_guard<std::mutex> lg(shard.mutex);
+        result.Merge(shard.histogram);
+    }
+    return result;
+}
+
+void Kora::Statistics::Reset() {
+    for (auto& ticker: _tickers) ticker.store(0, std::memory_order_relaxed);
+    for (auto& shards: _histograms) {
+        for (auto& shard: shards) {
+            std::lock_guard<std::mutex> lg(shard.mutex);
+            shard.histogram.Clear();
+        }
+    }
+    _start_micros = nowMicros();
+}
+
+std::string Kora::Statistics::ToString() const {
+    std::string result;
+    char buf[256];
+    for (uint32_t t = 0; t < TICKER_ENUM_MAX; t++) {
+        std::snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", TICKER_NAMES[t],
+                      static_cast<unsigned long long>(GetTickerCount(static_cast<Ticker>(t))));
+        result.append(buf);
+    }
+    for (uint32_t h = 0; h < HISTOGRAM_ENUM_MAX; h++) {
+        auto histogram = GetHistogram(static_cast<HistogramType>(h));
+        std::snprintf(buf, sizeof(buf), "%s P50 : %.2f P99 : %.2f P99.9 : %.2f MAX : %.2f COUNT : %.0f SUM : %.0f\n",
+                      HISTOGRAM_NAMES[h], histogram.Percentile(50), histogram.Percentile(99),
+                      histogram.Percentile(99.9), histogram.Max(), histogram.Count(), histogram.Sum());
+        result.append(buf);
+    }
+    return result;
+}
@@ -13,6 +13,10 @@ std::string Kora::Status::toString() const {
                 return "Data not found";
             case Kora::Code::_DONE:
                 return "Done";
+            case Kora::Code::_INVALIDARGUMENT:
+                return "Invalid argument";
+            case Kora::Code::_CORRUPTION:
+                return "Corruption";
             default:
                 return "Unknown code.";
         }
@@ -3,99 +3,538 @@
 //
 
 #include "../include/storage_engine.h"
+#include "../include/compaction_pipeline.h"
 #include "../include/helper.h"
+#include "../include/perf_context.h"
+#include "../include/thread_pool.h"
+#include <algorithm>
 #include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
 #include <vector>
 #include <sstream>
 #include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
 // initialize static variables
-std::map<long, std::string, std::greater<>> Kora::StorageEngine::_sstables = std::map<long, std::string, std::greater<>>();
-std::unordered_map<std::string, std::map<std::string, size_t>> Kora::StorageEngine::_hash_indexes = std::unordered_map<std::string, std::map<std::string, size_t>>();
 std::string Kora::StorageEngine::_TOMBSTONE_RECORD = "koraDYtombstoneDX";
-bool Kora::StorageEngine::_done_updating_sstables = false;
+std::string Kora::StorageEngine::_BATCH_RECORD = "koraDYbatchDX";
+std::string Kora::StorageEngine::_MERGE_RECORD = "koraDYmergeDX";
+std::string Kora::StorageEngine::_RANGE_TOMBSTONE_RECORD = "koraDYrangeDX";
+std::string Kora::StorageEngine::_BLOB_RECORD = "koraDYblobDX";
 
 
-Kora::Status Kora::StorageEngine::Set(Data&& key, Data&& value, bool from_log) noexcept {
+Kora::Status Kora::StorageEngine::Set(Data&& key, Data&& value, bool from_log, const WriteOptions& write_options,
+                                      uint64_t* trace_sequence) noexcept {
     /**
      * insert key and value into the memtable
      * update the memtable approx size
      * add the new data to the log file
      */
-    while (true) {
-        size_t key_size = key.size();
-        size_t value_size = value.size();
-        char data[key_size + value_size]; //extra bytes for new line character and the new line characters of key and value
-        // strcpy copies the string pointed to by source including the null character
-        strcpy(data, key.data());
-        strcpy(&data[key_size], value.data());
-        std::unique_lock<std::mutex> ulock(_mutex);
-        _memtable.insert(std::make_pair(key, value));
-        _memtableSize += sizeof(key) + sizeof(value);
-        ulock.unlock();
-        // only write to the log file when the Set method is called by a client and not when we're updating the sstables from the log fileΩ
-        if(!from_log) LogData(data, key_size, value_size);
+    StopWatch sw(_statistics, SET_MICROS);
+    size_t key_size = key.size();
+    size_t value_size = value.size();
+    // the write controller may hold writes back while flushes or compactions catch up. Replayed writes are exempt
+    if (!from_log) DelayWrite(key_size + value_size);
+    std::unique_lock<std::mutex> ulock(_mutex, std::defer_lock);
+    {
+        PERF_TIMER_GUARD(mutex_wait_nanos);
+        ulock.lock();
+    }
+    if (trace_sequence) *trace_sequence = TraceWriter::NextSequence();
+    AddToMemtable(key, value);
+    _memtableSize += _MEMTABLE_WRITE_CHARGE;
+    ulock.unlock();
+    // only write to the log file when the Set method is called by a client and not when we're updating the sstables from the log file.
+    // logging after the insert means a record can at worst land in the log file of the memtable after its own, never in an older one
+    if(!from_log) {
+        LogData(key.data(), key_size, value.data(), value_size, write_options.sync);
+        _statistics.RecordTick(NUMBER_KEYS_WRITTEN);
+        _statistics.RecordTick(BYTES_WRITTEN, key_size + value_size);
+    }
+    {
+        PERF_TIMER_GUARD(mutex_wait_nanos);
         ulock.lock();
-        if (_memtableSize >= _MAX_MEMTABLE_SIZE) {
-            _done_writing = false;
-            _temp_memtable = std::move(_memtable);
-            _memtableSize = 0;
-            _memtable = std::map<Data, Data, Kora::Comparator>();
-            _memtable_is_full = true;
-            _update_is_from_logfile = from_log;
-            ulock.unlock();
-            _cond.notify_one();
-            ulock.lock();
-            _cond.wait(ulock, [this] { return _done_writing; });
-            // delete log file since memtable has been successfully written to disk
-            ClearLogFile();
+    }
+    if (MemtableFull()) SwitchMemtable(ulock, from_log);
+    return {};
+}
+
+void Kora::StorageEngine::SwitchMemtable(std::unique_lock<std::mutex>& ulock, bool from_log, bool force) {
+    if (_immutable_memtables.size() >= _write_controller.MaxImmutableMemtables()) {
+        // hard stop: the flush queue is full. The writer thread never waits on writers, so it always drains the queue
+        uint64_t stall_start = nowMicros();
+        PERF_TIMER_GUARD(write_stall_nanos);
+        _cond.wait(ulock, [this] {
+            return _immutable_memtables.size() < _write_controller.MaxImmutableMemtables() || _shutting_down;
+        });
+        PERF_TIMER_STOP(write_stall_nanos);
+        RecordWriteStall(WriteStallCause::_MEMTABLE_LIMIT, WriteStallCondition::_STOPPED, nowMicros() - stall_start);
+    }
+    // another writer may have switched the memtable while we were waiting
+    if (!force && !MemtableFull()) return;
+    if (!force && _memtableSize < _MAX_MEMTABLE_SIZE) _statistics.RecordTick(MEMORY_BUDGET_FLUSHES);
+
+    ImmutableMemtable immutable;
+    immutable.table = std::move(_memtable);
+    immutable.range_tombstones = std::move(_range_tombstones);
+    immutable.prefix_filter = std::move(_memtable_prefix_filter);
+    immutable.bytes = _memtable_bytes;
+    _options.memory_manager->Move(MemoryKind::_MEMTABLE, MemoryKind::_IMMUTABLE_MEMTABLE, _memtable_bytes);
+    if (!from_log) {
+        // seal the active log file so that it can be recycled as soon as this memtable is in a segment. If no new log
+        // file can be started the active one goes on, and protects the records of both memtables
+        auto log = NewLogFile();
+        if (log) {
+            std::lock_guard<std::mutex> lg(_log_mutex);
+            immutable.log = std::move(_log);
+            _log = std::move(log);
+            immutable.first_batch = _memtable_first_batch;
+            _memtable_first_batch = 0;
+        }
+    }
+    _immutable_memtables.push_back(std::move(immutable));
+    _memtable = Memtable(Comparator(_options.fixed_key_size));
+    _range_tombstones = RangeTombstones();
+    _memtable_prefix_filter = NewMemtablePrefixFilter();
+    _memtableSize = 0;
+    _memtable_bytes = 0;
+    UpdateWriteStallState();
+    MaybeScheduleFlush();
+}
+
+void Kora::StorageEngine::DelayWrite(size_t num_bytes) {
+    auto condition = _write_controller.Condition();
+    if (condition == WriteStallCondition::_NORMAL) return;
+    auto cause = _write_controller.Cause();
+    uint64_t stall_start = nowMicros();
+    PERF_TIMER_GUARD(write_stall_nanos);
+    if (condition == WriteStallCondition::_DELAYED) {
+        uint64_t delay = _write_controller.GetDelay(num_bytes);
+        if (delay == 0) return;
+        std::this_thread::sleep_for(std::chrono::microseconds(delay));
+    } else {
+        std::unique_lock<std::mutex> ulock(_mutex);
+        // compaction only runs every few seconds, don't make stopped writers wait for the next round
+        _timer.wake();
+        while (_write_controller.IsStopped() && !_shutting_down) {
+            // flushes notify us, compaction progress is picked up by looking at the backlog again
+            _cond.wait_for(ulock, std::chrono::milliseconds(100));
+            UpdateWriteStallState();
+        }
+    }
+    PERF_TIMER_STOP(write_stall_nanos);
+    RecordWriteStall(cause, condition, nowMicros() - stall_start);
+}
+
+void Kora::StorageEngine::UpdateWriteStallState() {
+    uintmax_t level_files[_SETTLED_LEVEL + 1] = {}, level_bytes[_SETTLED_LEVEL + 1] = {};
+    TierSizes(level_files, level_bytes);
+    // a tier with at least two segments has work waiting for the compaction thread
+    size_t backlog_segments = 0;
+    uintmax_t pending_compaction_bytes = 0;
+    for (int level = 1; level <= 4; level++) {
+        if (level_files[level] < 2) continue;
+        backlog_segments += level_files[level];
+        pending_compaction_bytes += level_bytes[level];
+    }
+    _write_controller.Update(_immutable_memtables.size(), backlog_segments, pending_compaction_bytes);
+}
+
+void Kora::StorageEngine::RecordWriteStall(WriteStallCause cause, WriteStallCondition condition, uint64_t micros) {
+    _statistics.RecordTick(STALL_MICROS, micros);
+    _statistics.MeasureTime(WRITE_STALL_MICROS, micros);
+    _statistics.RecordTick(condition == WriteStallCondition::_STOPPED ? STALL_STOPPED_WRITES : STALL_DELAYED_WRITES);
+    switch (cause) {
+        case WriteStallCause::_MEMTABLE_LIMIT:
+            _statistics.RecordTick(STALL_MEMTABLE_LIMIT_MICROS, micros);
+            break;
+        case WriteStallCause::_SEGMENT_LIMIT:
+            _statistics.RecordTick(STALL_SEGMENT_LIMIT_MICROS, micros);
+            break;
+        case WriteStallCause::_PENDING_COMPACTION_BYTES:
+            _statistics.RecordTick(STALL_PENDING_COMPACTION_MICROS, micros);
+            break;
+        default:
+            break;
+    }
+}
+
+void Kora::StorageEngine::MaybeScheduleFlush() {
+    if (_flush_scheduled || _shutting_down || _immutable_memtables.empty()) return;
+    _flush_scheduled = true;
+    ThreadPool::Default(JobPriority::_HIGH).Schedule([this] { BackgroundFlush(); });
+}
+
+void Kora::StorageEngine::MaybeScheduleCompaction() {
+    std::lock_guard<std::mutex> lg(_mutex);
+    if (_compaction_scheduled || _shutting_down) return;
+    _compaction_scheduled = true;
+    ThreadPool::Default(JobPriority::_LOW).Schedule([this] { BackgroundCompaction(); });
+}
+
+void Kora::StorageEngine::BackgroundCompaction() {
+    Compact();
+    std::lock_guard<std::mutex> lg(_mutex);
+    UpdateWriteStallState();
+    _compaction_scheduled = false;
+    // notify while holding the lock: once it is released the destructor may already be tearing the engine down
+    _cond.notify_all();
+}
+
+void Kora::StorageEngine::MaybeScheduleBlobGC() {
+    std::lock_guard<std::mutex> lg(_mutex);
+    if (_blob_gc_scheduled || _shutting_down || _blob_files.empty()) return;
+    _blob_gc_scheduled = true;
+    ThreadPool::Default(JobPriority::_LOW).Schedule([this] { BackgroundBlobGC(); });
+}
+
+void Kora::StorageEngine::BackgroundBlobGC() {
+    std::vector<std::shared_ptr<BlobFile>> candidates;
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        for (const auto& [number, blob_file]: _blob_files) {
+            if (blob_file->GarbageRatio() >= _options.blob_garbage_collection_ratio) candidates.push_back(blob_file);
         }
-        return {};
     }
+    // oldest first, they have had the most time to collect garbage
+    for (const auto& blob_file: candidates) {
+        if (_shutting_down || !CollectBlobFile(blob_file)) break;
+    }
+    std::lock_guard<std::mutex> lg(_mutex);
+    _blob_gc_scheduled = false;
+    // notify while holding the lock: once it is released the destructor may already be tearing the engine down
+    _cond.notify_all();
 }
 
-Kora::Result Kora::StorageEngine::Get(Kora::Data&& input_key) {
+bool Kora::StorageEngine::CollectBlobFile(const std::shared_ptr<BlobFile>& blob_file) {
+    StopWatch sw(_statistics, BLOB_GC_MICROS);
+    // the keys still referring to the file are found in one pass over a snapshot of the database rather than with a
+    // lookup per value. The resolver only stops at those keys, and leaves the versions readers see in visible. The
+    // first memtable_versions of them come from memtables
+    struct SnapshotState {
+        std::vector<std::string> visible;
+        size_t memtable_versions = 0;
+    };
+    auto state = std::make_shared<SnapshotState>();
+    auto refers_to_file = [&blob_file](const std::string& version) {
+        BlobIndex index;
+        return DecodeBlobRecord(version, index) && index.file_number == blob_file->Number();
+    };
+    long snapshot_file_number = 0;
+    auto new_snapshot = [&]() {
+        std::vector<std::unique_ptr<Iterator>> children;
+        auto range_tombstones = std::make_shared<std::vector<RangeTombstones>>();
+        std::lock_guard<std::mutex> lg(_mutex);
+        SnapshotChildren(children, *range_tombstones);
+        size_t memtable_children = 1 + _immutable_memtables.size();
+        // flushes are the only thing that takes new file numbers
+        snapshot_file_number = _file_number;
+        return std::make_unique<MergingIterator>(std::move(children), [state, range_tombstones, memtable_children, refers_to_file](const std::string& key, const std::vector<const std::string*>& versions, std::string&) {
+            state->visible.clear();
+            state->memtable_versions = 0;
+            bool refers = false;
+            for (size_t i = 0; i < versions.size(); i++) {
+                bool done = false;
+                if (versions[i] != nullptr) {
+                    state->visible.push_back(*versions[i]);
+                    refers = refers || refers_to_file(*versions[i]);
+                    done = IsFinalVersion(*versions[i]);
+                }
+                if (!done && (*range_tombstones)[i].Covers(key)) {
+                    state->visible.push_back(_TOMBSTONE_RECORD);
+                    done = true;
+                }
+                if (i < memtable_children) state->memtable_versions = state->visible.size();
+                if (done) break;
+            }
+            return refers;
+        });
+    };
+
+    std::string key, value, folded;
+    std::vector<std::string> now;
+    std::vector<const std::string*> version_ptrs;
+    auto it = new_snapshot();
+    for (it->SeekToFirst(); it->Valid() && !_shutting_down;) {
+        key = it->key();
+        auto live = std::find_if(state->visible.begin(), state->visible.end(), refers_to_file);
+        BlobIndex index;
+        DecodeBlobRecord(*live, index);
+        if (!blob_file->Read(index, value).isOk()) return false;
+        {
+            // writes made since the snapshot are either in the memtables or, once flushed, in segments with new file
+            // numbers. Recheck the key under the lock the rewrite happens under, so that no write slips in between
+            auto ulock = LockForBatch();
+            now.clear();
+            FindMemtableVersions(key, now);
+            bool unchanged = snapshot_file_number == _file_number && now.size() == state->memtable_versions &&
+                             std::equal(now.begin(), now.end(), state->visible.begin());
+            if (!unchanged) {
+                now.clear();
+                FindVersions(key, now);
+                state->visible = std::move(now);
+                // the key has at most one value in the file, so if it is still referred to, it is by the same index
+                live = std::find_if(state->visible.begin(), state->visible.end(), refers_to_file);
+            }
+            // otherwise the key was overwritten or deleted since
+            if (live != state->visible.end()) {
+                WriteBatch batch;
+                if (live == state->visible.begin()) {
+                    batch.Set(key, value);
+                } else {
+                    // merge operands apply to the value. Fold them onto it so that the rewritten version doesn't
+                    // need the blob file anymore. Whatever FoldVersions() comes up with can stand on its own
+                    *live = value;
+                    version_ptrs.clear();
+                    for (auto version = state->visible.begin(); version <= live; ++version) version_ptrs.push_back(&*version);
+                    FoldVersions(key, version_ptrs, true, folded);
+                    batch.Set(key, folded);
+                }
+                ApplyBatch(batch, false);
+                _statistics.RecordTick(BLOB_GC_BYTES_RELOCATED, value.size());
+            }
+        }
+        MaybeSwitchMemtable();
+        if (snapshot_file_number == _file_number) {
+            it->Next();
+            continue;
+        }
+        // a flush went by, carry on past key with a snapshot that has the flushed segment
+        it = new_snapshot();
+        it->Seek(key);
+        if (it->Valid() && it->key() == key) it->Next();
+    }
+    if (_shutting_down) return false;
+
+    std::lock_guard<std::mutex> lg(_mutex);
+    // the rewritten values only live in the log files until they are flushed, so they have to be on disk before the
+    // blob file goes
+    std::shared_ptr<LogWriter> active_log;
+    {
+        std::lock_guard<std::mutex> log_lg(_log_mutex);
+        active_log = _log;
+    }
+    if (active_log) active_log->Sync();
+    for (const auto& immutable: _immutable_memtables) {
+        if (immutable.log) immutable.log->Sync();
+    }
+    _blob_files.erase(blob_file->Number());
+    blob_file->MarkObsolete();
+    _statistics.RecordTick(BLOB_GC_FILES);
+    return true;
+}
+
+const std::string& Kora::StorageEngine::FilterValue(const BlobFiles& blob_files, const std::string& key, const std::string& value, std::string& changed) {
+    if (value == _TOMBSTONE_RECORD || IsMergeRecord(value)) return value;
+    // the filter sees the value itself rather than its blob record
+    const std::string* existing = &value;
+    std::string blob_value;
+    if (IsBlobRecord(value)) {
+        if (!ReadBlob(blob_files, value, blob_value).isOk()) return value;
+        existing = &blob_value;
+    }
+    switch (_options.compaction_filter->Filter(key, *existing, &changed)) {
+        case CompactionFilter::Decision::_REMOVE:
+            _statistics.RecordTick(COMPACT_FILTER_REMOVED_KEYS);
+            return _TOMBSTONE_RECORD;
+        case CompactionFilter::Decision::_CHANGE_VALUE:
+            _statistics.RecordTick(COMPACT_FILTER_CHANGED_VALUES);
+            return changed;
+        default:
+            return value;
+    }
+}
+
+void Kora::StorageEngine::DropBlobReferences(const std::map<uint64_t, uint64_t>& dropped_bytes) {
+    for (const auto& [number, bytes]: dropped_bytes) {
+        auto blob_file = _blob_files.find(number);
+        // garbage collection may have removed the file already
+        if (blob_file == _blob_files.end()) continue;
+        blob_file->second->RemoveLiveBytes(bytes);
+        if (blob_file->second->LiveBytes() > 0) continue;
+        blob_file->second->MarkObsolete();
+        _blob_files.erase(blob_file);
+        _statistics.RecordTick(BLOB_GC_FILES);
+    }
+}
+
+Kora::Result Kora::StorageEngine::Get(Kora::Data&& input_key, uint64_t* trace_sequence) {
     /**
      * Convert key to char array
      * check the memtable first
      * start from the most recent segment, check for they key, continue until we run out of segments to check
      */
+    StopWatch sw(_statistics, GET_MICROS);
+    _statistics.RecordTick(NUMBER_KEYS_READ);
+    PERF_TIMER_GUARD(mutex_wait_nanos);
     std::lock_guard<std::mutex> lg(_mutex);
-    Result r(Kora::Status::NotFound("key not found"));
-    auto entry = _memtable.find(input_key);
+    PERF_TIMER_STOP(mutex_wait_nanos);
+    if (trace_sequence) *trace_sequence = TraceWriter::NextSequence();
+    std::string key(input_key.data(), input_key.size());
+    std::vector<std::string> versions;
+    bool done = FindMemtableVersions(key, versions);
+    _statistics.RecordTick(versions.empty() ? MEMTABLE_MISS : MEMTABLE_HIT);
+    // keys in a memtable are still changing, only what the segments answer goes into the row cache
+    bool cacheable = _options.row_cache && versions.empty();
+    Result result{Kora::Status::OK()};
+    if (!cacheable || !LookupRow(key, result)) {
+        if (!done) FindSegmentVersions(key, versions);
+        result = ResolveVersions(key, versions);
+        if (cacheable) InsertRow(key, result);
+    }
+    if (result.status().isOk()) {
+        _statistics.RecordTick(NUMBER_KEYS_FOUND);
+        _statistics.RecordTick(BYTES_READ, result.data().size());
+    }
+    return result;
+}
 
-    if (entry != _memtable.end())  {
-        // record exists but has been deleted. Return not found status
-        if (std::string(entry->second.data(), entry->second.size()).compare(Kora::StorageEngine::_TOMBSTONE_RECORD) == 0) return r;
+Kora::Result Kora::StorageEngine::ResolveVersions(const std::string& key, std::vector<std::string>& versions) {
+    if (versions.empty()) return Result{Kora::Status::NotFound("Key not found")};
+
+    for (auto& version: versions) {
+        if (!IsBlobRecord(version)) continue;
+        std::string record = std::move(version);
+        auto s = ReadBlob(_blob_files, record, version);
+        if (!s.isOk()) return Result{std::move(s)};
+    }
 
-        return Result(Kora::Status(), std::string(_memtable[input_key].data(), _memtable[input_key].size()));
+    std::string value;
+    if (versions.size() == 1 && !IsMergeRecord(versions.front())) {
+        // record exists but has been deleted. Return not found status
+        if (versions.front() == Kora::StorageEngine::_TOMBSTONE_RECORD) return Result{Kora::Status::NotFound("Key not found")};
+        value = std::move(versions.front());
     } else {
-        for (auto& [key, value]: _sstables) {
-            r = Search(input_key.data(), value, 0);
-            if (r.status().isOk()) {
-                // check if it has been deleted
-                if (r.data().compare(Kora::StorageEngine::_TOMBSTONE_RECORD) == 0) {
-                    return Result{Kora::Status::NotFound("Key not found")};
-                }
-                return r; // we have found the key
-            }
+        std::vector<const std::string*> version_ptrs;
+        for (const auto& version: versions) version_ptrs.push_back(&version);
+        // every version that matters has been found, so whatever is older can't change the outcome
+        switch (FoldVersions(key, version_ptrs, true, value)) {
+            case MergeResult::_VALUE:
+                break;
+            case MergeResult::_DELETED:
+                return Result{Kora::Status::NotFound("Key not found")};
+            case MergeResult::_OPERANDS:
+                return Result{Kora::Status::InvalidArgument("Key has merge operands but no merge operator is set")};
+            default:
+                return Result{Kora::Status::Corruption("Merge operator " + std::string(_options.merge_operator->Name()) + " failed")};
         }
-        return r;
     }
+    return Result(Kora::Status(), std::move(value));
+}
+
+std::string Kora::StorageEngine::RowKey(const char* key, size_t key_size) const {
+    // [cache id][key]
+    std::string row_key(reinterpret_cast<const char*>(&_row_cache_id), sizeof _row_cache_id);
+    row_key.append(key, key_size);
+    return row_key;
+}
+
+bool Kora::StorageEngine::LookupRow(const std::string& key, Result& result) {
+    auto row = _options.row_cache->Lookup(RowKey(key.data(), key.size()));
+    _statistics.RecordTick(row ? ROW_CACHE_HIT : ROW_CACHE_MISS);
+    if (!row) return false;
+    // [1][value] for a value, [0] for a key that is not found
+    if (row->empty() || row->front() == 0) result = Result{Kora::Status::NotFound("Key not found")};
+    else result = Result(Kora::Status(), row->substr(1));
+    return true;
+}
+
+void Kora::StorageEngine::InsertRow(const std::string& key, Result& result) {
+    auto status = result.status();
+    if (!status.isOk() && !status.isNotFound()) return;
+    auto row = std::make_shared<std::string>(1, status.isOk() ? 1 : 0);
+    if (status.isOk()) row->append(result.data());
+    _options.row_cache->Insert(RowKey(key.data(), key.size()), std::move(row));
+}
+
+bool Kora::StorageEngine::FindMemtableVersions(const std::string& key, std::vector<std::string>& versions) {
+    // the search goes on past a version only while it is a merge record whose operands still need the older versions
+    // of the key
+    auto found = [&versions](const char* value, size_t size) {
+        versions.emplace_back(value, size);
+        return IsFinalVersion(versions.back());
+    };
+    // a range tombstone hides the versions in older memtables and segments, so it ends the search like a tombstone
+    auto covered = [&](const RangeTombstones& ranges) {
+        return ranges.Covers(key) && found(_TOMBSTONE_RECORD.data(), _TOMBSTONE_RECORD.size());
+    };
+    // memtables whose prefix filter rules out the prefix of key don't hold it
+    bool has_prefix = _options.prefix_extractor && _options.prefix_extractor->InDomain(key);
+    std::string_view prefix = has_prefix ? _options.prefix_extractor->Transform(key) : std::string_view();
+    Data key_view(const_cast<char*>(key.data()), key.size());
+    PERF_TIMER_GUARD(memtable_probe_nanos);
+    auto entry = MemtableMayHavePrefix(_memtable_prefix_filter, prefix, has_prefix) ? _memtable.find(key_view) : _memtable.end();
+    PERF_TIMER_STOP(memtable_probe_nanos);
+    bool done = (entry != _memtable.end() && found(entry->second.data(), entry->second.size())) || covered(_range_tombstones);
+
+    // memtables waiting to be flushed are newer than any segment, newest first
+    for (auto it = _immutable_memtables.rbegin(); !done && it != _immutable_memtables.rend(); ++it) {
+        PERF_TIMER_GUARD(memtable_probe_nanos);
+        auto immutable_entry = MemtableMayHavePrefix(it->prefix_filter, prefix, has_prefix) ? it->table.find(key_view) : it->table.end();
+        done = (immutable_entry != it->table.end() && found(immutable_entry->second.data(), immutable_entry->second.size())) ||
+               covered(it->range_tombstones);
+    }
+    return done;
+}
+
+void Kora::StorageEngine::FindVersions(const std::string& key, std::vector<std::string>& versions) {
+    bool done = FindMemtableVersions(key, versions);
+    _statistics.RecordTick(versions.empty() ? MEMTABLE_MISS : MEMTABLE_HIT);
+    if (!done) FindSegmentVersions(key, versions);
+}
+
+void Kora::StorageEngine::FindSegmentVersions(const std::string& key, std::vector<std::string>& versions) {
+    auto found = [&versions](const char* value, size_t size) {
+        versions.emplace_back(value, size);
+        return IsFinalVersion(versions.back());
+    };
+    auto covered = [&](const RangeTombstones& ranges) {
+        return ranges.Covers(key) && found(_TOMBSTONE_RECORD.data(), _TOMBSTONE_RECORD.size());
+    };
+
+    uint64_t segments_probed = 0;
+    for (auto& [number, filepath]: _sstables) {
+        ++segments_probed;
+        PERF_COUNTER_ADD(segments_probed, 1);
+        auto range_tombstones = _segment_range_tombstones.find(filepath);
+        bool has_ranges = range_tombstones != _segment_range_tombstones.end();
+        auto r = SearchSegment(key, filepath);
+        if (r.status().isOk() && found(r.data().data(), r.data().size())) break;
+        if (has_ranges && covered(range_tombstones->second.ranges)) break;
+    }
+    _statistics.RecordTick(SEGMENTS_PROBED, segments_probed);
+    _statistics.MeasureTime(GET_SEGMENTS_PROBED, segments_probed);
+}
+
+Kora::Status Kora::StorageEngine::ReadBlob(const BlobFiles& blob_files, const std::string& record, std::string& value) {
+    BlobIndex index;
+    if (!DecodeBlobRecord(record, index)) return Status::Corruption("Malformed blob record");
+    auto blob_file = blob_files.find(index.file_number);
+    if (blob_file == blob_files.end()) {
+        return Status::Corruption("Missing blob file " + std::to_string(index.file_number) + ".blob");
+    }
+    auto s = blob_file->second->Read(index, value);
+    if (s.isOk()) _statistics.RecordTick(BLOB_FILE_BYTES_READ, value.size());
+    return s;
 }
 
-Kora::Result Kora::StorageEngine::Search(const char* key, std::string filepath, size_t start_offset, size_t end_offset) {
+Kora::Result Kora::StorageEngine::Search(const std::string& key, std::string filepath, size_t start_offset, size_t end_offset) {
+    PERF_TIMER_GUARD(search_nanos);
     std::ifstream segment {filepath, std::ios::binary};
-    size_t key_size = 0, value_size = 0, total_size = 0, prev_total_size = 0, copy_range = 0, file_length = 0;
+    size_t key_size = 0, value_size = 0, total_size = start_offset, prev_total_size = 0, copy_range = 0, file_length = 0;
     std::string k, value;
     if (segment.good()) {
         segment.seekg(start_offset);
-        while (!segment.eof()) {
+        // the index of a segment that has one starts at end_offset, and would be read as records
+        while (total_size < end_offset && !segment.eof()) {
             segment.seekg(total_size);
             segment.read(reinterpret_cast<char*>(&key_size), sizeof key_size);
             total_size += sizeof key_size;
@@ -103,652 +542,1412 @@ Kora::Result Kora::StorageEngine::Search(const char* key, std::string filepath,
             segment.read(reinterpret_cast<char*>(&value_size), sizeof value_size);
             total_size += sizeof value_size;
 
+            if (key_size == PADDING_RECORD) {
+                total_size += value_size;
+                continue;
+            }
             k.resize(key_size);
             segment.read(&k[0],key_size);
             total_size += key_size;
             total_size += value_size;
+            PERF_COUNTER_ADD(block_read_count, 1);
+            PERF_COUNTER_ADD(block_read_byte, sizeof key_size + sizeof value_size + key_size);
 
             // don't bother comparing keys that are not of the same length
-            if (k.size() != strlen(key)) {
+            if (k.size() != key.size()) {
                 segment.get(); // let's know if we are at eof quick enough to avoid errors
                 continue;
             }
 
             // continue as long as we have not found the key
-            if (memcmp(k.data(), key, k.size()) != 0) {
+            if (memcmp(k.data(), key.data(), k.size()) != 0) {
                 segment.get(); // let's know if we are at eof quick enough to avoid errors
                 continue;
             }
 
             value.resize(value_size);
             segment.read(&value[0],value_size);
+            PERF_COUNTER_ADD(block_read_byte, value_size);
 
+            _statistics.RecordTick(SEGMENT_BYTES_READ, total_size);
             return Result( Kora::Status::OK(), std::move(value));
         }
+        _statistics.RecordTick(SEGMENT_BYTES_READ, total_size);
         Result r(Kora::Status::NotFound("Key not found"));
         return r;
     } else {
-        // TODO: How should I handle when file no good
+        return Result(Kora::Status::IoError("Unable to open segment " + filepath));
+    }
+}
+
+Kora::Result Kora::StorageEngine::SearchSegment(const std::string& key, const std::string& filepath) {
+    auto index = IndexOf(filepath);
+    if (!index || !index->HasIndex()) return Search(key, filepath, RangeTombstonesOf(filepath).data_offset, index ? index->DataEnd() : SIZE_MAX);
+
+    PERF_TIMER_GUARD(search_nanos);
+    BlockCache::Block block;
+    size_t entry_offset;
+    auto s = index->FindBlock(key, block, &entry_offset);
+    if (!s.isOk()) return Result(std::move(s));
+    if (!block) return Result(Kora::Status::NotFound("Key not found"));
+    // the block is a run of [key size][value size][key][value] records in key order. When the block hash index
+    // points at a record, no other record of the block can hold the key
+    bool single = entry_offset < block->size();
+    size_t pos = single ? entry_offset : 0, key_size, value_size;
+    while (block->size() - pos >= sizeof key_size + sizeof value_size) {
+        std::memcpy(&key_size, block->data() + pos, sizeof key_size);
+        std::memcpy(&value_size, block->data() + pos + sizeof key_size, sizeof value_size);
+        pos += sizeof key_size + sizeof value_size;
+        // padding only follows the last record of a block
+        if (key_size == PADDING_RECORD || block->size() - pos < key_size || block->size() - pos - key_size < value_size) break;
+        int diff = key.compare(0, std::string::npos, block->data() + pos, key_size);
+        if (diff == 0) return Result(Kora::Status::OK(), std::string(block->data() + pos + key_size, value_size));
+        if (diff < 0 || single) return Result(Kora::Status::NotFound("Key not found"));
+        pos += key_size + value_size;
     }
+    return Result(Kora::Status::NotFound("Key not found"));
 }
 
-Kora::Status Kora::StorageEngine::Delete(const Data&& key) {
+Kora::Status Kora::StorageEngine::Delete(const Data&& key, const WriteOptions& write_options, uint64_t* trace_sequence) {
     /**
      * Add a tombstone to the memtable and the logfile. During compaction, this will be used to delete the key-value entry
      */
+    StopWatch sw(_statistics, DELETE_MICROS);
     size_t key_size = key.size(), value_size = Kora::StorageEngine::_TOMBSTONE_RECORD.size();
-    char data[key_size + value_size];
+    DelayWrite(key_size);
+    std::unique_lock<std::mutex> ulock(_mutex, std::defer_lock);
     {
-        std::lock_guard<std::mutex> lg(_mutex);
-        _memtable.insert(std::make_pair(key, Data(Kora::StorageEngine::_TOMBSTONE_RECORD.data())));
-        strcpy(data, key.data());
-        strcpy(&data[key_size], Kora::StorageEngine::_TOMBSTONE_RECORD.data());
+        PERF_TIMER_GUARD(mutex_wait_nanos);
+        ulock.lock();
+    }
+    if (trace_sequence) *trace_sequence = TraceWriter::NextSequence();
+    AddToMemtable(key, Data(Kora::StorageEngine::_TOMBSTONE_RECORD.data()));
+    _memtableSize += _MEMTABLE_WRITE_CHARGE;
+    ulock.unlock();
+    LogData(key.data(), key_size, Kora::StorageEngine::_TOMBSTONE_RECORD.data(), value_size, write_options.sync);
+    _statistics.RecordTick(NUMBER_KEYS_DELETED);
+    _statistics.RecordTick(BYTES_WRITTEN, key_size);
+    {
+        PERF_TIMER_GUARD(mutex_wait_nanos);
+        ulock.lock();
     }
-    LogData(data, key_size, value_size);
+    if (MemtableFull()) SwitchMemtable(ulock, false);
     return {};
 }
 
-void Kora::StorageEngine::LogData(const char* data, size_t key_size, size_t value_size) {
-    auto path = Kora::getDBPath();
-    path /= "log.kdb";
-    std::ofstream logfile(path.string(), std::ios::binary | std::ios_base::app);
-    if (logfile.is_open()) {
-        logfile.write(reinterpret_cast<char*>(&key_size), sizeof(key_size));
-        logfile.write(reinterpret_cast<char*>(&value_size), sizeof(value_size));
-        logfile.write(data, strlen(data));
-        logfile.close();
+Kora::Status Kora::StorageEngine::Write(const WriteBatch& batch, const WriteOptions& write_options, uint64_t* trace_sequence) {
+    if (batch.Count() == 0) return {};
+    DelayWrite(batch.ByteSize());
+    {
+        auto ulock = LockForBatch();
+        if (trace_sequence) *trace_sequence = TraceWriter::NextSequence();
+        ApplyBatch(batch, write_options.sync);
     }
+    MaybeSwitchMemtable();
+    return {};
 }
 
-[[noreturn]] void Kora::StorageEngine::Write() {
-    while (true) {
-        std::unique_lock<std::mutex> ulock(_mutex);
-        _cond.wait(ulock, [this]{ return _memtable_is_full; });
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        auto path = Kora::getDBPath();
-        path /= now() + ".sst";
-        size_t total_size = 0;
-        std::map<std::string, size_t> hash_index;
-        // insert first entry into has index. We're starting from there
-        hash_index.insert(std::make_pair(std::string(_temp_memtable.begin()->first.data()), 0));
-
-        size_t starting_byte = 0;
-        int count = 0;
-        size_t key_size = _temp_memtable.begin()->first.size();
-        size_t value_size = _temp_memtable.begin()->second.size();
-        std::ofstream segment(path.string(), std::ios::binary);
-
-        // if first record has not been deleted and is not from the log file, write first entry to sstable since we will be moving the iterator by 1
-        size_t min_len = _temp_memtable.begin()->second.size() < Kora::StorageEngine::_TOMBSTONE_RECORD.size() ? _temp_memtable.begin()->second.size() : Kora::StorageEngine::_TOMBSTONE_RECORD.size();
-        if (memcmp(_temp_memtable.begin()->second.data(), Kora::StorageEngine::_TOMBSTONE_RECORD.data(),min_len) == 0) {
-            if (_update_is_from_logfile) { // even if entry is deleted as seen from log file, still write it so that the value in the SStable can be updated accordingly.
-                segment.write(reinterpret_cast<char*>(&key_size), sizeof(_temp_memtable.begin()->first.size()));
-                segment.write(reinterpret_cast<char*>(&value_size), sizeof(_temp_memtable.begin()->second.size()));
-                segment.write(_temp_memtable.begin()->first.data(), key_size);
-                segment.write(_temp_memtable.begin()->second.data(), value_size);
-                // set starting byte to beginning of second entry since we will insert the first entry beforehand. The reason for inserting the first entry before hand is because we are making it an index, hence to made it easier to index the other necessary keys, we are excluding it from the iteration.
-                starting_byte =  sizeof(size_t) + sizeof(size_t) + _temp_memtable.begin()->first.size() + _temp_memtable.begin()->second.size();
-            }
-        } else {
-            //write normally if it's not deleted
-            segment.write(reinterpret_cast<char*>(&key_size), sizeof(_temp_memtable.begin()->first.size()));
-            segment.write(reinterpret_cast<char*>(&value_size), sizeof(_temp_memtable.begin()->second.size()));
-            segment.write(_temp_memtable.begin()->first.data(), key_size);
-            segment.write(_temp_memtable.begin()->second.data(), value_size);
-            // set starting byte to beginning of second entry since we will insert the first entry beforehand. The reason for inserting the first entry before hand is because we are making it an index, hence to made it easier to index the other necessary keys, we are excluding it from the iteration.
-            starting_byte =  sizeof(size_t) + sizeof(size_t) + _temp_memtable.begin()->first.size() + _temp_memtable.begin()->second.size();
-        }
-
-        if (segment.is_open()) {
-            for(auto it = std::next(_temp_memtable.begin(), 1); it != _temp_memtable.end(); it++) {
-                auto key = it->first;
-                auto value = it->second;
-
-                // skip if record has been deleted and is not from the log file
-                min_len = value.size() < Kora::StorageEngine::_TOMBSTONE_RECORD.size() ? value.size() : Kora::StorageEngine::_TOMBSTONE_RECORD.size();
-                if (!_update_is_from_logfile && memcmp(value.data(), Kora::StorageEngine::_TOMBSTONE_RECORD.data(), min_len) == 0) continue;
-
-                total_size = sizeof key.data() + sizeof value.data() + key.size() + value.size();
-                count += total_size;
-                if (count >= _HASH_INDEX_INTERVAL) {
-                    hash_index.insert(std::make_pair(std::string(key.data()), (count - total_size) + starting_byte));
-                    starting_byte += count;
-                    count = 0;
-                }
-                key_size = key.size();
-                value_size = value.size();
-                segment.write(reinterpret_cast<char*>(&key_size), sizeof(key.size()));
-                segment.write(reinterpret_cast<char*>(&value_size), sizeof(value.size()));
-                segment.write(key.data(), key_size);
-                segment.write(value.data(), value_size);
+std::unique_lock<std::mutex> Kora::StorageEngine::LockForBatch() {
+    PERF_TIMER_GUARD(mutex_wait_nanos);
+    return std::unique_lock<std::mutex>(_mutex);
+}
+
+std::vector<const std::string*> Kora::StorageEngine::BatchValues(const WriteBatch& batch, std::deque<std::string>& encoded) {
+    // deletes are stored as tombstones, merges as merge records holding their one operand and range deletions as
+    // range tombstone records holding their one range
+    std::vector<const std::string*> values;
+    values.reserve(batch.Count());
+    for (const auto& op: batch.Ops()) {
+        switch (op.type) {
+            case WriteBatch::OpType::_DELETE:
+                values.push_back(&_TOMBSTONE_RECORD);
+                break;
+            case WriteBatch::OpType::_MERGE:
+                encoded.push_back(EncodeMergeRecord(_MERGE_PARTIAL, "", {op.value}));
+                values.push_back(&encoded.back());
+                break;
+            case WriteBatch::OpType::_DELETE_RANGE: {
+                RangeTombstones range;
+                range.Add(op.key, op.value);
+                encoded.push_back(range.Encode());
+                values.push_back(&encoded.back());
+                break;
             }
-            segment.close();
-            Kora::StorageEngine::StoreSegmentpath(getSegmentFileAsLong(path.filename()), path);
-        }
-        _temp_memtable.erase(_temp_memtable.begin(), _temp_memtable.end());
-        _hash_indexes.insert(std::make_pair(path, hash_index));
-        _done_writing = true;
-        _memtable_is_full = false;
-        _update_is_from_logfile = false;
-        ulock.unlock();
-        _cond.notify_one();
+            default:
+                values.push_back(&op.value);
+        }
     }
+    return values;
 }
 
-void Kora::StorageEngine::Compact() {
-    if (Kora::sstableCount() <= 1) return;
-    auto db_path = Kora::getDBPath();
-
-    while (Kora::sstableCount() >= 2) {
-
-        long int f1_time_created = 0; // time_t is alias for long int
-        long int f2_time_created = 0;
-        size_t key_size = 0, value_size = 0, total_size = 0, prev_total_size = 0, copy_range = 0, file_length = 0;
-        size_t key_size2 = 0, value_size2 = 0, total_size2 = 0, prev_total_size2 = 0, copy_range2 = 0, file_length2= 0;
-
-
-        auto compactible_files = L1CompactibleFiles();
-        if (compactible_files.size() < 2) {
-            compactible_files = L2CompactibleFiles();
-            if (compactible_files.size() < 2) compactible_files = L3CompactibleFiles();
-            if (compactible_files.size() < 2) compactible_files = L4CompactibleFiles();
-            if (compactible_files.size() < 2) break;
-        }
-
-        // initialize variables
-        std::string key, value, key2, value2;
-
-        // create new segment file
-        auto new_segment_path = Kora::getDBPath();
-        new_segment_path /= now() + ".sst";
-        std::ofstream new_segment{ new_segment_path, std::ios::binary};
-
-        // open the compactible files for reading
-        std::ifstream file1 {compactible_files[0].filepath.string(), std::ios::binary};
-        file_length = compactible_files[0].size;
-        std::ifstream file2 {compactible_files[1].filepath.string(), std::ios::binary};
-        file_length2 = compactible_files[1].size;
-
-        std::string f1_filename = compactible_files[0].filepath.filename();
-        f1_filename = f1_filename.substr(0, f1_filename.find_last_of('.'));
-        std::string f2_filename = compactible_files[1].filepath.filename();
-        f2_filename = f2_filename.substr(0, f2_filename.find_last_of('.'));
-        f1_time_created = std::stol(f1_filename, nullptr, 10); // nullptr because the entire string will consist of digits
-        f2_time_created = std::stol(f2_filename, nullptr, 10);
-
-        while(!file1.eof() && !file2.eof()) {
-            // prev_total_size will hold the next position to start reading the next record from
-            size_t f1_pos = file1.tellg();
-            size_t f2_pos = file2.tellg();
-
-            prev_total_size = total_size;
-            prev_total_size2 = total_size2;
-            file1.seekg(prev_total_size); file2.seekg(prev_total_size2);
-            file1.read(reinterpret_cast<char*>(&key_size), sizeof key_size);
-            total_size += sizeof key_size;
+void Kora::StorageEngine::ApplyBatch(const WriteBatch& batch, bool sync) {
+    LogBatch(batch, 0, sync);
+    InsertBatch(batch);
+}
 
-            file2.read(reinterpret_cast<char*>(&key_size2), sizeof key_size2);
-            total_size2 += sizeof key_size2;
+void Kora::StorageEngine::LogBatch(const WriteBatch& batch, uint64_t batch_id, bool sync) {
+    std::deque<std::string> encoded;
+    auto values = BatchValues(batch, encoded);
+    // the whole batch goes into the log file as a single record, so a crash in the middle of the append loses all of it
+    std::ostringstream contents;
+    contents.write(reinterpret_cast<const char*>(&batch_id), sizeof batch_id);
+    for (size_t i = 0; i < values.size(); i++) {
+        const auto& op = batch.Ops()[i];
+        const auto& key = op.type == WriteBatch::OpType::_DELETE_RANGE ? _RANGE_TOMBSTONE_RECORD : op.key;
+        WriteRecord(contents, key.data(), key.size(), values[i]->data(), values[i]->size());
+    }
+    auto record = contents.str();
+    // logged while holding _mutex so that the record lands in the log file of the memtable the batch goes into
+    LogData(_BATCH_RECORD.data(), _BATCH_RECORD.size(), record.data(), record.size(), sync);
+    if (batch_id != 0 && _memtable_first_batch == 0) _memtable_first_batch = batch_id;
+}
 
-            file1.read(reinterpret_cast<char*>(&value_size), sizeof value_size);
-            total_size += sizeof value_size;
+void Kora::StorageEngine::InsertBatch(const WriteBatch& batch) {
+    std::deque<std::string> encoded;
+    auto values = BatchValues(batch, encoded);
+    for (size_t i = 0; i < values.size(); i++) {
+        const auto& op = batch.Ops()[i];
+        if (op.type == WriteBatch::OpType::_DELETE_RANGE) {
+            AddRangeTombstone(op.key, op.value);
+            _memtableSize += _MEMTABLE_WRITE_CHARGE;
+            _statistics.RecordTick(NUMBER_RANGE_DELETES);
+            continue;
+        }
+        Data key_view(const_cast<char*>(op.key.data()), op.key.size());
+        Data value_view(const_cast<char*>(values[i]->data()), values[i]->size());
+        // the memtable keeps its own copies of the key and the value
+        AddToMemtable(key_view, value_view);
+        _memtableSize += _MEMTABLE_WRITE_CHARGE;
+        _statistics.RecordTick(op.type == WriteBatch::OpType::_DELETE ? NUMBER_KEYS_DELETED :
+                               op.type == WriteBatch::OpType::_MERGE ? NUMBER_MERGES : NUMBER_KEYS_WRITTEN);
+    }
+    _statistics.RecordTick(BYTES_WRITTEN, batch.ByteSize());
+}
 
-            file2.read(reinterpret_cast<char*>(&value_size2), sizeof value_size2);
-            total_size2 += sizeof value_size2;
+void Kora::StorageEngine::AddToMemtable(const Data& key, const Data& value) {
+    // the row of the key goes out of date once the memtable is flushed, and isn't looked at until then
+    if (_options.row_cache) _options.row_cache->Erase(RowKey(key.data(), key.size()));
+    std::string_view key_view(key.data(), key.size());
+    if (_options.prefix_extractor && _options.prefix_extractor->InDomain(key_view)) {
+        // the bits of the filter are allocated, and charged with the memtable, once the first prefix is added
+        if (_memtable_prefix_filter.Empty()) ChargeMemtable(0, _memtable_prefix_filter.Bytes());
+        _memtable_prefix_filter.AddKey(_options.prefix_extractor->Transform(key_view));
+    }
+    // keys written in increasing order go after the last entry, which takes neither a lookup nor a search of the tree
+    if (_memtable.empty() || _memtable.key_comp()(_memtable.rbegin()->first, key)) {
+        ChargeMemtable(0, key.size() + value.size() + _MEMTABLE_ENTRY_OVERHEAD);
+        _memtable.emplace_hint(_memtable.end(), key, Data(value));
+        _statistics.RecordTick(MEMTABLE_APPENDS);
+        return;
+    }
+    auto entry = _memtable.find(key);
+    if (entry == _memtable.end() || !IsMergeRecord(value.data(), value.size()) || value.data()[_MERGE_RECORD.size()] != _MERGE_PARTIAL) {
+        // insert_or_assign so that writing a key that is already in the memtable replaces its value. The memtable
+        // keeps its own copies of the key and the value
+        ChargeMemtable(entry == _memtable.end() ? 0 : key.size() + entry->second.size() + _MEMTABLE_ENTRY_OVERHEAD,
+                       key.size() + value.size() + _MEMTABLE_ENTRY_OVERHEAD);
+        _memtable.insert_or_assign(key, Data(value));
+        return;
+    }
+    // stack the new operands on the entry of the key. The merge operator only runs once the key is read or compacted
+    const Data& existing = entry->second;
+    std::string stacked;
+    if (IsMergeRecord(existing.data(), existing.size())) {
+        stacked.assign(existing.data(), existing.size());
+    } else if (existing.size() == _TOMBSTONE_RECORD.size() && memcmp(existing.data(), _TOMBSTONE_RECORD.data(), existing.size()) == 0) {
+        stacked = EncodeMergeRecord(_MERGE_ON_DELETED, "", {});
+    } else {
+        stacked = EncodeMergeRecord(_MERGE_ON_VALUE, std::string(existing.data(), existing.size()), {});
+    }
+    size_t header_size = _MERGE_RECORD.size() + 1;
+    stacked.append(value.data() + header_size, value.size() - header_size);
+    Data stacked_view(const_cast<char*>(stacked.data()), stacked.size());
+    ChargeMemtable(existing.size(), stacked.size());
+    entry->second = Data(stacked_view);
+}
 
-            key.resize(key_size);
-            file1.read(&key[0],key_size);
-            total_size += key_size;
+void Kora::StorageEngine::ChargeMemtable(size_t old_bytes, size_t new_bytes) {
+    _memtable_bytes = _memtable_bytes - old_bytes + new_bytes;
+    if (new_bytes > old_bytes) _options.memory_manager->Reserve(MemoryKind::_MEMTABLE, new_bytes - old_bytes);
+    else _options.memory_manager->Release(MemoryKind::_MEMTABLE, old_bytes - new_bytes);
+}
 
-            key2.resize(key_size2);
-            file2.read(&key2[0],key_size2);
-            total_size2 += key_size2;
+void Kora::StorageEngine::AddRangeTombstone(const std::string& begin, const std::string& end) {
+    if (!(begin < end)) return;
+    // entries of a memtable must be newer than its range tombstones, so the ones in the range go right away
+    Data begin_view(const_cast<char*>(begin.data()), begin.size());
+    Data end_view(const_cast<char*>(end.data()), end.size());
+    auto first = _memtable.lower_bound(begin_view), last = _memtable.lower_bound(end_view);
+    size_t erased_bytes = 0;
+    for (auto it = first; it != last; ++it) erased_bytes += it->first.size() + it->second.size() + _MEMTABLE_ENTRY_OVERHEAD;
+    ChargeMemtable(erased_bytes, begin.size() + end.size() + _MEMTABLE_ENTRY_OVERHEAD);
+    _memtable.erase(first, last);
+    _range_tombstones.Add(begin, end);
+    // the rows in the range can't be found by key, so every row of the engine is left behind to age out
+    if (_options.row_cache) _row_cache_id = BlockCache::NewCacheId();
+}
 
-            value.resize(value_size);
-            file1.read(&value[0],value_size);
-            total_size += value_size;
+void Kora::StorageEngine::ReplayRangeTombstones(const RangeTombstones& ranges) {
+    std::unique_lock<std::mutex> ulock(_mutex);
+    for (const auto& [begin, end]: ranges.Ranges()) {
+        AddRangeTombstone(begin, end);
+        _memtableSize += _MEMTABLE_WRITE_CHARGE;
+    }
+    if (MemtableFull()) SwitchMemtable(ulock, true);
+}
 
-            value2.resize(value_size2);
-            file2.read(&value2[0],value_size2);
-            total_size2 += value_size2;
-
-            int pos1 = file1.tellg();
-            int pos2 = file2.tellg();
-
-            auto diff = key.compare(key2);
-            file1.seekg(prev_total_size); // go to beginning of current record
-            file2.seekg(prev_total_size2);
-            copy_range2 = total_size2 - prev_total_size2;
-            copy_range = total_size - prev_total_size;
-            if (diff > 0) {
-                // key is greater than key2
-                if (value2.compare(Kora::StorageEngine::_TOMBSTONE_RECORD) == 0) {
-                    file1.close();
-                    file2.close();
-                    DiscardDeletedKey(key2, f2_time_created);
-                    file1.seekg(0);
-                    file2.seekg(0);
-                    total_size = 0, total_size2 = 0, prev_total_size2 = 0, prev_total_size = 0;
-                    file1 = std::ifstream {compactible_files[0].filepath.string(), std::ios::binary};
-                    file2 = std::ifstream  {compactible_files[1].filepath.string(), std::ios::binary};
-                    continue;
-                }
-                std::copy_n(std::istreambuf_iterator<char>(file2), copy_range2, std::ostreambuf_iterator<char>(new_segment));
-                size_t n_pos = new_segment.tellp();
-                file2.seekg(pos2);
-                total_size = prev_total_size;
-                file1.seekg(total_size);
-            }
-            else if (diff < 0) {
-                // key is less than key2
-                if (value.compare(Kora::StorageEngine::_TOMBSTONE_RECORD) == 0) {
-                    file1.close();
-                    file2.close();
-                    DiscardDeletedKey(key, f1_time_created);
-                    file1.seekg(0);
-                    file2.seekg(0);
-                    total_size = 0, total_size2 = 0, prev_total_size2 = 0, prev_total_size = 0;
-                    file1 = std::ifstream {compactible_files[0].filepath.string(), std::ios::binary};
-                    file2 = std::ifstream  {compactible_files[1].filepath.string(), std::ios::binary};
-                    continue;
-                }
-                std::copy_n(std::istreambuf_iterator<char>(file1), copy_range, std::ostreambuf_iterator<char>(new_segment));
-                file1.seekg(pos1);
-                total_size2 = prev_total_size2;
-                file2.seekg(total_size2);
-            }
-            else {
-                // they are equal
-                // pick the most recent
-                std::string f1_filename = compactible_files[0].filepath.filename();
-                f1_filename = f1_filename.substr(0, f1_filename.find_last_of('.'));
-                std::string f2_filename = compactible_files[1].filepath.filename();
-                f2_filename = f2_filename.substr(0, f2_filename.find_last_of('.'));
-                f1_time_created = std::stol(f1_filename, nullptr, 10); // nullptr because the entire string will consist of digits
-                f2_time_created = std::stol(f2_filename, nullptr, 10);
-                if (f1_time_created > f2_time_created) {
-                    if (value.compare(Kora::StorageEngine::_TOMBSTONE_RECORD) == 0) {
-                        file1.close();
-                        file2.close();
-                        DiscardDeletedKey(key, f1_time_created);
-                        file1.seekg(0);
-                        file2.seekg(0);
-                        total_size = 0, total_size2 = 0, prev_total_size2 = 0, prev_total_size = 0;
-                        file1 = std::ifstream {compactible_files[0].filepath.string(), std::ios::binary};
-                        file2 = std::ifstream  {compactible_files[1].filepath.string(), std::ios::binary};
-                        continue;
-                    }
-                    std::copy_n(std::istreambuf_iterator<char>(file1), copy_range, std::ostreambuf_iterator<char>(new_segment));
-                    file1.seekg(pos1);
-                    file2.seekg(total_size2);
-                }
-                else {
-                    if (value2.compare(Kora::StorageEngine::_TOMBSTONE_RECORD) == 0) {
-                        file1.close();
-                        file2.close();
-                        DiscardDeletedKey(key2, f2_time_created);
-                        file1.seekg(0);
-                        file2.seekg(0);
-                        total_size = 0, total_size2 = 0, prev_total_size2 = 0, prev_total_size = 0;
-                        file1 = std::ifstream {compactible_files[0].filepath.string(), std::ios::binary};
-                        file2 = std::ifstream  {compactible_files[1].filepath.string(), std::ios::binary};
-                        continue;
-                    }
-                    std::copy_n(std::istreambuf_iterator<char>(file2), copy_range2, std::ostreambuf_iterator<char>(new_segment));
-                    file2.seekg(pos2);
-//                    total_size = prev_total_size;
-                    file1.seekg(total_size);
-                }
+std::string Kora::StorageEngine::EncodeMergeRecord(char kind, const std::string& base, const std::vector<std::string>& operands) {
+    std::string record = _MERGE_RECORD;
+    record.push_back(kind);
+    auto append = [&record](const std::string& part) {
+        size_t size = part.size();
+        record.append(reinterpret_cast<const char*>(&size), sizeof size);
+        record.append(part);
+    };
+    if (kind == _MERGE_ON_VALUE) append(base);
+    for (const auto& operand: operands) append(operand);
+    return record;
+}
+
+bool Kora::StorageEngine::DecodeMergeRecord(const std::string& record, char& kind, std::string& base, std::vector<std::string>& operands) {
+    if (!IsMergeRecord(record)) return false;
+    size_t pos = _MERGE_RECORD.size();
+    kind = record[pos++];
+    auto read = [&record, &pos](std::string& part) {
+        size_t size = 0;
+        if (record.size() - pos < sizeof size) return false;
+        memcpy(&size, record.data() + pos, sizeof size);
+        pos += sizeof size;
+        if (record.size() - pos < size) return false;
+        part.assign(record, pos, size);
+        pos += size;
+        return true;
+    };
+    base.clear();
+    operands.clear();
+    if (kind == _MERGE_ON_VALUE) {
+        if (!read(base)) return false;
+    } else if (kind != _MERGE_PARTIAL && kind != _MERGE_ON_DELETED) {
+        return false;
+    }
+    while (pos < record.size()) {
+        operands.emplace_back();
+        if (!read(operands.back())) return false;
+    }
+    return true;
+}
+
+Kora::MergeResult Kora::StorageEngine::FoldVersions(const std::string& key, const std::vector<const std::string*>& versions, bool complete, std::string& result) {
+    const std::string& newest = *versions.front();
+    if (!IsMergeRecord(newest)) {
+        if (newest == _TOMBSTONE_RECORD) return MergeResult::_DELETED;
+        result = newest;
+        return MergeResult::_VALUE;
+    }
+    // gather the operands newest first, down to the version they apply to
+    char kind = _MERGE_PARTIAL;
+    std::string base;
+    std::vector<std::string> operands, record_operands;
+    for (const auto* version: versions) {
+        if (!IsMergeRecord(*version)) {
+            if (*version == _TOMBSTONE_RECORD) {
+                kind = _MERGE_ON_DELETED;
+            } else {
+                kind = _MERGE_ON_VALUE;
+                base = *version;
             }
-            // go to position total_size + 1
-            file1.get(); // do this so that eof can be set appropriately. see https://en.cppreference.com/w/cpp/io/basic_istream/get
-            file2.get();
+            break;
         }
-        // copy over any of the leftovers. This may copy over some deleted entries. it's no problem as deleted records are checked on Get() and such records would eventually be removed by compaction in the future.
-        if (!file1.eof()) {
-            file1.seekg(total_size); // because .get() has moved it one byte already
-            std::copy_n(std::istreambuf_iterator<char>(file1), file_length - total_size, std::ostreambuf_iterator<char>(new_segment));
+        if (!DecodeMergeRecord(*version, kind, base, record_operands)) {
+            _statistics.RecordTick(MERGE_FAILURES);
+            result = newest;
+            return MergeResult::_FAILED;
         }
-        if (!file2.eof()) {
-            file2.seekg(total_size2);  // because .get() has moved it one byte already
-            std::copy_n(std::istreambuf_iterator<char>(file2), file_length2 - total_size2, std::ostreambuf_iterator<char>(new_segment));
+        operands.insert(operands.end(), std::make_move_iterator(record_operands.rbegin()), std::make_move_iterator(record_operands.rend()));
+        if (kind != _MERGE_PARTIAL) break;
+    }
+    std::reverse(operands.begin(), operands.end());
+
+    if (_options.merge_operator && (complete || kind != _MERGE_PARTIAL)) {
+        _statistics.RecordTick(MERGE_OPERATIONS);
+        if (_options.merge_operator->FullMerge(key, kind == _MERGE_ON_VALUE ? &base : nullptr, operands, &result)) {
+            return MergeResult::_VALUE;
         }
-        new_segment.seekp(0);
-        new_segment.close();
-        // store new segment for easy retrieval
-        Kora::StorageEngine::StoreSegmentpath(getSegmentFileAsLong(new_segment_path.filename()), new_segment_path);
+        _statistics.RecordTick(MERGE_FAILURES);
+        result = EncodeMergeRecord(kind, base, operands);
+        return MergeResult::_FAILED;
+    }
+    result = EncodeMergeRecord(kind, base, operands);
+    return MergeResult::_OPERANDS;
+}
 
-        // delete all references to already compacted files
-        Kora::StorageEngine::DeleteSegmentpath(getSegmentFileAsLong(compactible_files[0].filepath.filename()));
-        fs::remove(compactible_files[0].filepath);
-        RemoveIndex(compactible_files[0].filepath);
-        Kora::StorageEngine::DeleteSegmentpath(getSegmentFileAsLong(compactible_files[1].filepath.filename()));
-        RemoveIndex(compactible_files[1].filepath);
-        fs::remove(compactible_files[1].filepath);
+void Kora::StorageEngine::MaybeSwitchMemtable() {
+    std::unique_lock<std::mutex> ulock(_mutex);
+    if (MemtableFull()) SwitchMemtable(ulock, false);
+}
 
-        // create index
-        CreateIndexFromCompactedSegment(new_segment_path.string());
+uint64_t Kora::StorageEngine::OldestLoggedBatch() {
+    std::lock_guard<std::mutex> lg(_mutex);
+    // batch ids only grow, so the first batch of the oldest log file holding any is the oldest
+    for (const auto& immutable: _immutable_memtables) {
+        if (immutable.first_batch != 0) return immutable.first_batch;
     }
+    return _memtable_first_batch;
 }
 
-void Kora::StorageEngine::CreateIndexFromCompactedSegment(std::string filepath) {
-    std::ifstream file1 {filepath, std::ios::binary};
+void Kora::StorageEngine::SealBatchesBefore(uint64_t batch_id) {
+    std::unique_lock<std::mutex> ulock(_mutex);
+    if (_memtable_first_batch != 0 && _memtable_first_batch < batch_id) SwitchMemtable(ulock, false, true);
+}
 
-    size_t key_size = 0, value_size = 0, count = 0, starting_byte = 0, prev_total_size = 0, first = 0;
+bool Kora::StorageEngine::MemtableMayHavePrefix(const DynamicBloom& filter, std::string_view prefix, bool use_filter) {
+    if (!use_filter || filter.Bytes() == 0) return true;
+    _statistics.RecordTick(PREFIX_FILTER_CHECKED);
+    if (filter.MayMatch(prefix)) return true;
+    _statistics.RecordTick(PREFIX_FILTER_USEFUL);
+    return false;
+}
 
-    std::string key, value, key2, value2;
+void Kora::StorageEngine::SnapshotChildren(std::vector<std::unique_ptr<Iterator>>& children, std::vector<RangeTombstones>& range_tombstones,
+                                           const std::string& prefix) {
+    // the filters only know the prefixes the extractor gives
+    bool use_filter = !prefix.empty() && _options.prefix_extractor && _options.prefix_extractor->IsPrefix(prefix);
+    Data prefix_view(const_cast<char*>(prefix.data()), prefix.size());
+    auto snapshot = [&](const Memtable& table, const DynamicBloom& filter) {
+        std::vector<std::pair<std::string, std::string>> entries;
+        auto first = table.begin(), last = table.end();
+        if (prefix.empty()) {
+            entries.reserve(table.size());
+        } else if (MemtableMayHavePrefix(filter, prefix, use_filter)) {
+            // the keys that start with prefix follow each other from the first key at or past it
+            first = last = table.lower_bound(prefix_view);
+            while (last != table.end() && last->first.size() >= prefix.size() && memcmp(last->first.data(), prefix.data(), prefix.size()) == 0) ++last;
+        } else {
+            first = last;
+        }
+        for (auto it = first; it != last; ++it) {
+            entries.emplace_back(std::string(it->first.data(), it->first.size()), std::string(it->second.data(), it->second.size()));
+        }
+        return std::make_unique<MemtableIterator>(std::move(entries), _options.memory_manager);
+    };
+    children.push_back(snapshot(_memtable, _memtable_prefix_filter));
+    range_tombstones.push_back(_range_tombstones);
+    for (auto it = _immutable_memtables.rbegin(); it != _immutable_memtables.rend(); ++it) {
+        children.push_back(snapshot(it->table, it->prefix_filter));
+        range_tombstones.push_back(it->range_tombstones);
+    }
+    for (const auto& [filename, filepath]: _sstables) {
+        auto segment_range_tombstones = RangeTombstonesOf(filepath);
+        auto index = IndexOf(filepath);
+        if (prefix.empty()) {
+            children.push_back(std::make_unique<SegmentIterator>(filepath, segment_range_tombstones.data_offset, index,
+                                                                 _options.memory_manager, _options.readahead_size));
+        } else if (!index || index->PrefixMayMatch(prefix, use_filter ? _options.prefix_extractor.get() : nullptr)) {
+            // bounded, so that the merge stops at the end of the prefix instead of stepping over the keys after it
+            children.push_back(std::make_unique<PrefixIterator>(
+                    std::make_unique<SegmentIterator>(filepath, segment_range_tombstones.data_offset, index, _options.memory_manager,
+                                                      _options.readahead_size), prefix));
+        } else if (!segment_range_tombstones.ranges.Empty()) {
+            // the range tombstones of a segment without the prefix still hide keys of older segments
+            children.push_back(std::make_unique<MemtableIterator>(std::vector<std::pair<std::string, std::string>>()));
+        } else {
+            continue;
+        }
+        range_tombstones.push_back(std::move(segment_range_tombstones.ranges));
+    }
+}
 
-    std::map<std::string, size_t> hash_index;
+std::unique_ptr<Kora::Iterator> Kora::StorageEngine::NewIterator(const ReadOptions& read_options) {
+    std::vector<std::unique_ptr<Iterator>> children;
+    auto range_tombstones = std::make_shared<std::vector<RangeTombstones>>();
+    std::lock_guard<std::mutex> lg(_mutex);
+    SnapshotChildren(children, *range_tombstones, read_options.prefix);
+    // every version of a key is in one of the children, so merge operands can always be applied. Keys that are
+    // deleted, or whose operands can't be applied, are left out. The iterator holds on to the blob files of the
+    // snapshot, so they stay readable even if garbage collection removes them in the meantime
+    std::vector<const std::string*> found;
+    std::deque<std::string> blob_values;
+    return std::make_unique<MergingIterator>(std::move(children), [this, range_tombstones, blob_files = _blob_files, found, blob_values](const std::string& key, const std::vector<const std::string*>& versions, std::string& value) mutable {
+        // the versions that matter, newest first, down to the first final one or the first range tombstone covering key
+        found.clear();
+        blob_values.clear();
+        for (size_t i = 0; i < versions.size(); i++) {
+            if (versions[i] != nullptr) {
+                found.push_back(versions[i]);
+                if (IsBlobRecord(*versions[i])) {
+                    // a value that can't be read is stepped over like a deleted key
+                    blob_values.emplace_back();
+                    if (!ReadBlob(blob_files, *versions[i], blob_values.back()).isOk()) return false;
+                    found.back() = &blob_values.back();
+                }
+                if (IsFinalVersion(*found.back())) break;
+            }
+            if ((*range_tombstones)[i].Covers(key)) {
+                found.push_back(&_TOMBSTONE_RECORD);
+                break;
+            }
+        }
+        return FoldVersions(key, found, true, value) == MergeResult::_VALUE;
+    });
+}
 
-    while(!file1.eof()) {
-        file1.seekg(prev_total_size);
-        size_t total_size = 0;
-        size_t f1_pos = file1.tellg();
+void Kora::StorageEngine::LogData(const char* key, size_t key_size, const char* value, size_t value_size, bool sync) {
+    StopWatch sw(_statistics, WAL_APPEND_MICROS);
+    PERF_TIMER_GUARD(wal_append_nanos);
+    // holding the log file keeps it from being recycled under us if the memtable is switched meanwhile
+    std::shared_ptr<LogWriter> log;
+    {
+        std::lock_guard<std::mutex> lg(_log_mutex);
+        log = _log;
+    }
+    if (!log || !log->AddRecord(key, key_size, value, value_size)) return;
+    PERF_TIMER_STOP(wal_append_nanos);
+    if (sync) {
+        PERF_TIMER_GUARD(wal_sync_nanos);
+        log->Sync();
+    }
+    _statistics.RecordTick(WAL_WRITES);
+    _statistics.RecordTick(WAL_BYTES, LogWriter::_RECORD_HEADER_SIZE + sizeof(key_size) + sizeof(value_size) + key_size + value_size);
+}
 
-        file1.read(reinterpret_cast<char*>(&key_size), sizeof key_size);
-        total_size += sizeof key_size;
+void Kora::StorageEngine::BackgroundFlush() {
+    std::unique_lock<std::mutex> ulock(_mutex);
+    // unflushed memtables are still in their log files and will be restored on the next start
+    while (!_immutable_memtables.empty() && !_shutting_down) {
+        // nothing touches the memtable at the front of the queue until it is popped, so it can be written out without the lock
+        ImmutableMemtable& immutable = _immutable_memtables.front();
+        ulock.unlock();
 
-        file1.read(reinterpret_cast<char*>(&value_size), sizeof value_size);
-        total_size += sizeof value_size;
+        StopWatch sw(_statistics, FLUSH_MICROS);
+        auto path = NewSegmentPath();
+        auto temp_path = path.string() + ".tmp";
+        SegmentRangeTombstones range_tombstones;
+        std::shared_ptr<BlobFile> blob_file;
+        bool written = WriteSegment(immutable.table, immutable.range_tombstones, temp_path, range_tombstones, blob_file);
 
-        key.resize(key_size);
-        file1.read(&key[0],key_size);
-        total_size += key_size;
+        ulock.lock();
+        if (!written && blob_file) blob_file->MarkObsolete();
+        if (!written && (!immutable.table.empty() || !immutable.range_tombstones.Empty())) {
+            // keep the memtable queued and try again in a bit rather than dropping records we only have in memory
+            std::cout << "Error writing segment " << path << "\n";
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            _cond.wait_for(ulock, std::chrono::seconds(1), [this] { return _shutting_down.load(); });
+            continue;
+        }
+        if (written) {
+            // the blob file goes in first, readers may look up its values as soon as the segment is in place
+            if (blob_file) _blob_files.emplace(blob_file->Number(), blob_file);
+            InstallSegment(temp_path, path, std::move(range_tombstones));
+            _statistics.RecordTick(FLUSH_COUNT);
+            _statistics.RecordTick(FLUSH_BYTES_WRITTEN, fs::file_size(path));
+            // the records are safely in a segment, so the log file that protected them can be reused. A writer that
+            // took it just before it was sealed may still be appending to it though, in which case it is removed
+            if (immutable.log && immutable.log.use_count() == 1) {
+                RecycleLogFile(immutable.log->Path(), immutable.log->Number());
+            } else if (immutable.log) {
+                std::error_code ec;
+                fs::remove(immutable.log->Path(), ec);
+            }
+        }
+        _options.memory_manager->Release(MemoryKind::_IMMUTABLE_MEMTABLE, immutable.bytes);
+        _immutable_memtables.pop_front();
+        UpdateWriteStallState();
+        // writers stopped on a full queue can go ahead
+        _cond.notify_all();
+    }
+    _flush_scheduled = false;
+    // notify while holding the lock: once it is released the destructor may already be tearing the engine down
+    _cond.notify_all();
+}
 
-        value.resize(value_size);
-        file1.read(&value[0],value_size);
-        total_size += value_size;
-        count += total_size;
+std::shared_ptr<Kora::LogWriter> Kora::StorageEngine::NewLogFile() {
+    auto path = _db_path / LogWriter::FileName(_log_number + 1);
+    // the blocks of a recycled file are already allocated. What it still holds carries an older log number and ends
+    // the replay of the new log, like the end of a new file does
+    bool recycled = false;
+    while (!recycled && !_recyclable_logs.empty()) {
+        std::error_code ec;
+        fs::rename(_recyclable_logs.front(), path, ec);
+        _recyclable_logs.pop_front();
+        recycled = !ec;
+    }
+    auto log = LogWriter::Open(path, _log_number + 1);
+    if (!log) {
+        std::cout << "Unable to open log file " << path << "\n";
+        return nullptr;
+    }
+    ++_log_number;
+    if (recycled) _statistics.RecordTick(WAL_FILES_RECYCLED);
+    return log;
+}
 
-        // index first entry
-        if (first == 0) {
-            hash_index.insert(std::make_pair(key,
-                                             starting_byte));
-            starting_byte += count;
-            prev_total_size = count;
-            count = 0;
-            ++first;
-            file1.get(); // do this so that eof can be set appropriately. see https://en.cppreference.com/w/cpp/io/basic_istream/get
-            continue;
+void Kora::StorageEngine::RecycleLogFile(const fs::path& path, uint64_t number) {
+    std::error_code ec;
+    if (_recyclable_logs.size() < _options.recycle_log_file_num) {
+        // renamed first, so that a restart doesn't take it for a log file to replay
+        auto recycle_path = _db_path / ("recycle_" + std::to_string(number) + ".kdb");
+        fs::rename(path, recycle_path, ec);
+        if (!ec) {
+            _recyclable_logs.push_back(recycle_path);
+            return;
         }
+    }
+    fs::remove(path, ec);
+}
+
+fs::path Kora::StorageEngine::NewSegmentPath() {
+    return _db_path / (std::to_string(++_file_number) + ".sst");
+}
+
+void Kora::StorageEngine::InstallSegment(const fs::path& temp_path, const fs::path& path, SegmentRangeTombstones&& range_tombstones) {
+    fs::rename(temp_path, path);
+    StoreSegmentpath(getSegmentFileAsLong(path.filename()), path);
+    _segment_indexes.insert_or_assign(path, SegmentIndex::Open(path, range_tombstones.data_offset, _options.block_cache, _options.memory_manager, &_statistics));
+    // a new segment, whose tier is that of its size
+    _segment_levels.erase(path);
+    if (range_tombstones.ranges.Empty()) _segment_range_tombstones.erase(path);
+    else _segment_range_tombstones.insert_or_assign(path, std::move(range_tombstones));
+}
 
-        // index next x byte/kb
-        if (count >= 50) {
-            hash_index.insert(std::make_pair(key, starting_byte));
-            prev_total_size += total_size;
-            starting_byte += total_size;
-            count = 0;
-            file1.get(); // do this so that eof can be set appropriately. see https://en.cppreference.com/w/cpp/io/basic_istream/get
+bool Kora::StorageEngine::WriteSegment(const Memtable& memtable, const RangeTombstones& ranges, const fs::path& path,
+                                       SegmentRangeTombstones& range_tombstones, std::shared_ptr<BlobFile>& blob_file) {
+    if (memtable.empty() && ranges.Empty()) return false;
+    DirectWritableFile segment(path, _options.use_direct_io_for_flush_and_compaction);
+    if (!segment.is_open()) return false;
+
+    // large values go to a blob file of their own, which is in place before the segment referring to it is installed
+    std::unique_ptr<BlobFileWriter> blob_writer;
+    uint64_t blob_number = 0;
+    std::string blob_record;
+    auto separate = [&](const Data& key, const Data& value) {
+        if (_options.min_blob_size == 0 || value.size() < _options.min_blob_size) return false;
+        std::string_view view(value.data(), value.size());
+        if (view == _TOMBSTONE_RECORD || IsMergeRecord(value.data(), value.size()) || view.substr(0, _BLOB_RECORD.size()) == _BLOB_RECORD) return false;
+        if (!blob_writer) {
+            blob_number = ++_file_number;
+            blob_writer = std::make_unique<BlobFileWriter>(_db_path / (std::to_string(blob_number) + ".blob"), blob_number,
+                                                           _options.use_direct_io_for_flush_and_compaction);
+        }
+        BlobIndex index;
+        blob_writer->Add(key.data(), key.size(), value.data(), value.size(), index);
+        blob_record = EncodeBlobRecord(index);
+        return true;
+    };
+
+    range_tombstones.ranges = ranges;
+    range_tombstones.data_offset = WriteRangeTombstones(segment, ranges);
+    // tombstones are written too so that they keep hiding older versions of their keys until compaction removes them
+    auto index_builder = NewIndexBuilder(range_tombstones.data_offset);
+    for (const auto& [key, value]: memtable) {
+        if (separate(key, value)) {
+            WriteRecord(segment, key.data(), key.size(), blob_record.data(), blob_record.size());
+            index_builder.Add(key.data(), key.size(), sizeof(size_t) + sizeof(size_t) + key.size() + blob_record.size());
             continue;
         }
-        // go to position total_size + 1
-        file1.get(); // do this so that eof can be set appropriately. see https://en.cppreference.com/w/cpp/io/basic_istream/get
-        starting_byte += count;
-        prev_total_size += count;
+        WriteRecord(segment, key.data(), key.size(), value.data(), value.size());
+        index_builder.Add(key.data(), key.size(), sizeof(size_t) + sizeof(size_t) + key.size() + value.size());
+    }
+    index_builder.Finish(segment);
+    segment.close();
+    if (_options.use_direct_io_for_flush_and_compaction && !segment.UsingDirectIO()) _statistics.RecordTick(DIRECT_IO_FALLBACKS);
+    if (blob_writer) {
+        uint64_t blob_bytes = blob_writer->Size();
+        bool blob_written = blob_writer->Finish();
+        blob_file = std::make_shared<BlobFile>(_db_path / (std::to_string(blob_number) + ".blob"), blob_number);
+        // every value in a new blob file is live
+        blob_file->AddLiveBytes(blob_bytes);
+        if (!blob_written) return false;
+        _statistics.RecordTick(BLOB_FILE_BYTES_WRITTEN, blob_bytes);
     }
-    _hash_indexes.insert(std::make_pair(filepath, hash_index));
+    return !segment.fail();
 }
 
-std::vector<Kora::CompactibleObject> Kora::StorageEngine::L1CompactibleFiles() {
-    auto db_path = Kora::getDBPath();
-    std::vector<Kora::CompactibleObject> result;
-    short int file_count = 0;
-    uintmax_t total_size = 0;
-    for (auto const& dir_entry: fs::directory_iterator{db_path}) {
-        if (dir_entry.exists() && dir_entry.is_regular_file()) {
-            auto ext = dir_entry.path().extension().string();
-            if (ext == ".sst") {
-                if (dir_entry.file_size() >= _MAX_MEMTABLE_SIZE && dir_entry.file_size() <= _MAX_LEVEL1_SIZE) {
-                    if (file_count == 0) {
-                        CompactibleObject cobj = {dir_entry.path().string(), dir_entry.file_size()};
-                        total_size = cobj.size;
-                        result.push_back(cobj);
-                        ++file_count;
-                    } else {
-                        CompactibleObject cobj = {dir_entry.path().string(), dir_entry.file_size()};
-                        if (std::find(result.begin(), result.end(), cobj) != result.end()) continue;
-                        result.push_back(cobj);
-                        ++file_count;
-                        break;
-                    }
-                }
-            } else continue;
+bool Kora::StorageEngine::MovableInputs(const CompactionInputs& inputs) const {
+    // the compaction filter has to see every value, range tombstones may hide records of the other input, and with
+    // nothing older left tombstones are dropped
+    if (_options.compaction_filter || inputs.bottommost || !inputs.newer_ranges.ranges.Empty() || !inputs.older_ranges.ranges.Empty()) {
+        return false;
+    }
+    for (const auto& index: {inputs.newer_index, inputs.older_index}) {
+        if (!index || !index->HasIndex() || index->NumPartitions() == 0) return false;
+    }
+    // an unknown smallest key is empty, and never lets a range pass for one that doesn't overlap. Both inputs have
+    // partitions, so their largest keys are known
+    return inputs.newer_index->LargestKey() < inputs.older_index->SmallestKey() ||
+           inputs.older_index->LargestKey() < inputs.newer_index->SmallestKey();
+}
+
+void Kora::StorageEngine::Compact() {
+    while (!_shutting_down) {
+        // start with the smallest segments, they are the cheapest to merge
+        std::vector<CompactibleObject> compactible_files;
+        int level = 1;
+        for (; level <= 4; level++) {
+            compactible_files = CompactibleFiles(level);
+            if (compactible_files.size() >= 2) break;
+        }
+        if (compactible_files.size() < 2) break;
+
+        const auto& newer = compactible_files[0];
+        const auto& older = compactible_files[1];
+        long older_number = getSegmentFileAsLong(older.filepath.filename());
+        CompactionInputs inputs{newer, older};
+        {
+            std::lock_guard<std::mutex> lg(_mutex);
+            inputs.bottommost = _sstables.rbegin()->first == older_number;
+            inputs.newer_ranges = RangeTombstonesOf(newer.filepath);
+            inputs.older_ranges = RangeTombstonesOf(older.filepath);
+            inputs.blob_files = _blob_files;
+            inputs.newer_index = IndexOf(newer.filepath);
+            inputs.older_index = IndexOf(older.filepath);
+            if (inputs.newer_index) inputs.newer_end = inputs.newer_index->DataEnd();
+            if (inputs.older_index) inputs.older_end = inputs.older_index->DataEnd();
+        }
+
+        if (MovableInputs(inputs)) {
+            // merging would write the same records again, so both inputs stay as they are and only move up a tier,
+            // where they are picked with their new neighbours. Their age order doesn't matter as no key is in both
+            std::lock_guard<std::mutex> lg(_mutex);
+            _segment_levels[newer.filepath] = level + 1;
+            _segment_levels[older.filepath] = level + 1;
+            _statistics.RecordTick(COMPACT_TRIVIAL_MOVES);
+            continue;
         }
+        StopWatch sw(_statistics, COMPACTION_MICROS);
+
+        // the new segment takes the place of the older input. It is written under a temporary name so that nothing
+        // picks it up half written
+        fs::path temp_segment_path = older.filepath.string() + ".tmp";
+
+        // the range tombstones of both inputs go on hiding the segments older than them, unless there are none
+        SegmentRangeTombstones output_ranges;
+        if (!inputs.bottommost) {
+            output_ranges.ranges.Add(inputs.newer_ranges.ranges);
+            output_ranges.ranges.Add(inputs.older_ranges.ranges);
+        }
+        // bytes of the blob values whose references are left out of the new segment, by blob file
+        std::map<uint64_t, uint64_t> dropped_blob_bytes;
+
+        auto boundaries = SubcompactionBoundaries(inputs);
+        if (boundaries.empty() ||
+            !MergeSubcompactions(inputs, boundaries, temp_segment_path, output_ranges, dropped_blob_bytes)) {
+            dropped_blob_bytes.clear();
+            // with direct I/O neither the inputs nor the output pass through the page cache, so a large compaction
+            // leaves the pages reads are using where they are. The inputs are read and the output written on threads
+            // of their own, so the disk works while this thread merges
+            AsyncWritableFile new_segment{temp_segment_path, _options.use_direct_io_for_flush_and_compaction};
+            output_ranges.data_offset = WriteRangeTombstones(new_segment, output_ranges.ranges);
+            auto index_builder = NewIndexBuilder(output_ranges.data_offset);
+            MergeInputs(inputs, "", "", new_segment, index_builder, dropped_blob_bytes);
+            index_builder.Finish(new_segment);
+            new_segment.close();
+            _statistics.RecordTick(COMPACT_WRITE_STAGE_MICROS, new_segment.BusyMicros());
+            if (_options.use_direct_io_for_flush_and_compaction && !new_segment.UsingDirectIO()) _statistics.RecordTick(DIRECT_IO_FALLBACKS);
+            if (new_segment.fail()) {
+                std::cout << "Error writing segment " << temp_segment_path << "\n";
+                fs::remove(temp_segment_path);
+                break;
+            }
+        }
+        _statistics.RecordTick(COMPACTION_COUNT);
+        _statistics.RecordTick(COMPACT_READ_BYTES, newer.size + older.size);
+        std::error_code ec;
+        _statistics.RecordTick(COMPACT_WRITE_BYTES, SegmentSize(temp_segment_path, ec));
+
+        if (fs::file_size(temp_segment_path) == 0) {
+            // every record was a tombstone or hidden by one and no range tombstones are left, so neither input needs
+            // replacing
+            std::lock_guard<std::mutex> lg(_mutex);
+            fs::remove(temp_segment_path);
+            DropBlobReferences(dropped_blob_bytes);
+            if (_options.compaction_filter) _row_cache_id = BlockCache::NewCacheId();
+            for (const auto& compacted: compactible_files) RemoveSegment(compacted.filepath);
+            continue;
+        }
+
+        // swap the compacted files for the new segment in one step as far as readers are concerned. The older input
+        // is replaced first: if we crash before the newer one is removed, it only holds records that are also in the
+        // new segment
+        std::lock_guard<std::mutex> lg(_mutex);
+        // store new segment for easy retrieval
+        InstallSegment(temp_segment_path, older.filepath, std::move(output_ranges));
+        DropBlobReferences(dropped_blob_bytes);
+        // rows of the values the compaction filter removed or changed are out of date, and there is no telling which
+        if (_options.compaction_filter) _row_cache_id = BlockCache::NewCacheId();
+
+        // delete all references to already compacted files
+        RemoveSegment(newer.filepath);
     }
-    return result;
 }
 
-std::vector<Kora::CompactibleObject> Kora::StorageEngine::L2CompactibleFiles() {
-    auto db_path = Kora::getDBPath();
-    std::vector<Kora::CompactibleObject> result;
-    short int file_count = 0;
-    for (auto const& dir_entry: fs::directory_iterator{db_path}) {
-        if (dir_entry.exists() && dir_entry.is_regular_file()) {
-            auto ext = dir_entry.path().extension().string();
-            if (ext == ".sst") {
-                if (dir_entry.file_size() >= _MAX_LEVEL1_SIZE + 1 && dir_entry.file_size() <= _MAX_LEVEL2_SIZE) {
-                    if (file_count == 0) {
-                        CompactibleObject cobj = {dir_entry.path().string(), dir_entry.file_size()};
-                        result.push_back(cobj);
-                        ++file_count;
-                    } else {
-                        CompactibleObject cobj = {dir_entry.path().string(), dir_entry.file_size()};
-                        if (std::find(result.begin(), result.end(), cobj) != result.end()) continue;
-                        result.push_back(cobj);
-                        ++file_count;
-                        break;
-                    }
-                }
-            } else continue;
+std::vector<std::string> Kora::StorageEngine::SubcompactionBoundaries(const CompactionInputs& inputs) const {
+    std::vector<std::string> boundaries;
+    if (_options.max_subcompactions <= 1 || SegmentLevel(inputs.older.size) < 4 || !inputs.newer_index ||
+        !inputs.older_index || !inputs.newer_index->HasIndex() || !inputs.older_index->HasIndex()) {
+        return boundaries;
+    }
+    // each index partition covers about the same number of data blocks, so spreading the partitions of both inputs
+    // evenly over the key ranges spreads their bytes too
+    auto keys = inputs.newer_index->PartitionKeys();
+    auto older_keys = inputs.older_index->PartitionKeys();
+    keys.insert(keys.end(), older_keys.begin(), older_keys.end());
+    std::sort(keys.begin(), keys.end());
+    size_t num_ranges = std::min<size_t>(_options.max_subcompactions, keys.size());
+    for (size_t i = 1; i < num_ranges; i++) {
+        const auto& key = keys[i * keys.size() / num_ranges];
+        if (boundaries.empty() || boundaries.back() < key) boundaries.push_back(key);
+    }
+    return boundaries;
+}
+
+bool Kora::StorageEngine::MergeSubcompactions(const CompactionInputs& inputs, const std::vector<std::string>& boundaries,
+                                              const fs::path& path, SegmentRangeTombstones& output_ranges,
+                                              std::map<uint64_t, uint64_t>& dropped_blob_bytes) {
+    size_t num_ranges = boundaries.size() + 1;
+    std::error_code ec;
+    fs::remove(path, ec);
+    std::vector<std::unique_ptr<AsyncWritableFile>> outputs;
+    outputs.push_back(std::make_unique<AsyncWritableFile>(path, _options.use_direct_io_for_flush_and_compaction, 0));
+    if (outputs[0]->fail()) return false;
+    output_ranges.data_offset = WriteRangeTombstones(*outputs[0], output_ranges.ranges);
+    // regions start on blocks of the filesystem, so that direct I/O can write them and the gaps between them can be
+    // cut out of the file
+    struct stat st{};
+    uint64_t alignment = ::stat(path.c_str(), &st) == 0 && st.st_blksize > 0 ? std::max<uint64_t>(st.st_blksize, 4096) : 4096;
+
+    // a range reads the blocks of each input from the one its first key is in to the one its last key is in. It
+    // writes no more than that unless the compaction filter or merge operator make values larger, or small values
+    // become tombstones, so twice that leaves plenty of room. A range that outgrows its region anyway overwrites the
+    // start of the next one, and the compaction is merged again on one thread
+    std::vector<FileRegion> regions(num_ranges);
+    uint64_t end = output_ranges.data_offset;
+    for (size_t i = 0; i < num_ranges; i++) {
+        const std::string& begin = i == 0 ? "" : boundaries[i - 1];
+        const std::string& last = i < boundaries.size() ? boundaries[i] : "";
+        uint64_t range_bytes = inputs.newer_index->DataBytes(begin, last) + inputs.older_index->DataBytes(begin, last) +
+                               2 * _options.block_size;
+        if (i > 0) {
+            regions[i].start = (end + PADDING_HEADER_SIZE + alignment - 1) / alignment * alignment;
+            outputs.push_back(std::make_unique<AsyncWritableFile>(path, _options.use_direct_io_for_flush_and_compaction, regions[i].start));
+            if (outputs[i]->fail()) return false;
         }
+        end = std::max<uint64_t>(regions[i].start, output_ranges.data_offset) + 2 * range_bytes;
     }
-    return result;
+
+    // the first range goes after the range tombstones, the others into regions of their own with an index of their
+    // own, which is appended to that of the first
+    auto index_builder = NewIndexBuilder(output_ranges.data_offset);
+    std::vector<SegmentIndexBuilder> part_builders;
+    for (size_t i = 1; i < num_ranges; i++) part_builders.push_back(NewIndexBuilder(0));
+    std::vector<std::map<uint64_t, uint64_t>> range_dropped_blob_bytes(num_ranges);
+    auto merge_range = [&](size_t i) {
+        MergeInputs(inputs, i == 0 ? "" : boundaries[i - 1], i < boundaries.size() ? boundaries[i] : "", *outputs[i],
+                    i == 0 ? index_builder : part_builders[i - 1], range_dropped_blob_bytes[i]);
+        outputs[i]->close();
+    };
+    // the ranges are handed out one at a time to the compaction pool and to this thread, which takes on whatever
+    // range no pool thread has picked up, so the compaction never waits on a range that hasn't started and the pool
+    // stays the only source of compaction threads. A pool thread that turns up once every range is taken only
+    // touches state, which outlives this compaction
+    struct RangeState {
+        std::atomic<size_t> next{0};
+        size_t done = 0;
+        std::mutex mutex;
+        std::condition_variable cond;
+    };
+    auto state = std::make_shared<RangeState>();
+    auto merge_ranges = [state, num_ranges, merge_range] {
+        for (size_t i = state->next++; i < num_ranges; i = state->next++) {
+            merge_range(i);
+            std::lock_guard<std::mutex> lg(state->mutex);
+            if (++state->done == num_ranges) state->cond.notify_all();
+        }
+    };
+    for (size_t i = 1; i < num_ranges; i++) ThreadPool::Default(JobPriority::_LOW).Schedule(merge_ranges);
+    merge_ranges();
+    {
+        std::unique_lock<std::mutex> lk(state->mutex);
+        state->cond.wait(lk, [&state, num_ranges] { return state->done == num_ranges; });
+    }
+    _statistics.RecordTick(SUBCOMPACTIONS, num_ranges);
+
+    bool ok = true;
+    for (const auto& output: outputs) {
+        ok = ok && !output->fail();
+        _statistics.RecordTick(COMPACT_WRITE_STAGE_MICROS, output->BusyMicros());
+        if (_options.use_direct_io_for_flush_and_compaction && !output->UsingDirectIO()) _statistics.RecordTick(DIRECT_IO_FALLBACKS);
+    }
+    // ranges without records at the end are left out, and every other range has to leave room for the padding
+    // record after it
+    regions[0].end = index_builder.Offset();
+    size_t num_regions = 1;
+    for (size_t i = 1; i < num_ranges; i++) {
+        regions[i].end = regions[i].start + part_builders[i - 1].Offset();
+        if (regions[i - 1].end + PADDING_HEADER_SIZE > regions[i].start) ok = false;
+        if (regions[i].end > regions[i].start) num_regions = i + 1;
+    }
+    regions.resize(num_regions);
+    if (!ok || !JoinFileRegions(path, regions, alignment)) {
+        fs::remove(path, ec);
+        return false;
+    }
+    for (size_t i = 1; i < num_regions; i++) index_builder.Append(std::move(part_builders[i - 1]), regions[i].start);
+    for (const auto& range_dropped: range_dropped_blob_bytes) {
+        for (const auto& [number, bytes]: range_dropped) dropped_blob_bytes[number] += bytes;
+    }
+    std::ofstream index_file(path, std::ios::binary | std::ios::app);
+    index_builder.Finish(index_file);
+    index_file.close();
+    if (index_file.fail()) {
+        fs::remove(path, ec);
+        return false;
+    }
+    return true;
 }
 
-std::vector<Kora::CompactibleObject> Kora::StorageEngine::L3CompactibleFiles() {
-    auto db_path = Kora::getDBPath();
-    std::vector<Kora::CompactibleObject> result;
-    short int file_count = 0;
-    for (auto const& dir_entry: fs::directory_iterator{db_path}) {
-        if (dir_entry.exists() && dir_entry.is_regular_file()) {
-            auto ext = dir_entry.path().extension().string();
-            if (ext == ".sst") {
-                if (dir_entry.file_size() >= _MAX_LEVEL2_SIZE + 1 && dir_entry.file_size() <= _MAX_LEVEL3_SIZE) {
-                    if (file_count == 0) {
-                        CompactibleObject cobj = {dir_entry.path().string(), dir_entry.file_size()};
-                        result.push_back(cobj);
-                        ++file_count;
-                    } else {
-                        CompactibleObject cobj = {dir_entry.path().string(), dir_entry.file_size()};
-                        if (std::find(result.begin(), result.end(), cobj) != result.end()) continue;
-                        result.push_back(cobj);
-                        ++file_count;
-                        break;
-                    }
-                }
-            } else continue;
+void Kora::StorageEngine::MergeInputs(const CompactionInputs& inputs, const std::string& begin, const std::string& end,
+                                      AsyncWritableFile& output, SegmentIndexBuilder& index_builder,
+                                      std::map<uint64_t, uint64_t>& dropped_blob_bytes) {
+    uint64_t merge_start = nowMicros();
+    uint64_t output_wait = output.WaitMicros();
+    // a key range starts at the first data block of each input that reaches it
+    uint64_t newer_start = inputs.newer_ranges.data_offset, older_start = inputs.older_ranges.data_offset;
+    if (!begin.empty() && inputs.newer_index) newer_start = inputs.newer_index->SeekOffset(begin);
+    if (!begin.empty() && inputs.older_index) older_start = inputs.older_index->SeekOffset(begin);
+    PrefetchingSegmentReader input1{inputs.newer.filepath, newer_start, inputs.newer_end, _options.readahead_size,
+                                    _options.use_direct_reads_for_compaction};
+    PrefetchingSegmentReader input2{inputs.older.filepath, older_start, inputs.older_end, _options.readahead_size,
+                                    _options.use_direct_reads_for_compaction};
+    auto next = [&](PrefetchingSegmentReader& input) {
+        while (input.Next()) {
+            if (input.key() < begin) continue;
+            return end.empty() || input.key() < end;
+        }
+        return false;
+    };
+    bool bottommost = inputs.bottommost;
+
+    // only references to large values are copied, the values stay where they are in their blob files. Values the
+    // compaction filter removes become tombstones
+    const std::string* kept = nullptr;
+    std::string filtered;
+    auto keep = [&](const std::string& key, const std::string& value) {
+        const std::string& record = _options.compaction_filter ? FilterValue(inputs.blob_files, key, value, filtered) : value;
+        if (bottommost && record == Kora::StorageEngine::_TOMBSTONE_RECORD) {
+            if (&record == &value) _statistics.RecordTick(COMPACT_TOMBSTONES_DROPPED);
+            return;
+        }
+        WriteRecord(output, key.data(), key.size(), record.data(), record.size());
+        index_builder.Add(key.data(), key.size(), sizeof(size_t) + sizeof(size_t) + key.size() + record.size());
+        kept = &record;
+    };
+    auto drop_blob = [&](const std::string& key, const std::string& value) {
+        BlobIndex index;
+        if (kept != &value && DecodeBlobRecord(value, index)) dropped_blob_bytes[index.file_number] += index.RecordSize(key.size());
+    };
+
+    // both segments are sorted, so merge them in one pass. When both hold a key, the newer record wins unless it
+    // holds merge operands, which are folded into the older record. Older records in the ranges deleted by the
+    // newer segment are dropped
+    std::string folded, blob_value;
+    std::vector<const std::string*> versions;
+    bool has1 = next(input1);
+    bool has2 = next(input2);
+    while (has1 || has2) {
+        int diff = !has1 ? 1 : !has2 ? -1 : input1.key().compare(input2.key());
+        const std::string& key = diff <= 0 ? input1.key() : input2.key();
+        kept = nullptr;
+        versions.clear();
+        if (diff <= 0) versions.push_back(&input1.value());
+        if ((diff > 0 || !IsFinalVersion(input1.value())) && inputs.newer_ranges.ranges.Covers(key)) {
+            if (diff >= 0) _statistics.RecordTick(COMPACT_RANGE_DELETED_KEYS);
+            versions.push_back(&_TOMBSTONE_RECORD);
+        } else if (diff >= 0) {
+            versions.push_back(&input2.value());
+        }
+        if (versions.front() == &_TOMBSTONE_RECORD) {
+            // only an older record hidden by a range tombstone
+        } else if (IsMergeRecord(*versions.front()) && (versions.size() > 1 || bottommost)) {
+            // operands applying to a value in a blob file need the value itself. It can only be missing if garbage
+            // collection found the key overwritten, in which case the operands have nothing to apply to either
+            if (versions.size() > 1 && IsBlobRecord(*versions[1])) {
+                if (ReadBlob(inputs.blob_files, *versions[1], blob_value).isOk()) versions[1] = &blob_value;
+                else versions.pop_back();
+            }
+            // operands that can't be applied yet are kept as one merge record
+            FoldVersions(key, versions, bottommost, folded);
+            keep(key, folded);
+        } else {
+            if (versions.size() > 1) _statistics.RecordTick(COMPACT_KEYS_DROPPED);
+            keep(key, *versions.front());
         }
+        if (diff <= 0) drop_blob(key, input1.value());
+        if (diff >= 0) drop_blob(key, input2.value());
+        if (diff <= 0) has1 = next(input1);
+        if (diff >= 0) has2 = next(input2);
     }
-    return result;
+    _statistics.RecordTick(COMPACT_MERGE_STAGE_MICROS, nowMicros() - merge_start - input1.WaitMicros() - input2.WaitMicros() -
+                                                       (output.WaitMicros() - output_wait));
+    _statistics.RecordTick(COMPACT_READ_STAGE_MICROS, input1.BusyMicros() + input2.BusyMicros());
+}
+
+size_t Kora::StorageEngine::WriteRangeTombstones(std::ostream& file, const RangeTombstones& ranges) {
+    if (ranges.Empty()) return 0;
+    auto encoded = ranges.Encode();
+    WriteRecord(file, _RANGE_TOMBSTONE_RECORD.data(), _RANGE_TOMBSTONE_RECORD.size(), encoded.data(), encoded.size());
+    return sizeof(size_t) + sizeof(size_t) + _RANGE_TOMBSTONE_RECORD.size() + encoded.size();
+}
+
+size_t Kora::StorageEngine::ReadRangeTombstones(std::istream& file, RangeTombstones& ranges) {
+    std::string key, value;
+    if (ReadRecord(file, key, value) && key == _RANGE_TOMBSTONE_RECORD && ranges.Decode(value)) {
+        return sizeof(size_t) + sizeof(size_t) + key.size() + value.size();
+    }
+    // segments without range tombstones start right away with their key-value records
+    ranges = RangeTombstones();
+    file.clear();
+    file.seekg(0);
+    return 0;
 }
 
-std::vector<Kora::CompactibleObject> Kora::StorageEngine::L4CompactibleFiles() {
-    auto db_path = Kora::getDBPath();
+bool Kora::StorageEngine::ReadRecord(std::istream& file, std::string& key, std::string& value) {
+    size_t key_size = 0, value_size = 0;
+    if (!file.read(reinterpret_cast<char*>(&key_size), sizeof key_size)) return false;
+    if (!file.read(reinterpret_cast<char*>(&value_size), sizeof value_size)) return false;
+    key.resize(key_size);
+    value.resize(value_size);
+    return file.read(&key[0], key_size) && file.read(&value[0], value_size);
+}
+
+void Kora::StorageEngine::WriteRecord(std::ostream& file, const char* key, size_t key_size, const char* value, size_t value_size) {
+    file.write(reinterpret_cast<char*>(&key_size), sizeof(key_size));
+    file.write(reinterpret_cast<char*>(&value_size), sizeof(value_size));
+    file.write(key, key_size);
+    file.write(value, value_size);
+}
+
+std::vector<Kora::CompactibleObject> Kora::StorageEngine::CompactibleFiles(int level) {
     std::vector<Kora::CompactibleObject> result;
-    short int file_count = 0;
-    for (auto const& dir_entry: fs::directory_iterator{db_path}) {
-        if (dir_entry.exists() && dir_entry.is_regular_file()) {
-            auto ext = dir_entry.path().extension().string();
-            if (ext == ".sst") {
-                if (dir_entry.file_size() >= _MIN_LEVEL4_SIZE) {
-                    if (file_count == 0) {
-                        CompactibleObject cobj = {dir_entry.path().string(), dir_entry.file_size()};
-                        result.push_back(cobj);
-                        ++file_count;
-                    } else {
-                        CompactibleObject cobj = {dir_entry.path().string(), dir_entry.file_size()};
-                        if (std::find(result.begin(), result.end(), cobj) != result.end()) continue;
-                        result.push_back(cobj);
-                        ++file_count;
-                        break;
-                    }
-                }
-            } else continue;
+    std::lock_guard<std::mutex> lg(_mutex);
+    // only merge segments that are next to each other in age. Merging across a segment in between would move the
+    // records of one of them to the wrong side of it. Settled segments count as the largest tier, but two of them
+    // were already found not to overlap
+    CompactibleObject previous{};
+    int previous_level = 0;
+    for (const auto& [filename, filepath]: _sstables) {
+        std::error_code ec;
+        CompactibleObject cobj = {filepath, SegmentSize(filepath, ec)};
+        if (ec) cobj.size = 0;
+        int cobj_level = LevelOf(filepath, cobj.size);
+        if (!previous.filepath.empty() && std::min(previous_level, 4) == level && std::min(cobj_level, 4) == level &&
+            (previous_level != _SETTLED_LEVEL || cobj_level != _SETTLED_LEVEL)) {
+            result.push_back(previous);
+            result.push_back(cobj);
+            break;
         }
+        previous = cobj;
+        previous_level = cobj_level;
     }
     return result;
 }
 
 void Kora::StorageEngine::BuildSSTableMap() {
-    auto db_path = Kora::getDBPath();
-    if (!fs::exists(db_path)) return;
-    for (auto const& dir_entry: fs::directory_iterator{db_path}) {
+    if (!fs::exists(_db_path)) return;
+    std::vector<fs::path> unfinished;
+    for (auto const& dir_entry: fs::directory_iterator{_db_path}) {
         if (dir_entry.exists() && dir_entry.is_regular_file()) {
             auto ext = dir_entry.path().extension().string();
             if (ext == ".sst") {
                 long filename = Kora::getSegmentFileAsLong(dir_entry.path().filename());
                 _sstables.insert(std::make_pair(filename, dir_entry.path().string()));
+                // carry on numbering after the newest segment
+                if (filename > _file_number) _file_number = filename;
+                std::ifstream segment(dir_entry.path(), std::ios::binary);
+                SegmentRangeTombstones range_tombstones;
+                range_tombstones.data_offset = ReadRangeTombstones(segment, range_tombstones.ranges);
+                _segment_indexes.emplace(dir_entry.path().string(), SegmentIndex::Open(dir_entry.path(), range_tombstones.data_offset,
+                                                                                       _options.block_cache, _options.memory_manager, &_statistics));
+                if (!range_tombstones.ranges.Empty()) _segment_range_tombstones.emplace(dir_entry.path().string(), std::move(range_tombstones));
+            } else if (ext == ".blob") {
+                long number = Kora::getSegmentFileAsLong(dir_entry.path().filename());
+                _blob_files.emplace(number, std::make_shared<BlobFile>(dir_entry.path(), number));
+                if (number > _file_number) _file_number = number;
+            } else if (ext == ".tmp" && dir_entry.path().stem().extension() == ".sst") {
+                // a flush or compaction that was cut short. Its input is still around, so the partial output can go
+                unfinished.push_back(dir_entry.path());
             } else continue;
         }
     }
-}
-
-
-void Kora::StorageEngine::BuildIndexes() {
-    auto db_path = Kora::getDBPath();
-    if (!fs::exists(db_path)) return;
-    for (auto const& dir_entry: fs::directory_iterator{db_path}) {
-        if (dir_entry.exists() && dir_entry.is_regular_file()) {
-            auto ext = dir_entry.path().extension().string();
-            if (ext == ".sst") {
-                CreateIndexFromCompactedSegment(dir_entry.path().string());
-            } else continue;
+    for (const auto& path: unfinished) fs::remove(path);
+    if (_blob_files.empty()) return;
+
+    // which blob values are still live is only known from the references in the segments
+    for (const auto& [number, filepath]: _sstables) {
+        SegmentIterator segment(filepath, RangeTombstonesOf(filepath).data_offset, IndexOf(filepath), nullptr, _options.readahead_size);
+        BlobIndex index;
+        for (segment.SeekToFirst(); segment.Valid(); segment.Next()) {
+            if (!DecodeBlobRecord(segment.value(), index)) continue;
+            auto blob_file = _blob_files.find(index.file_number);
+            if (blob_file != _blob_files.end()) blob_file->second->AddLiveBytes(index.RecordSize(segment.key().size()));
         }
     }
+    // blob files nothing refers to, e.g. left behind by a flush that was cut short
+    for (auto it = _blob_files.begin(); it != _blob_files.end();) {
+        if (it->second->LiveBytes() > 0) {
+            ++it;
+            continue;
+        }
+        it->second->MarkObsolete();
+        it = _blob_files.erase(it);
+    }
 }
 
+
 /**
  * This method reads the log file, writes each entry to a memtable which would eventually be written out to disk and compacted, hence updating the records.
  */
 void Kora::StorageEngine::UpdateSSTablesFromLogFile(StorageEngine *SE) {
-    auto path = Kora::getDBPath();
-    path /= "log.kdb";
-    if(!fs::exists(path)) return;
-    std::ifstream file {path, std::ios::binary};
-
-    size_t key_size = 0, value_size = 0, count = 0, starting_byte = 0, total_size = 0, first = 0;
-
-    std::string key, value, key2, value2;
-
-    std::map<std::string, size_t> hash_index;
-
-    if (file.good()) {
-        while(!file.eof()) {
-            file.seekg(total_size);
-            size_t f1_pos = file.tellg();
-
-            file.read(reinterpret_cast<char*>(&key_size), sizeof key_size);
-            total_size += sizeof key_size;
-
-            file.read(reinterpret_cast<char*>(&value_size), sizeof value_size);
-            total_size += sizeof value_size;
+    auto db_path = SE->_db_path;
+    // log files and recyclable log files by number. log.kdb is the active log file of versions that renamed it on
+    // sealing, and holds the newest records
+    std::map<uint64_t, fs::path> logs, recyclable_logs;
+    auto legacy_log = db_path / "log.kdb";
+    if (fs::exists(db_path)) {
+        for (auto const& dir_entry: fs::directory_iterator{db_path}) {
+            auto filename = dir_entry.path().filename().string();
+            if (dir_entry.path().extension() != ".kdb") continue;
+            if (filename.rfind("log_", 0) == 0) logs.emplace(std::stoull(filename.substr(4), nullptr, 10), dir_entry.path());
+            if (filename.rfind("recycle_", 0) == 0) recyclable_logs.emplace(std::stoull(filename.substr(8), nullptr, 10), dir_entry.path());
+        }
+    }
+    // numbers only grow, so whatever a recycled file still holds can never pass for records of a later log
+    if (!logs.empty()) SE->_log_number = logs.rbegin()->first;
+    if (!recyclable_logs.empty()) SE->_log_number = std::max(SE->_log_number, recyclable_logs.rbegin()->first);
+
+    // log files without checksums can't tell their own records from older ones, so they are never recycled
+    std::vector<fs::path> unchecksummed_logs;
+    for (auto it = logs.begin(); it != logs.end();) {
+        if (ReplayLogFile(it->second, it->first, SE)) {
+            ++it;
+            continue;
+        }
+        unchecksummed_logs.push_back(it->second);
+        it = logs.erase(it);
+    }
+    if (fs::exists(legacy_log)) {
+        ReplayLogFile(legacy_log, 0, SE);
+        unchecksummed_logs.push_back(legacy_log);
+    }
 
-            key.resize(key_size);
-            file.read(&key[0],key_size);
-            total_size += key_size;
+    std::unique_lock<std::mutex> ulock(SE->_mutex);
+    for (const auto& [number, path]: recyclable_logs) SE->RecycleLogFile(path, number);
+    // memtables that filled up during the replay only live in the old log files until they are flushed
+    SE->_cond.wait(ulock, [SE] { return SE->_immutable_memtables.empty(); });
+
+    // what is left in the memtable becomes the content of a fresh active log file, which is on disk before the old
+    // log files are let go, so a crash at any point leaves log files that replay to the same state
+    auto log = SE->NewLogFile();
+    if (!log) {
+        SE->_committed_batches.clear();
+        SE->_done_updating_sstables = true;
+        return;
+    }
+    if (!SE->_range_tombstones.Empty()) {
+        // the range tombstones go first, the memtable entries are newer than them
+        auto encoded = SE->_range_tombstones.Encode();
+        log->AddRecord(_RANGE_TOMBSTONE_RECORD.data(), _RANGE_TOMBSTONE_RECORD.size(), encoded.data(), encoded.size());
+    }
+    for (const auto& [key, value]: SE->_memtable) log->AddRecord(key.data(), key.size(), value.data(), value.size());
+    log->Sync();
+    {
+        std::lock_guard<std::mutex> lg(SE->_log_mutex);
+        SE->_log = std::move(log);
+    }
+    for (const auto& [number, path]: logs) SE->RecycleLogFile(path, number);
+    for (const auto& path: unchecksummed_logs) fs::remove(path);
+    SE->_committed_batches.clear();
+    SE->_done_updating_sstables = true;
+}
 
-            value.resize(value_size);
-            file.read(&value[0],value_size);
-            total_size += value_size;
+bool Kora::StorageEngine::ReplayLogFile(const fs::path& path, uint64_t number, StorageEngine *SE) {
+    LogReader file{path, number, SE->_options.readahead_size};
+    std::string key, value;
+    // a record cut short by a crash in the middle of an append, or left over from the file's previous use, ends the
+    // replay
+    RangeTombstones ranges;
+    while (file.ReadRecord(key, value)) {
+        if (key == _RANGE_TOMBSTONE_RECORD) {
+            if (ranges.Decode(value)) SE->ReplayRangeTombstones(ranges);
+            continue;
+        }
+        if (key != _BATCH_RECORD) {
             SE->Set(Data(std::move(key)), Data(std::move(value)), true);
-            file.get();
+            continue;
+        }
+        std::istringstream batch(value);
+        uint64_t batch_id = 0;
+        batch.read(reinterpret_cast<char*>(&batch_id), sizeof batch_id);
+        // part of a batch spanning several engines that crashed before it was committed
+        if (batch_id != 0 && SE->_committed_batches.count(batch_id) == 0) continue;
+        std::string batch_key, batch_value;
+        while (ReadRecord(batch, batch_key, batch_value)) {
+            if (batch_key == _RANGE_TOMBSTONE_RECORD) {
+                if (ranges.Decode(batch_value)) SE->ReplayRangeTombstones(ranges);
+                continue;
+            }
+            SE->Set(Data(std::move(batch_key)), Data(std::move(batch_value)), true);
         }
     }
-    file.close();
-    Kora::StorageEngine::_done_updating_sstables = true;
-    // Clear Log file after updating
-    // ClearLogFile();
+    return file.Checksummed();
 }
 
-void Kora::StorageEngine::DiscardDeletedKey(std::string input_key, long most_recent_filename) {
-    try {
-        for (const auto& [filename, filepath]: Kora::StorageEngine::_sstables) {
-            if (filename > most_recent_filename) continue;
-
-            if(!fs::exists(filepath)) return;
-
-            std::ifstream file {filepath, std::ios::binary};
+void Kora::StorageEngine::SyncFile(const fs::path& path) {
+    // streams can't be synced, so sync the file through its own descriptor once the stream has been flushed
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
 
-            // create temp file
-            fs::path temp_file_path { filepath.substr(0, filepath.find_last_of(".")) + "_temp.sst"};
-            std::ofstream temp_file {temp_file_path, std::ios::binary};
-            if (file.good() && temp_file.good()) {
-                // store contents of file here temporarily
-                std::copy_n(std::istreambuf_iterator<char>(file), fs::file_size(filepath), std::ostreambuf_iterator<char>(temp_file));
-                temp_file.close();
+Kora::Status Kora::StorageEngine::CreateCheckpoint(const fs::path& dir, std::vector<std::string>& files) {
+    std::vector<std::shared_ptr<LogWriter>> logs;
+    // the files that can't be linked, e.g. because dir is on another filesystem, are only opened under _mutex and
+    // copied once it is released. The descriptors keep what the files held even if a compaction removes or replaces
+    // them in the meantime
+    std::vector<std::pair<int, fs::path>> copies;
+    Status status;
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        std::vector<fs::path> immutable_files;
+        for (const auto& [number, filepath]: _sstables) immutable_files.emplace_back(filepath);
+        for (const auto& [number, blob_file]: _blob_files) immutable_files.push_back(blob_file->Path());
+        // once linked, a file stays in the checkpoint whatever happens to it here
+        for (const auto& path: immutable_files) {
+            std::error_code ec;
+            fs::create_hard_link(path, dir / path.filename(), ec);
+            if (ec) {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    status = Status::IoError("Unable to open " + path.string() + " for checkpoint " + dir.string());
+                    break;
+                }
+                copies.emplace_back(fd, path);
             }
+            files.push_back(path.filename().string());
+        }
+        // log files are overwritten in place when they are recycled, so they are copied rather than linked. Holding
+        // them keeps them from being recycled until they are
+        for (const auto& immutable: _immutable_memtables) {
+            if (immutable.log) logs.push_back(immutable.log);
+        }
+        std::lock_guard<std::mutex> log_lg(_log_mutex);
+        if (_log) logs.push_back(_log);
+    }
+    for (const auto& [fd, path]: copies) {
+        if (status.isOk() && !CopyOpenFile(fd, dir / path.filename())) {
+            status = Status::IoError("Unable to copy " + path.string() + " into checkpoint " + dir.string());
+        }
+        ::close(fd);
+    }
+    if (!status.isOk()) return status;
+    // the records appended so far are all the checkpoint gets of the active log
+    for (const auto& log: logs) {
+        auto name = log->Path().filename();
+        if (!log->CopyTo(dir / name)) return Status::IoError("Unable to copy " + log->Path().string() + " into checkpoint " + dir.string());
+        files.push_back(name.string());
+    }
+    return {};
+}
 
-            size_t key_size = 0, value_size = 0, count = 0, starting_byte = 0, total_size = 0, prev_total_size = 0, first = 0;
-
-            std::string key, value, key2, value2;
-
-            std::map<std::string, size_t> hash_index;
-
-            while(!file.eof()) {
-                file.seekg(prev_total_size);
-                prev_total_size = total_size;
-                file.seekg(prev_total_size);
-                size_t f1_pos = file.tellg();
+uintmax_t Kora::StorageEngine::SegmentSize(const std::string& filepath, std::error_code& ec) {
+    struct stat st{};
+    if (::stat(filepath.c_str(), &st) != 0) {
+        ec.assign(errno, std::generic_category());
+        return 0;
+    }
+    ec.clear();
+    // the blocks of a small file round its size up
+    return std::min<uintmax_t>(st.st_size, static_cast<uintmax_t>(st.st_blocks) * 512);
+}
 
-                file.read(reinterpret_cast<char*>(&key_size), sizeof key_size);
-                total_size += sizeof key_size;
+int Kora::StorageEngine::SegmentLevel(uintmax_t size) {
+    if (size < _MAX_MEMTABLE_SIZE) return 0;
+    if (size <= _MAX_LEVEL1_SIZE) return 1;
+    if (size <= _MAX_LEVEL2_SIZE) return 2;
+    if (size <= _MAX_LEVEL3_SIZE) return 3;
+    return 4;
+}
 
-                file.read(reinterpret_cast<char*>(&value_size), sizeof value_size);
-                total_size += sizeof value_size;
+Kora::Result Kora::StorageEngine::GetProperty(const std::string& property) {
+    if (property == "kora.stats") return Result(Kora::Status::OK(), StatsString());
+    if (property == "kora.num-segments") return Result(Kora::Status::OK(), std::to_string(sstableCount(_db_path)));
+    if (property == "kora.num-immutable-memtables") {
+        std::lock_guard<std::mutex> lg(_mutex);
+        return Result(Kora::Status::OK(), std::to_string(_immutable_memtables.size()));
+    }
+    if (property == "kora.write-stall-condition") {
+        return Result(Kora::Status::OK(), WriteController::ConditionName(_write_controller.Condition()) + " (" +
+                                          WriteController::CauseName(_write_controller.Cause()) + ")");
+    }
+    if (property == "kora.actual-delayed-write-rate") {
+        return Result(Kora::Status::OK(), std::to_string(_write_controller.DelayedWriteRate()));
+    }
+    if (property == "kora.memory-usage") return Result(Kora::Status::OK(), _options.memory_manager->ToString());
+    if (property == "kora.segment-index-memory") {
+        // one line per segment, newest first
+        std::stringstream ss;
+        std::lock_guard<std::mutex> lg(_mutex);
+        for (const auto& [filename, filepath]: _sstables) {
+            auto index = IndexOf(filepath);
+            ss << fs::path(filepath).filename().string() << ": ";
+            if (!index || !index->HasIndex()) {
+                ss << "no index\n";
+                continue;
+            }
+            ss << index->MemoryUsage() << " bytes in memory, " << index->NumPartitions() << " partitions of "
+               << index->IndexPartitionBytes() << " index bytes and " << index->FilterPartitionBytes() << " filter bytes on disk";
+            if (index->HasLearnedIndex()) ss << ", a learned index of " << index->NumLearnedModels() << " models";
+            if (_options.prefix_extractor && index->HasPrefixFilters(*_options.prefix_extractor)) ss << ", prefix filters";
+            ss << "\n";
+        }
+        return Result(Kora::Status::OK(), ss.str());
+    }
+    return Result(Kora::Status::NotFound("Unknown property " + property));
+}
 
-                key.resize(key_size);
-                file.read(&key[0],key_size);
-                total_size += key_size;
+void Kora::StorageEngine::TierSizes(uintmax_t level_files[_SETTLED_LEVEL + 1], uintmax_t level_bytes[_SETTLED_LEVEL + 1]) {
+    for (const auto& [filename, filepath]: _sstables) {
+        std::error_code ec;
+        uintmax_t size = SegmentSize(filepath, ec);
+        if (ec) continue;
+        int level = LevelOf(filepath, size);
+        ++level_files[level];
+        level_bytes[level] += size;
+    }
+}
 
-                value.resize(value_size);
-                file.read(&value[0],value_size);
-                total_size += value_size;
-                // if deleted, remove from file
-                if (key.compare(input_key) == 0) {
-                    // resize file from 0 to prev_total_size
-                    file.close();
-                    {
-                        std::ofstream f{filepath, std::ios::binary}; // open main file in output mode
-                        std::ifstream tempf{temp_file_path, std::ios::binary}; // open temp file in input mode
-                        fs::resize_file(filepath, prev_total_size); // resize file to the total size before the deleted entry
-                        std::copy_n(std::istreambuf_iterator<char>(tempf), prev_total_size, std::ostreambuf_iterator<char>(f));
-                        tempf.seekg(total_size); // seek to the next entry after the deleted entry
-                        if (total_size < fs::file_size(temp_file_path)) std::copy_n(std::istreambuf_iterator<char>(tempf), fs::file_size(temp_file_path) - total_size, std::ostreambuf_iterator<char>(f));
-                        tempf.close();
-                        break;
-                    }
-                    file = std::ifstream {filepath, std::ios::binary};
-                    file.seekg(prev_total_size);
-                }
-                file.get();
-            }
-            file.seekg(0);
-            file.close();
-            fs::remove(temp_file_path);
+std::string Kora::StorageEngine::StatsString() {
+    uintmax_t level_files[_SETTLED_LEVEL + 1] = {}, level_bytes[_SETTLED_LEVEL + 1] = {};
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        TierSizes(level_files, level_bytes);
+    }
+    // a tier with at least two segments has work waiting for the compaction thread
+    uintmax_t pending_compaction_bytes = 0;
+    for (int level = 1; level <= 4; level++) {
+        if (level_files[level] >= 2) pending_compaction_bytes += level_bytes[level];
+    }
+    size_t memtable_entries, immutable_memtables, blob_files, indexed_segments = 0, learned_segments = 0, index_memory = 0;
+    uint64_t blob_file_bytes = 0, blob_live_bytes = 0, index_partition_bytes = 0, filter_partition_bytes = 0;
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        memtable_entries = _memtable.size();
+        immutable_memtables = _immutable_memtables.size();
+        blob_files = _blob_files.size();
+        for (const auto& [filepath, index]: _segment_indexes) {
+            if (!index->HasIndex()) continue;
+            ++indexed_segments;
+            if (index->HasLearnedIndex()) ++learned_segments;
+            index_memory += index->MemoryUsage();
+            index_partition_bytes += index->IndexPartitionBytes();
+            filter_partition_bytes += index->FilterPartitionBytes();
+        }
+        for (const auto& [number, blob_file]: _blob_files) {
+            blob_file_bytes += blob_file->FileSize();
+            blob_live_bytes += std::min(blob_file->LiveBytes(), blob_file->FileSize());
         }
-    } catch (...) {
-        std::cout << " Error ocurred with deleting tombstones\n";
     }
+
+    auto ticker = [this](Ticker t) { return _statistics.GetTickerCount(t); };
+    double user_bytes = ticker(BYTES_WRITTEN);
+    double disk_bytes = ticker(WAL_BYTES) + ticker(FLUSH_BYTES_WRITTEN) + ticker(COMPACT_WRITE_BYTES) + ticker(BLOB_FILE_BYTES_WRITTEN);
+    auto probes = _statistics.GetHistogram(GET_SEGMENTS_PROBED);
+    auto flushes = _statistics.GetHistogram(FLUSH_MICROS);
+    auto compactions = _statistics.GetHistogram(COMPACTION_MICROS);
+
+    std::stringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(2);
+    ss << "** Kora Stats **\n";
+    ss << "Uptime(secs): " << _statistics.UptimeMicros() / 1e6 << "\n";
+    ss << "Memtable entries: " << memtable_entries << ", memtables waiting for flush: " << immutable_memtables << ", "
+       << ticker(MEMTABLE_APPENDS) << " writes appended in key order\n";
+    ss << "Tier  Files  Size(MB)\n";
+    // L5 are the settled segments of the largest tier
+    for (int level = 0; level <= _SETTLED_LEVEL; level++) {
+        ss << "  L" << level << "  " << level_files[level] << "  " << level_bytes[level] / 1048576.0 << "\n";
+    }
+    ss << "Pending compaction bytes: " << pending_compaction_bytes << "\n";
+    ss << "Writes: " << ticker(NUMBER_KEYS_WRITTEN) << " sets, " << ticker(NUMBER_KEYS_DELETED) << " deletes, "
+       << ticker(NUMBER_MERGES) << " merges, " << ticker(NUMBER_RANGE_DELETES) << " range deletes, "
+       << user_bytes / 1048576.0 << " MB user data\n";
+    ss << "WAL: " << ticker(WAL_WRITES) << " appends, " << ticker(WAL_BYTES) / 1048576.0 << " MB, "
+       << ticker(WAL_FILES_RECYCLED) << " files recycled\n";
+    ss << "Flush: " << ticker(FLUSH_COUNT) << " flushes, " << ticker(FLUSH_BYTES_WRITTEN) / 1048576.0 << " MB, "
+       << flushes.Average() / 1000.0 << " ms avg\n";
+    ss << "Compaction: " << ticker(COMPACTION_COUNT) << " compactions, " << ticker(COMPACT_READ_BYTES) / 1048576.0
+       << " MB read, " << ticker(COMPACT_WRITE_BYTES) / 1048576.0 << " MB written, "
+       << (compactions.Sum() > 0 ? ticker(COMPACT_READ_BYTES) / 1048576.0 / (compactions.Sum() / 1e6) : 0.0) << " MB/s read, "
+       << compactions.Average() / 1000.0
+       << " ms avg, " << ticker(COMPACT_KEYS_DROPPED) << " overwritten keys, " << ticker(COMPACT_RANGE_DELETED_KEYS)
+       << " range deleted keys and " << ticker(COMPACT_TOMBSTONES_DROPPED) << " tombstones dropped\n";
+    // share of the compaction time each stage of the pipeline was busy. Every compaction reads two inputs at once.
+    // The key ranges of compactions split into subcompactions are merged at the same time, so their stages add up
+    auto stage_busy = [&](Ticker t, int threads) {
+        return compactions.Sum() > 0 ? ticker(t) * 100.0 / (compactions.Sum() * threads) : 0.0;
+    };
+    ss << "Compaction stages: read " << stage_busy(COMPACT_READ_STAGE_MICROS, 2) << "%, merge "
+       << stage_busy(COMPACT_MERGE_STAGE_MICROS, 1) << "%, write " << stage_busy(COMPACT_WRITE_STAGE_MICROS, 1) << "% busy, "
+       << ticker(SUBCOMPACTIONS) << " subcompactions, " << ticker(COMPACT_TRIVIAL_MOVES)
+       << " moves of segments that don't overlap\n";
+    ss << "Compaction filter: " << ticker(COMPACT_FILTER_REMOVED_KEYS) << " removed, "
+       << ticker(COMPACT_FILTER_CHANGED_VALUES) << " changed\n";
+    ss << "Blob files: " << blob_files << " files, " << blob_file_bytes / 1048576.0 << " MB, "
+       << (blob_file_bytes - blob_live_bytes) / 1048576.0 << " MB garbage, " << ticker(BLOB_GC_FILES) << " removed, "
+       << ticker(BLOB_GC_BYTES_RELOCATED) / 1048576.0 << " MB relocated by garbage collection\n";
+    ss << "Segment index: " << indexed_segments << " segments, " << index_memory / 1024.0 << " KB in memory, "
+       << index_partition_bytes / 1048576.0 << " MB index and " << filter_partition_bytes / 1048576.0
+       << " MB filter partitions on disk, " << learned_segments << " with a learned index, " << ticker(LEARNED_INDEX_HIT)
+       << " predictions within its error bound and " << ticker(LEARNED_INDEX_MISS) << " outside\n";
+    ss << "Prefix filters: " << ticker(PREFIX_FILTER_CHECKED) << " checked, " << ticker(PREFIX_FILTER_USEFUL)
+       << " ruled out a memtable or segment\n";
+    const auto& memory = *_options.memory_manager;
+    ss << "Memory: " << memory.TotalUsage() / 1048576.0 << " MB used of " << memory.Budget() / 1048576.0 << " MB budget ("
+       << (memory.Usage(MemoryKind::_MEMTABLE) + memory.Usage(MemoryKind::_IMMUTABLE_MEMTABLE)) / 1048576.0 << " MB memtables, "
+       << memory.BlockCacheUsage() / 1048576.0 << " MB block cache, " << memory.Usage(MemoryKind::_PINNED_INDEX) / 1048576.0
+       << " MB pinned index, " << memory.Usage(MemoryKind::_ITERATOR) / 1048576.0 << " MB iterators), "
+       << ticker(MEMORY_BUDGET_FLUSHES) << " early flushes\n";
+    ss << "Block cache: " << _options.block_cache->Usage() / 1048576.0 << " of " << _options.block_cache->Capacity() / 1048576.0
+       << " MB used, " << ticker(BLOCK_CACHE_HIT) << " hits, " << ticker(BLOCK_CACHE_MISS) << " misses, "
+       << ticker(BLOOM_FILTER_USEFUL) << " lookups ruled out by Bloom filters, " << ticker(BLOCK_HASH_INDEX_HIT)
+       << " block hash index hits and " << ticker(BLOCK_HASH_INDEX_COLLISION) << " collisions\n";
+    if (_options.row_cache) {
+        uint64_t lookups = ticker(ROW_CACHE_HIT) + ticker(ROW_CACHE_MISS);
+        ss << "Row cache: " << _options.row_cache->Usage() / 1048576.0 << " of " << _options.row_cache->Capacity() / 1048576.0
+           << " MB used, " << ticker(ROW_CACHE_HIT) << " hits, " << ticker(ROW_CACHE_MISS) << " misses, "
+           << (lookups > 0 ? 100.0 * ticker(ROW_CACHE_HIT) / lookups : 0.0) << "% hit rate\n";
+    }
+    ss << "Write amplification: " << (user_bytes > 0 ? disk_bytes / user_bytes : 0.0) << "\n";
+    ss << "Write stall condition: " << WriteController::ConditionName(_write_controller.Condition()) << " (cause: "
+       << WriteController::CauseName(_write_controller.Cause()) << "), delayed write rate "
+       << _write_controller.DelayedWriteRate() / 1048576.0 << " MB/s\n";
+    ss << "Write stalls: " << ticker(STALL_DELAYED_WRITES) << " delayed, " << ticker(STALL_STOPPED_WRITES) << " stopped, "
+       << ticker(STALL_MICROS) / 1000.0 << " ms total (memtable-limit " << ticker(STALL_MEMTABLE_LIMIT_MICROS) / 1000.0
+       << " ms, segment-limit " << ticker(STALL_SEGMENT_LIMIT_MICROS) / 1000.0 << " ms, pending-compaction-bytes "
+       << ticker(STALL_PENDING_COMPACTION_MICROS) / 1000.0 << " ms)\n";
+    ss << "Gets: " << ticker(NUMBER_KEYS_READ) << " reads, " << ticker(NUMBER_KEYS_FOUND) << " found, "
+       << ticker(MEMTABLE_HIT) << " memtable hits, " << probes.Average() << " segments probed per miss\n";
+    ss << "\n" << _statistics.ToString();
+    return ss.str();
 }
 
-void Kora::StorageEngine::ClearLogFile() {
-    static int count;
-    auto path = getDBPath();
-    path /= "log.kdb";
-    try {
-        fs::resize_file(path, 0);
-    } catch (fs::filesystem_error const& ex) {
-        // TODO: FIgure out how to handle this better
-        std::cout << "Error clearing log file\n";
+void Kora::StorageEngine::DumpStats() {
+    auto path = _db_path / "LOG";
+    std::ofstream log(path.string(), std::ios_base::app);
+    if (log.is_open()) {
+        auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        log << "------- DUMPING STATS at " << std::ctime(&time) << StatsString() << "\n";
     }
 }
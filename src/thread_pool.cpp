@@ -0,0 +1,83 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+
+Kora::ThreadPool::ThreadPool(int threads) {
+    SetBackgroundThreads(threads);
+}
+
+Kora::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        _shutting_down = true;
+    }
+    _cond.notify_all();
+    for (auto& thread: _threads) thread.join();
+}
+
+void Kora::ThreadPool::Schedule(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        _queue.push_back(std::move(job));
+    }
+    _cond.notify_all();
+}
+
+void Kora::ThreadPool::SetBackgroundThreads(int threads) {
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        SetLimit(threads);
+    }
+    _cond.notify_all();
+}
+
+void Kora::ThreadPool::EnsureBackgroundThreads(int threads) {
+    {
+        std::lock_guard<std::mutex> lg(_mutex);
+        if (threads <= _limit) return;
+        SetLimit(threads);
+    }
+    _cond.notify_all();
+}
+
+void Kora::ThreadPool::SetLimit(int threads) {
+    _limit = std::max(threads, 1);
+    while (static_cast<int>(_threads.size()) < _limit) {
+        int index = static_cast<int>(_threads.size());
+        _threads.emplace_back(&ThreadPool::Run, this, index);
+    }
+}
+
+int Kora::ThreadPool::GetBackgroundThreads() {
+    std::lock_guard<std::mutex> lg(_mutex);
+    return _limit;
+}
+
+size_t Kora::ThreadPool::QueueLength() {
+    std::lock_guard<std::mutex> lg(_mutex);
+    return _queue.size();
+}
+
+void Kora::ThreadPool::Run(int index) {
+    std::unique_lock<std::mutex> ulock(_mutex);
+    while (true) {
+        _cond.wait(ulock, [this, index] { return _shutting_down || (index < _limit && !_queue.empty()); });
+        if (_shutting_down) return;
+        auto job = std::move(_queue.front());
+        _queue.pop_front();
+        ulock.unlock();
+        job();
+        ulock.lock();
+    }
+}
+
+Kora::ThreadPool& Kora::ThreadPool::Default(JobPriority priority) {
+    // never destroyed: databases that are themselves static may still be using the pools while the program exits
+    static auto* high = new ThreadPool(1);
+    static auto* low = new ThreadPool(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    return priority == JobPriority::_HIGH ? *high : *low;
+}
@@ -0,0 +1,285 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+const char Kora::TraceWriter::_MAGIC[8] = {'k', 'o', 'r', 'a', 't', 'r', 'c', '1'};
+const size_t Kora::TraceWriter::_BUFFER_SIZE;
+const size_t Kora::TraceWriter::_THREAD_BUFFER_SIZE;
+const uint64_t Kora::TraceWriter::_NO_SEQUENCE;
+std::atomic<uint64_t> Kora::TraceWriter::_next_sequence{0};
+std::atomic<uint64_t> Kora::TraceWriter::_next_id{0};
+
+namespace {
+    const uint8_t SYNC_FLAG = 0x80;
+
+    void PutVarint(std::string& buffer, uint64_t value) {
+        while (value >= 0x80) {
+            buffer.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<char>(value));
+    }
+
+    void PutString(std::string& buffer, const std::string& s) {
+        PutVarint(buffer, s.size());
+        buffer.append(s);
+    }
+
+    bool GetVarint(std::istream& file, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = file.get();
+            if (c == std::char_traits<char>::eof()) return false;
+            value |= static_cast<uint64_t>(c & 0x7f) << shift;
+            if ((c & 0x80) == 0) return true;
+        }
+        return false;
+    }
+
+    bool GetString(std::istream& file, std::string& s) {
+        uint64_t size = 0;
+        if (!GetVarint(file, size) || size > (1ull << 32)) return false;
+        s.resize(size);
+        return size == 0 || static_cast<bool>(file.read(&s[0], static_cast<std::streamsize>(size)));
+    }
+}
+
+Kora::TraceWriter::TraceWriter(const fs::path& path, const TraceOptions& options):
+        _options{options}, _file{path, std::ios::binary | std::ios::trunc}, _start_micros{nowMicros()}, _last_micros{_start_micros} {
+    _buffer.reserve(_BUFFER_SIZE + 4096);
+    _buffer.append(_MAGIC, sizeof _MAGIC);
+}
+
+Kora::TraceWriter::ThreadBuffer* Kora::TraceWriter::CurrentThreadBuffer() {
+    // the buffer of the last trace the thread recorded to, which is usually this one
+    thread_local uint64_t cached_id = _NO_SEQUENCE;
+    thread_local ThreadBuffer* cached_buffer = nullptr;
+    if (cached_id == _id) return cached_buffer;
+    auto owner = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lg(_threads_mutex);
+    auto buffer = std::find_if(_threads.begin(), _threads.end(), [owner](const auto& t) { return t->owner == owner; });
+    if (buffer == _threads.end()) {
+        _threads.push_back(std::make_unique<ThreadBuffer>());
+        _threads.back()->owner = owner;
+        buffer = _threads.end() - 1;
+    }
+    cached_id = _id;
+    cached_buffer = buffer->get();
+    return cached_buffer;
+}
+
+Kora::TraceWriter::ThreadBuffer* Kora::TraceWriter::StartOperation() {
+    if (_closed || _full.load(std::memory_order_relaxed) || !_file.is_open()) return nullptr;
+    auto buffer = CurrentThreadBuffer();
+    // the sequence number the operation takes later can't be lower. A merge that reads the counter after this only
+    // writes out records below low
+    buffer->low = _next_sequence.load();
+    // Close() may have missed low, in which case it doesn't wait for the operation
+    if (_closed) {
+        buffer->low = _NO_SEQUENCE;
+        return nullptr;
+    }
+    return buffer;
+}
+
+void Kora::TraceWriter::AbortOperation(ThreadBuffer* buffer) {
+    if (buffer) buffer->low = _NO_SEQUENCE;
+}
+
+size_t Kora::TraceWriter::BeginRecord(ThreadBuffer& buffer, TraceType type, bool sync) {
+    size_t offset = buffer.data.size();
+    buffer.data.push_back(static_cast<char>(static_cast<uint8_t>(type) | (sync ? SYNC_FLAG : 0)));
+    return offset;
+}
+
+bool Kora::TraceWriter::EndRecord(ThreadBuffer& buffer, uint64_t sequence, size_t offset) {
+    if (sequence == _NO_SEQUENCE) sequence = NextSequence();
+    buffer.entries.push_back({sequence, nowMicros(), offset, buffer.data.size() - offset});
+    buffer.low = _NO_SEQUENCE;
+    return buffer.data.size() >= _THREAD_BUFFER_SIZE;
+}
+
+void Kora::TraceWriter::Merge(bool all) {
+    std::unique_lock<std::mutex> merge_lock(_merge_mutex, std::defer_lock);
+    if (all) merge_lock.lock();
+    else if (!merge_lock.try_lock()) return;
+    std::vector<ThreadBuffer*> threads;
+    {
+        std::lock_guard<std::mutex> lg(_threads_mutex);
+        for (const auto& thread: _threads) threads.push_back(thread.get());
+    }
+    // operations that start from here on get at least the current count. Those in flight get at least the low of
+    // their thread, and every record below the lowest of them is in a thread buffer by now
+    uint64_t watermark = all ? _NO_SEQUENCE : _next_sequence.load();
+    for (auto thread: threads) watermark = std::min<uint64_t>(watermark, thread->low);
+    for (auto thread: threads) {
+        std::lock_guard<std::mutex> lg(thread->mutex);
+        for (const auto& entry: thread->entries) {
+            _pending.push_back({entry.sequence, entry.micros, _pending_data.size(), entry.size});
+            _pending_data.append(thread->data, entry.offset, entry.size);
+        }
+        thread->data.clear();
+        thread->entries.clear();
+    }
+    std::sort(_pending.begin(), _pending.end(), [](const auto& a, const auto& b) { return a.sequence < b.sequence; });
+
+    std::vector<ThreadBuffer::Entry> later;
+    std::string later_data;
+    for (const auto& entry: _pending) {
+        if (entry.sequence >= watermark) {
+            later.push_back({entry.sequence, entry.micros, later_data.size(), entry.size});
+            later_data.append(_pending_data, entry.offset, entry.size);
+            continue;
+        }
+        if (_full) continue;
+        if (_options.max_trace_file_size > 0 && _file_size + _buffer.size() >= _options.max_trace_file_size) {
+            _full = true;
+            continue;
+        }
+        // records are taken after their operations are applied, so a record can have an earlier time than the one
+        // before it
+        _buffer.push_back(_pending_data[entry.offset]);
+        PutVarint(_buffer, entry.micros > _last_micros ? entry.micros - _last_micros : 0);
+        _last_micros = std::max(_last_micros, entry.micros);
+        _buffer.append(_pending_data, entry.offset + 1, entry.size - 1);
+        if (_buffer.size() >= _BUFFER_SIZE) WriteBuffer();
+    }
+    _pending = std::move(later);
+    _pending_data = std::move(later_data);
+}
+
+void Kora::TraceWriter::WriteBuffer() {
+    _file.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+    _file_size += _buffer.size();
+    _buffer.clear();
+}
+
+void Kora::TraceWriter::Set(ThreadBuffer* buffer, uint64_t sequence, const std::string& key, const std::string& value,
+                            bool sync) {
+    if (!buffer) return;
+    bool full;
+    {
+        std::lock_guard<std::mutex> lg(buffer->mutex);
+        size_t offset = BeginRecord(*buffer, TraceType::_SET, sync);
+        PutString(buffer->data, key);
+        PutString(buffer->data, value);
+        full = EndRecord(*buffer, sequence, offset);
+    }
+    if (full) Merge(false);
+}
+
+void Kora::TraceWriter::Get(ThreadBuffer* buffer, uint64_t sequence, const std::string& key) {
+    if (!buffer) return;
+    bool full;
+    {
+        std::lock_guard<std::mutex> lg(buffer->mutex);
+        size_t offset = BeginRecord(*buffer, TraceType::_GET, false);
+        PutString(buffer->data, key);
+        full = EndRecord(*buffer, sequence, offset);
+    }
+    if (full) Merge(false);
+}
+
+void Kora::TraceWriter::Delete(ThreadBuffer* buffer, uint64_t sequence, const std::string& key, bool sync) {
+    if (!buffer) return;
+    bool full;
+    {
+        std::lock_guard<std::mutex> lg(buffer->mutex);
+        size_t offset = BeginRecord(*buffer, TraceType::_DELETE, sync);
+        PutString(buffer->data, key);
+        full = EndRecord(*buffer, sequence, offset);
+    }
+    if (full) Merge(false);
+}
+
+void Kora::TraceWriter::Write(ThreadBuffer* buffer, uint64_t sequence, const WriteBatch& batch, bool sync) {
+    if (!buffer) return;
+    bool full;
+    {
+        std::lock_guard<std::mutex> lg(buffer->mutex);
+        size_t offset = BeginRecord(*buffer, TraceType::_WRITE, sync);
+        PutVarint(buffer->data, batch.Count());
+        for (const auto& op: batch.Ops()) {
+            buffer->data.push_back(static_cast<char>(op.type));
+            PutString(buffer->data, op.key);
+            PutString(buffer->data, op.value);
+        }
+        full = EndRecord(*buffer, sequence, offset);
+    }
+    if (full) Merge(false);
+}
+
+Kora::Status Kora::TraceWriter::Close() {
+    _closed = true;
+    // the operations that started before the trace was closed are still recorded
+    std::vector<ThreadBuffer*> threads;
+    {
+        std::lock_guard<std::mutex> lg(_threads_mutex);
+        for (const auto& thread: _threads) threads.push_back(thread.get());
+    }
+    for (auto thread: threads) {
+        while (thread->low != _NO_SEQUENCE) std::this_thread::yield();
+    }
+    Merge(true);
+    std::lock_guard<std::mutex> lg(_merge_mutex);
+    if (!_file.is_open()) return {};
+    WriteBuffer();
+    _file.close();
+    if (_file.fail()) return Status::IoError("Unable to write the trace file");
+    return {};
+}
+
+Kora::TraceReader::TraceReader(const fs::path& path): _file{path, std::ios::binary} {
+    if (!_file.is_open()) {
+        _status = Status::IoError("Unable to open trace file " + path.string());
+        return;
+    }
+    char magic[sizeof TraceWriter::_MAGIC];
+    if (!_file.read(magic, sizeof magic) || std::memcmp(magic, TraceWriter::_MAGIC, sizeof magic) != 0) {
+        _status = Status::Corruption(path.string() + " is not a trace file");
+    }
+}
+
+bool Kora::TraceReader::Next(TraceRecord& record) {
+    if (!_status.isOk()) return false;
+    int type = _file.get();
+    uint64_t delta = 0;
+    if (type == std::char_traits<char>::eof() || !GetVarint(_file, delta)) return false;
+    _timestamp += delta;
+    record.timestamp = _timestamp;
+    record.sync = (type & SYNC_FLAG) != 0;
+    record.type = static_cast<TraceType>(type & ~SYNC_FLAG);
+    record.key.clear();
+    record.value.clear();
+    record.batch.Clear();
+    switch (record.type) {
+        case TraceType::_SET:
+            return GetString(_file, record.key) && GetString(_file, record.value);
+        case TraceType::_GET:
+        case TraceType::_DELETE:
+            return GetString(_file, record.key);
+        case TraceType::_WRITE: {
+            uint64_t count = 0;
+            if (!GetVarint(_file, count)) return false;
+            std::string key, value;
+            for (uint64_t i = 0; i < count; i++) {
+                int op = _file.get();
+                if (op == std::char_traits<char>::eof() || !GetString(_file, key) || !GetString(_file, value)) return false;
+                switch (static_cast<WriteBatch::OpType>(op)) {
+                    case WriteBatch::OpType::_SET: record.batch.Set(std::move(key), std::move(value)); break;
+                    case WriteBatch::OpType::_DELETE: record.batch.Delete(std::move(key)); break;
+                    case WriteBatch::OpType::_MERGE: record.batch.Merge(std::move(key), std::move(value)); break;
+                    case WriteBatch::OpType::_DELETE_RANGE: record.batch.DeleteRange(std::move(key), std::move(value)); break;
+                    default: return false;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,97 @@
+//
+// Created by kwaku on 19/10/2026.
+//
+
+#include "../include/write_controller.h"
+#include "../include/helper.h"
+
+#include <algorithm>
+
+Kora::WriteController::WriteController(const Options& options) {
+    _max_immutable_memtables = options.max_write_buffer_number > 1 ? options.max_write_buffer_number - 1 : 1;
+    // with only a couple of memtables, slowing down on the last one would throttle every flush
+    _memtable_slowdown_trigger = options.max_write_buffer_number > 3 ? _max_immutable_memtables - 1 : 0;
+    _segment_slowdown_trigger = options.segment_slowdown_writes_trigger;
+    _segment_stop_trigger = options.segment_stop_writes_trigger;
+    _soft_pending_compaction_bytes = options.soft_pending_compaction_bytes_limit;
+    _hard_pending_compaction_bytes = options.hard_pending_compaction_bytes_limit;
+    _base_delayed_write_rate = options.delayed_write_rate > 0 ? options.delayed_write_rate : 1;
+    _delayed_write_rate = _base_delayed_write_rate;
+}
+
+void Kora::WriteController::Update(size_t immutable_memtables, size_t backlog_segments, uint64_t pending_compaction_bytes) {
+    auto condition = WriteStallCondition::_NORMAL;
+    auto cause = WriteStallCause::_NONE;
+    // how far the backlog has moved from its slowdown trigger towards its stop trigger, between 0 and 1
+    double pressure = 0;
+
+    if (_segment_stop_trigger > 0 && backlog_segments >= _segment_stop_trigger) {
+        condition = WriteStallCondition::_STOPPED;
+        cause = WriteStallCause::_SEGMENT_LIMIT;
+    } else if (_hard_pending_compaction_bytes > 0 && pending_compaction_bytes >= _hard_pending_compaction_bytes) {
+        condition = WriteStallCondition::_STOPPED;
+        cause = WriteStallCause::_PENDING_COMPACTION_BYTES;
+    } else if (_memtable_slowdown_trigger > 0 && immutable_memtables >= _memtable_slowdown_trigger) {
+        condition = WriteStallCondition::_DELAYED;
+        cause = WriteStallCause::_MEMTABLE_LIMIT;
+    } else if (_segment_slowdown_trigger > 0 && backlog_segments >= _segment_slowdown_trigger) {
+        condition = WriteStallCondition::_DELAYED;
+        cause = WriteStallCause::_SEGMENT_LIMIT;
+        if (_segment_stop_trigger > _segment_slowdown_trigger) {
+            pressure = static_cast<double>(backlog_segments - _segment_slowdown_trigger) /
+                       static_cast<double>(_segment_stop_trigger - _segment_slowdown_trigger);
+        }
+    } else if (_soft_pending_compaction_bytes > 0 && pending_compaction_bytes >= _soft_pending_compaction_bytes) {
+        condition = WriteStallCondition::_DELAYED;
+        cause = WriteStallCause::_PENDING_COMPACTION_BYTES;
+        if (_hard_pending_compaction_bytes > _soft_pending_compaction_bytes) {
+            pressure = static_cast<double>(pending_compaction_bytes - _soft_pending_compaction_bytes) /
+                       static_cast<double>(_hard_pending_compaction_bytes - _soft_pending_compaction_bytes);
+        }
+    }
+
+    pressure = std::min(1.0, std::max(0.0, pressure));
+    auto rate = static_cast<uint64_t>(static_cast<double>(_base_delayed_write_rate) * (1.0 - 0.875 * pressure));
+    _delayed_write_rate.store(std::max<uint64_t>(rate, 1), std::memory_order_relaxed);
+    _cause.store(cause, std::memory_order_release);
+    _condition.store(condition, std::memory_order_release);
+}
+
+uint64_t Kora::WriteController::GetDelay(uint64_t num_bytes) {
+    if (Condition() != WriteStallCondition::_DELAYED) return 0;
+    uint64_t cost = num_bytes * 1000000 / DelayedWriteRate();
+    std::lock_guard<std::mutex> lg(_mutex);
+    uint64_t now = nowMicros();
+    // don't let time spent running at full speed turn into credit for a burst
+    uint64_t start = std::max(now, _next_write_micros);
+    _next_write_micros = start + cost;
+    return _next_write_micros - now;
+}
+
+std::string Kora::WriteController::ConditionName(WriteStallCondition condition) {
+    switch (condition) {
+        case WriteStallCondition::_NORMAL:
+            return "normal";
+        case WriteStallCondition::_DELAYED:
+            return "delayed";
+        case WriteStallCondition::_STOPPED:
+            return "stopped";
+        default:
+            return "unknown";
+    }
+}
+
+std::string Kora::WriteController::CauseName(WriteStallCause cause) {
+    switch (cause) {
+        case WriteStallCause::_NONE:
+            return "none";
+        case WriteStallCause::_MEMTABLE_LIMIT:
+            return "memtable-limit";
+        case WriteStallCause::_SEGMENT_LIMIT:
+            return "segment-limit";
+        case WriteStallCause::_PENDING_COMPACTION_BYTES:
+            return "pending-compaction-bytes";
+        default:
+            return "unknown";
+    }
+}